@@ -0,0 +1,400 @@
+#include "aggregate.h"
+#include "index.h"
+#include "predicate.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+// целое в double приводится к int64 так же, как в каноническом виде хэш-индекса
+bool isWholeNumber(double number) {
+    return std::isfinite(number) && number == std::floor(number) && std::fabs(number) < 9.0e18;
+}
+
+// ключ группы строкой: тип и значение; целые со знаком и без знака и целые double (1.0) дают один ключ,
+// как при сравнении json и в хэш-индексе
+void appendKey(std::string& out, const Document* value) {
+    if (value == nullptr || value->is_null()) {
+        out.push_back('n');  // нет поля - та же группа, что и null
+    } else if (value->is_string()) {
+        const std::string& text = value->get_ref<const std::string&>();
+        out.push_back('s');
+        out.append(std::to_string(text.size()));
+        out.push_back(':');
+        out.append(text);
+    } else if (value->is_number_unsigned()) {
+        out.push_back('i');
+        out.append(std::to_string(value->get<uint64_t>()));
+    } else if (value->is_number_integer()) {
+        out.push_back('i');
+        out.append(std::to_string(value->get<int64_t>()));
+    } else if (value->is_number_float() && isWholeNumber(value->get<double>())) {
+        out.push_back('i');
+        out.append(std::to_string(static_cast<int64_t>(value->get<double>())));
+    } else if (value->is_boolean()) {
+        out.push_back(value->get<bool>() ? 't' : 'f');
+    } else {
+        // дробные числа, массивы и объекты - в каноническом виде индекса (1.0 внутри массива тоже как 1)
+        std::string text = HashIndex::keyOf(*value);
+        out.push_back('j');
+        out.append(std::to_string(text.size()));
+        out.push_back(':');
+        out.append(text);
+    }
+}
+
+bool parseAccumulator(const std::string& name, const Document& spec, AccumulatorSpec& result) {
+    if (!spec.is_object() || spec.size() != 1) {
+        std::cerr << "Accumulator '" << name << "' must be an object with one operator" << std::endl;
+        return false;
+    }
+    std::string op = spec.begin().key();
+    result.name = name;
+    result.argument = AggregateExpression::parse(spec.begin().value());
+    if (op == "$sum") {
+        result.op = AccumulatorOp::Sum;
+    } else if (op == "$avg") {
+        result.op = AccumulatorOp::Avg;
+    } else if (op == "$min") {
+        result.op = AccumulatorOp::Min;
+    } else if (op == "$max") {
+        result.op = AccumulatorOp::Max;
+    } else if (op == "$count") {
+        result.op = AccumulatorOp::Count;
+    } else {
+        std::cerr << "Unknown accumulator '" << op << "' in '" << name << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+}
+
+AggregateExpression AggregateExpression::parse(const Document& spec) {
+    AggregateExpression expression;
+    if (spec.is_string()) {
+        const std::string& text = spec.get_ref<const std::string&>();
+        if (text.size() > 1 && text[0] == '$') {
+            expression.is_field = true;
+            expression.field = text.substr(1);
+            return expression;
+        }
+    }
+    expression.constant = spec;
+    return expression;
+}
+
+const Document* AggregateExpression::resolve(const DocumentWrapper& doc, Document& scratch) const {
+    if (!is_field) {
+        return &constant;
+    }
+    return doc.findField(field, scratch);
+}
+
+void AccumulatorState::addInteger(int64_t value) {
+    int64_t sum = 0;
+    if (__builtin_add_overflow(integer_sum, value, &sum)) {
+        // дальше сумма в double
+        float_sum += static_cast<double>(value);
+        integer_only = false;
+    } else {
+        integer_sum = sum;
+    }
+}
+
+void AccumulatorState::add(AccumulatorOp op, const Document* value) {
+    switch (op) {
+    case AccumulatorOp::Count:
+        count++;
+        break;
+    case AccumulatorOp::Sum:
+    case AccumulatorOp::Avg:
+        // не числа пропускаются
+        if (value == nullptr || !value->is_number()) {
+            break;
+        }
+        count++;
+        if (value->is_number_float()) {
+            float_sum += value->get<double>();
+            integer_only = false;
+        } else if (value->is_number_unsigned() && value->get<uint64_t>() > static_cast<uint64_t>(std::numeric_limits<int64_t>::max())) {
+            float_sum += static_cast<double>(value->get<uint64_t>());
+            integer_only = false;
+        } else {
+            addInteger(value->get<int64_t>());
+        }
+        break;
+    case AccumulatorOp::Min:
+    case AccumulatorOp::Max:
+        // как и $sum, null и отсутствующие поля не учитываются
+        if (value == nullptr || value->is_null()) {
+            break;
+        }
+        if (!has_extreme || (op == AccumulatorOp::Min ? *value < extreme : extreme < *value)) {
+            extreme = *value;
+            has_extreme = true;
+        }
+        break;
+    }
+}
+
+void AccumulatorState::merge(AccumulatorOp op, const AccumulatorState& other) {
+    count += other.count;
+    float_sum += other.float_sum;
+    if (!other.integer_only) {
+        integer_only = false;
+    }
+    addInteger(other.integer_sum);
+    if (other.has_extreme) {
+        add(op, &other.extreme);
+    }
+}
+
+Document AccumulatorState::result(AccumulatorOp op) const {
+    switch (op) {
+    case AccumulatorOp::Count:
+        return count;
+    case AccumulatorOp::Sum:
+        if (integer_only) {
+            return integer_sum;
+        }
+        return float_sum + static_cast<double>(integer_sum);
+    case AccumulatorOp::Avg:
+        if (count == 0) {
+            return nullptr;
+        }
+        return (float_sum + static_cast<double>(integer_sum)) / static_cast<double>(count);
+    case AccumulatorOp::Min:
+    case AccumulatorOp::Max:
+        return has_extreme ? extreme : Document();
+    }
+    return nullptr;
+}
+
+GroupTable::GroupTable(const AggregationPipeline& owner) : pipeline(owner) {}
+
+void GroupTable::buildKey(const DocumentWrapper& doc) {
+    key.clear();
+    Document scratch;
+    if (!pipeline.compound_key) {
+        appendKey(key, pipeline.group_key.resolve(doc, scratch));
+        return;
+    }
+    for (size_t i = 0; i < pipeline.group_fields.size(); ++i) {
+        appendKey(key, pipeline.group_fields[i].second.resolve(doc, scratch));
+        key.push_back(',');
+    }
+}
+
+Document GroupTable::groupId(const DocumentWrapper& doc) const {
+    Document scratch;
+    if (!pipeline.compound_key) {
+        const Document* value = pipeline.group_key.resolve(doc, scratch);
+        return value != nullptr ? *value : Document();
+    }
+    Document id = Document::object();
+    for (size_t i = 0; i < pipeline.group_fields.size(); ++i) {
+        const Document* value = pipeline.group_fields[i].second.resolve(doc, scratch);
+        id[pipeline.group_fields[i].first] = value != nullptr ? *value : Document();
+    }
+    return id;
+}
+
+void GroupTable::add(const DocumentWrapper& doc) {
+    buildKey(doc);
+    GroupState* group = groups.find(key);
+    if (group == nullptr) {
+        GroupState created;
+        created.id = groupId(doc);
+        created.values = Vector<AccumulatorState>(pipeline.accumulators.size());
+        groups.put(key, std::move(created));
+        group = groups.find(key);
+    }
+    Document scratch;
+    for (size_t i = 0; i < pipeline.accumulators.size(); ++i) {
+        const AccumulatorSpec& spec = pipeline.accumulators[i];
+        group->values[i].add(spec.op, spec.op == AccumulatorOp::Count ? nullptr : spec.argument.resolve(doc, scratch));
+    }
+}
+
+void GroupTable::merge(const GroupTable& other) {
+    for (auto it = other.groups.iterate(); it.valid(); it.next()) {
+        GroupState* group = groups.find(it.key());
+        if (group == nullptr) {
+            GroupState copy;
+            copy.id = it.value().id;
+            copy.values = it.value().values;
+            groups.put(it.key(), std::move(copy));
+            continue;
+        }
+        for (size_t i = 0; i < pipeline.accumulators.size(); ++i) {
+            group->values[i].merge(pipeline.accumulators[i].op, it.value().values[i]);
+        }
+    }
+}
+
+size_t GroupTable::size() const {
+    return groups.size();
+}
+
+Vector<DocumentWrapper> GroupTable::finish() const {
+    Vector<const GroupState*> ordered;
+    ordered.reserve(groups.size());
+    for (auto it = groups.iterate(); it.valid(); it.next()) {
+        ordered.push_back(&it.value());
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const GroupState* a, const GroupState* b) { return a->id < b->id; });
+    Vector<DocumentWrapper> results;
+    results.reserve(ordered.size());
+    for (size_t i = 0; i < ordered.size(); ++i) {
+        Document doc = Document::object();
+        doc["_id"] = ordered[i]->id;
+        for (size_t j = 0; j < pipeline.accumulators.size(); ++j) {
+            doc[pipeline.accumulators[j].name] = ordered[i]->values[j].result(pipeline.accumulators[j].op);
+        }
+        results.emplace_back(std::move(doc));
+    }
+    return results;
+}
+
+bool AggregationPipeline::parse(const std::string& pipeline_json) {
+    try {
+        return parse(Document::parse(pipeline_json));
+    } catch (const std::exception& e) {
+        std::cerr << "Pipeline parsing error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool AggregationPipeline::parse(const Document& pipeline) {
+    if (!pipeline.is_array()) {
+        std::cerr << "Pipeline must be an array of stages" << std::endl;
+        return false;
+    }
+    QueryParser parser;
+    Document matches = Document::array();
+    bool grouped = false;
+    for (auto it = pipeline.begin(); it != pipeline.end(); ++it) {
+        if (!it->is_object() || it->size() != 1) {
+            std::cerr << "Pipeline stage must be an object with one operator: " << it->dump() << std::endl;
+            return false;
+        }
+        const std::string& op = it->begin().key();
+        const Document& spec = it->begin().value();
+        if (op == "$match") {
+            if (!spec.is_object()) {
+                std::cerr << "$match requires a query object" << std::endl;
+                return false;
+            }
+            if (!grouped) {
+                matches.push_back(spec);
+            } else {
+                Stage stage;
+                stage.match = parser.parse(spec);
+                after_group.push_back(stage);
+            }
+        } else if (op == "$count") {
+            if (!spec.is_string() || spec.get_ref<const std::string&>().empty()) {
+                std::cerr << "$count requires a field name" << std::endl;
+                return false;
+            }
+            if (!grouped) {
+                // подсчёт совпадений - группировка в одну группу
+                count_only = spec.get<std::string>();
+                AccumulatorSpec counter;
+                counter.name = count_only;
+                counter.op = AccumulatorOp::Count;
+                accumulators.push_back(counter);
+                grouped = true;
+            } else {
+                Stage stage;
+                stage.is_count = true;
+                stage.count_name = spec.get<std::string>();
+                after_group.push_back(stage);
+            }
+        } else if (op == "$group") {
+            if (grouped) {
+                std::cerr << "Only one $group or $count before grouping is supported" << std::endl;
+                return false;
+            }
+            if (!parseGroup(spec)) {
+                return false;
+            }
+            grouped = true;
+        } else {
+            std::cerr << "Unknown pipeline stage '" << op << "'" << std::endl;
+            return false;
+        }
+    }
+    if (!grouped) {
+        std::cerr << "Pipeline requires a $group or $count stage" << std::endl;
+        return false;
+    }
+    // несколько $match подряд - одно условие через $and
+    if (matches.size() == 1) {
+        match = parser.parse(matches[0]);
+    } else if (matches.size() > 1) {
+        match = parser.parse(Document{{"$and", matches}});
+    }
+    return true;
+}
+
+bool AggregationPipeline::parseGroup(const Document& spec) {
+    if (!spec.is_object() || !spec.contains("_id")) {
+        std::cerr << "$group requires an object with _id" << std::endl;
+        return false;
+    }
+    const Document& id = spec["_id"];
+    if (id.is_object()) {
+        compound_key = true;
+        for (auto it = id.begin(); it != id.end(); ++it) {
+            group_fields.emplace_back(it.key(), AggregateExpression::parse(it.value()));
+        }
+    } else {
+        group_key = AggregateExpression::parse(id);
+    }
+    for (auto it = spec.begin(); it != spec.end(); ++it) {
+        if (it.key() == "_id") {
+            continue;
+        }
+        AccumulatorSpec accumulator;
+        if (!parseAccumulator(it.key(), it.value(), accumulator)) {
+            return false;
+        }
+        accumulators.push_back(accumulator);
+    }
+    return true;
+}
+
+Vector<DocumentWrapper> AggregationPipeline::finish(const GroupTable& groups) const {
+    Vector<DocumentWrapper> results;
+    if (!count_only.empty()) {
+        Document doc = Document::object();
+        // совпадений нет - групп нет, но число всё равно выдаётся
+        doc[count_only] = groups.size() == 0 ? Document(0) : groups.finish()[0].getRawDocument()[count_only];
+        results.emplace_back(std::move(doc));
+    } else {
+        results = groups.finish();
+    }
+    for (size_t i = 0; i < after_group.size(); ++i) {
+        const Stage& stage = after_group[i];
+        if (stage.is_count) {
+            Document doc = Document::object();
+            doc[stage.count_name] = results.size();
+            results.clear();
+            results.emplace_back(std::move(doc));
+            continue;
+        }
+        Predicate predicate = Predicate::compile(stage.match);
+        Vector<DocumentWrapper> kept;
+        for (size_t j = 0; j < results.size(); ++j) {
+            if (predicate.matches(results[j])) {
+                kept.push_back(std::move(results[j]));
+            }
+        }
+        results = std::move(kept);
+    }
+    return results;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include "document.h"
+#include "hash_map.h"
+#include "parser.h"
+#include "vector.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+
+// значение в стадии конвейера: "$поле" - поле документа, иначе константа
+struct AggregateExpression {
+    bool is_field = false;
+    std::string field;
+    Document constant;
+
+    static AggregateExpression parse(const Document& spec);
+    // указатель на поле документа или на константу, nullptr - поля нет
+    // поле компактного документа разворачивается в scratch, указатель действителен до его следующего использования
+    const Document* resolve(const DocumentWrapper& doc, Document& scratch) const;
+};
+
+enum class AccumulatorOp { Sum, Avg, Min, Max, Count };
+
+struct AccumulatorSpec {
+    std::string name;
+    AccumulatorOp op = AccumulatorOp::Count;
+    AggregateExpression argument;
+};
+
+// промежуточное значение аккумулятора: частичные значения потоков сливаются merge
+struct AccumulatorState {
+    int64_t integer_sum = 0;
+    double float_sum = 0;
+    bool integer_only = true;   // сумма точная в целых, пока не встретилось дробное или переполнение
+    uint64_t count = 0;         // $count - документов, $avg - чисел
+    Document extreme;           // $min/$max
+    bool has_extreme = false;
+
+    void add(AccumulatorOp op, const Document* value);
+    void merge(AccumulatorOp op, const AccumulatorState& other);
+    Document result(AccumulatorOp op) const;
+
+private:
+    void addInteger(int64_t value);
+};
+
+struct GroupState {
+    Document id;
+    Vector<AccumulatorState> values;
+};
+
+class AggregationPipeline;
+
+// группы одного потока: документы не копируются, хранятся только ключ и аккумуляторы
+class GroupTable {
+private:
+    const AggregationPipeline& pipeline;
+    HashMap<std::string, GroupState> groups;
+    std::string key;            // буфер ключа, чтобы не выделять строку на каждый документ
+
+    void buildKey(const DocumentWrapper& doc);
+    Document groupId(const DocumentWrapper& doc) const;
+
+public:
+    explicit GroupTable(const AggregationPipeline& owner);
+    GroupTable(const GroupTable&) = delete;
+    GroupTable& operator=(const GroupTable&) = delete;
+
+    void add(const DocumentWrapper& doc);
+    void merge(const GroupTable& other);
+    size_t size() const;
+    // документы групп по возрастанию _id
+    Vector<DocumentWrapper> finish() const;
+};
+
+// конвейер [{"$match": ...}, {"$group": ...}, {"$match": ...}, {"$count": "n"}]
+// $match до группировки сливаются в один запрос для планировщика, потом одна $group или $count,
+// стадии после неё применяются к документам групп
+class AggregationPipeline {
+public:
+    struct Stage {
+        bool is_count = false;
+        std::string count_name;
+        ParsedQuery match;
+    };
+
+    ParsedQuery match;
+    Vector<std::pair<std::string, AggregateExpression>> group_fields;  // _id: {"a": "$a", ...}
+    AggregateExpression group_key;                                     // _id: "$a" или константа
+    bool compound_key = false;
+    Vector<AccumulatorSpec> accumulators;
+    std::string count_only;     // $count без $group: один документ {count_only: число}
+    Vector<Stage> after_group;
+
+    // false - ошибка в конвейере, причина в std::cerr
+    bool parse(const std::string& pipeline_json);
+    bool parse(const Document& pipeline);
+    // итог по слитым группам и стадии после группировки
+    Vector<DocumentWrapper> finish(const GroupTable& groups) const;
+
+private:
+    bool parseGroup(const Document& spec);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "allocator.h"
+#include <new>
+
+HeapAllocator::HeapAllocator() : allocations(0), deallocations(0), bytes_in_use(0) {}
+
+void* HeapAllocator::allocate(size_t bytes) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_in_use.fetch_add(bytes, std::memory_order_relaxed);
+    return ::operator new(bytes);
+}
+
+void HeapAllocator::deallocate(void* ptr, size_t bytes) {
+    if (ptr == nullptr) {
+        return;
+    }
+    deallocations.fetch_add(1, std::memory_order_relaxed);
+    bytes_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+    ::operator delete(ptr);
+}
+
+AllocatorStats HeapAllocator::stats() const {
+    AllocatorStats result;
+    result.allocations = allocations.load(std::memory_order_relaxed);
+    result.deallocations = deallocations.load(std::memory_order_relaxed);
+    result.bytes_in_use = bytes_in_use.load(std::memory_order_relaxed);
+    result.bytes_reserved = result.bytes_in_use;
+    return result;
+}
+
+HeapAllocator& HeapAllocator::shared() {
+    static HeapAllocator allocator;
+    return allocator;
+}
+
+SlabAllocator::SlabAllocator() : blocks(nullptr), cursor(nullptr), block_end(nullptr) {
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        free_lists[i] = nullptr;
+    }
+}
+
+SlabAllocator::~SlabAllocator() {
+    release();
+}
+
+size_t SlabAllocator::classOf(size_t bytes) {
+    size_t shift = MIN_CLASS_SHIFT;
+    while ((static_cast<size_t>(1) << shift) < bytes) {
+        shift++;
+    }
+    return shift - MIN_CLASS_SHIFT;
+}
+
+void SlabAllocator::newBlock() {
+    // в начале блока - ссылка на предыдущий, чтобы release() прошёл по всем
+    char* memory = static_cast<char*>(::operator new(BLOCK_SIZE));
+    Block* block = reinterpret_cast<Block*>(memory);
+    block->next = blocks;
+    blocks = block;
+    cursor = memory + (static_cast<size_t>(1) << MIN_CLASS_SHIFT);
+    block_end = memory + BLOCK_SIZE;
+    counters.blocks++;
+    counters.bytes_reserved += BLOCK_SIZE;
+}
+
+void* SlabAllocator::allocate(size_t bytes) {
+    counters.allocations++;
+    if (bytes > (static_cast<size_t>(1) << MAX_CLASS_SHIFT)) {
+        counters.bytes_in_use += bytes;
+        counters.bytes_reserved += bytes;
+        return ::operator new(bytes);
+    }
+    size_t size_class = classOf(bytes);
+    size_t chunk_size = static_cast<size_t>(1) << (size_class + MIN_CLASS_SHIFT);
+    counters.bytes_in_use += chunk_size;
+    FreeChunk* chunk = free_lists[size_class];
+    if (chunk != nullptr) {
+        free_lists[size_class] = chunk->next;
+        return chunk;
+    }
+    if (static_cast<size_t>(block_end - cursor) < chunk_size) {
+        // хвост блока уходит в списки меньших размеров, чтобы не пропадал
+        while (cursor != nullptr && static_cast<size_t>(block_end - cursor) >= (static_cast<size_t>(1) << MIN_CLASS_SHIFT)) {
+            size_t tail_class = classOf(static_cast<size_t>(block_end - cursor) + 1) - 1;
+            FreeChunk* tail = reinterpret_cast<FreeChunk*>(cursor);
+            tail->next = free_lists[tail_class];
+            free_lists[tail_class] = tail;
+            cursor += static_cast<size_t>(1) << (tail_class + MIN_CLASS_SHIFT);
+        }
+        newBlock();
+    }
+    void* result = cursor;
+    cursor += chunk_size;
+    return result;
+}
+
+void SlabAllocator::deallocate(void* ptr, size_t bytes) {
+    if (ptr == nullptr) {
+        return;
+    }
+    counters.deallocations++;
+    if (bytes > (static_cast<size_t>(1) << MAX_CLASS_SHIFT)) {
+        counters.bytes_in_use -= bytes;
+        counters.bytes_reserved -= bytes;
+        ::operator delete(ptr);
+        return;
+    }
+    size_t size_class = classOf(bytes);
+    counters.bytes_in_use -= static_cast<size_t>(1) << (size_class + MIN_CLASS_SHIFT);
+    FreeChunk* chunk = static_cast<FreeChunk*>(ptr);
+    chunk->next = free_lists[size_class];
+    free_lists[size_class] = chunk;
+}
+
+void SlabAllocator::release() {
+    while (blocks != nullptr) {
+        Block* next = blocks->next;
+        ::operator delete(blocks);
+        blocks = next;
+    }
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+        free_lists[i] = nullptr;
+    }
+    cursor = nullptr;
+    block_end = nullptr;
+    counters = AllocatorStats();
+}
+
+AllocatorStats SlabAllocator::stats() const {
+    return counters;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <atomic>
+#include <cstddef>
+
+// счётчики распределителя памяти
+struct AllocatorStats {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+    size_t bytes_in_use = 0;      // выдано и не возвращено
+    size_t bytes_reserved = 0;    // взято у системы
+    size_t blocks = 0;            // крупных блоков у слабов
+};
+
+// обычная куча: каждый запрос - отдельный operator new, общий на процесс
+class HeapAllocator {
+private:
+    std::atomic<size_t> allocations;
+    std::atomic<size_t> deallocations;
+    std::atomic<size_t> bytes_in_use;
+
+public:
+    HeapAllocator();
+    HeapAllocator(const HeapAllocator&) = delete;
+    HeapAllocator& operator=(const HeapAllocator&) = delete;
+
+    void* allocate(size_t bytes);
+    void deallocate(void* ptr, size_t bytes);
+    AllocatorStats stats() const;
+
+    static HeapAllocator& shared();
+};
+
+// слабы: память берётся у системы блоками по 1 МБ и режется на куски размеров-степеней двойки,
+// освобождённые куски уходят в список своего размера; release() отдаёт все блоки сразу
+// не потокобезопасен: у каждого владельца (индекса) свой
+class SlabAllocator {
+private:
+    static const size_t BLOCK_SIZE = 1 << 20;
+    static const size_t MIN_CLASS_SHIFT = 5;    // 32 байта
+    static const size_t MAX_CLASS_SHIFT = 16;   // 64 КБ, крупнее - напрямую из кучи
+    static const size_t CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+
+    struct FreeChunk {
+        FreeChunk* next;
+    };
+    struct Block {
+        Block* next;
+    };
+
+    FreeChunk* free_lists[CLASS_COUNT];
+    Block* blocks;
+    char* cursor;        // свободное место в текущем блоке
+    char* block_end;
+    AllocatorStats counters;
+
+    static size_t classOf(size_t bytes);
+    void newBlock();
+
+public:
+    SlabAllocator();
+    ~SlabAllocator();
+    SlabAllocator(const SlabAllocator&) = delete;
+    SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+    void* allocate(size_t bytes);
+    void deallocate(void* ptr, size_t bytes);
+    // все блоки возвращаются системе; выданные куски становятся недействительны
+    void release();
+    AllocatorStats stats() const;
+};
+
+#endif
\ No newline at end of file
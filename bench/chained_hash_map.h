@@ -0,0 +1,220 @@
+// прежняя HashMap с цепочками (до перехода на открытую адресацию) - база для сравнения в бенчмарке
+#ifndef CHAINED_HASH_MAP_H
+#define CHAINED_HASH_MAP_H
+
+#include "../vector.h"
+#include <string>
+
+template<typename K, typename V>  
+struct ChainedHashNode {
+    std::string key;  
+    V value;
+    ChainedHashNode* next;
+    
+    ChainedHashNode(const std::string& k, const V& v) : key(k), value(v), next(nullptr) {}
+};
+
+struct ChainedHashFunction {
+    size_t operator()(const std::string& key, size_t capacity) const {
+        size_t hash = 5381;
+        for (size_t i = 0; i < key.size(); ++i) {
+            hash = ((hash << 5) + hash) + key[i];
+        }
+        return hash % capacity;
+    }
+};
+
+template<typename K, typename V, typename Hash = ChainedHashFunction>  
+class ChainedHashMap {
+private:
+    Vector<ChainedHashNode<K, V>*> table; //массив указателей на цепочки
+    size_t size_;
+    size_t capacity_;
+    Hash hash_func;
+    const double LOAD_FACTOR_THRESHOLD = 0.75;
+
+    void rehash() {
+        size_t new_capacity = capacity_ * 2;
+        Vector<ChainedHashNode<K, V>*> new_table(new_capacity, nullptr);
+        
+        for (size_t i = 0; i < capacity_; ++i) {
+            ChainedHashNode<K, V>* current = table[i];
+            while (current != nullptr) {
+                ChainedHashNode<K, V>* next = current->next;
+                size_t new_index = hash_func(current->key, new_capacity);
+                
+                current->next = new_table[new_index];
+                new_table[new_index] = current;
+                
+                current = next;
+            }
+        }
+        
+        table = new_table;
+        capacity_ = new_capacity;
+    }
+
+public:
+    ChainedHashMap(size_t capacity = 16) : size_(0), capacity_(capacity) {
+        table.resize(capacity_, nullptr);
+    }
+
+    ~ChainedHashMap() {
+        clear();
+    }
+
+    void put(const K& key, const V& value) {  
+        if (static_cast<double>(size_) / capacity_ > LOAD_FACTOR_THRESHOLD) {
+            rehash();
+        }
+        
+        size_t index = hash_func(key, capacity_);
+        ChainedHashNode<K, V>* current = table[index]; //указатель на начало цепочки
+        
+        while (current != nullptr) {
+            if (current->key == key) {
+                current->value = value;
+                return;
+            }
+            current = current->next;
+        }
+        ChainedHashNode<K, V>* new_node = new ChainedHashNode<K, V>(key, value);
+        new_node->next = table[index];
+        table[index] = new_node;
+        size_++;
+    }
+
+    bool get(const K& key, V& value) const {  
+        size_t index = hash_func(key, capacity_);
+        ChainedHashNode<K, V>* current = table[index];
+        
+        while (current != nullptr) {
+            if (current->key == key) {
+                value = current->value;
+                return true;
+            }
+            current = current->next;
+        }
+        return false;
+    }
+
+    bool remove(const K& key) {  
+        size_t index = hash_func(key, capacity_);
+        ChainedHashNode<K, V>* current = table[index];
+        ChainedHashNode<K, V>* prev = nullptr;
+        
+        while (current != nullptr) {
+            if (current->key == key) {
+                if (prev == nullptr) {
+                    table[index] = current->next;
+                } else {
+                    prev->next = current->next;
+                }
+                delete current;
+                size_--;
+                return true;
+            }
+            prev = current;
+            current = current->next;
+        }
+        return false;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            ChainedHashNode<K, V>* current = table[i];
+            while (current != nullptr) {
+                ChainedHashNode<K, V>* next = current->next;
+                delete current;
+                current = next;
+            }
+            table[i] = nullptr;
+        }
+        size_ = 0;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    double load_factor() const { return static_cast<double>(size_) / capacity_; }
+
+    // указатель на значение в таблице без копирования, nullptr - ключа нет
+    // действителен до следующего изменения таблицы
+    const V* find(const K& key) const {
+        size_t index = hash_func(key, capacity_);
+        ChainedHashNode<K, V>* current = table[index];
+        while (current != nullptr) {
+            if (current->key == key) {
+                return &current->value;
+            }
+            current = current->next;
+        }
+        return nullptr;
+    }
+
+    // последовательный обход записей на месте, без копирования значений
+    class ConstIterator {
+    private:
+        const ChainedHashMap* map;
+        size_t bucket;
+        const ChainedHashNode<K, V>* node;
+
+        void skipEmpty() {
+            while (node == nullptr && bucket < map->capacity_) {
+                node = map->table[bucket++];
+            }
+        }
+
+    public:
+        ConstIterator(const ChainedHashMap* m) : map(m), bucket(0), node(nullptr) { skipEmpty(); }
+        bool valid() const { return node != nullptr; }
+        const K& key() const { return node->key; }
+        const V& value() const { return node->value; }
+        void next() {
+            node = node->next;
+            skipEmpty();
+        }
+    };
+
+    ConstIterator iterate() const {
+        return ConstIterator(this);
+    }
+
+    // обход цепочек корзин [begin, end) - для разбиения таблицы между потоками
+    template<typename Visitor>
+    void forEachInBuckets(size_t begin, size_t end, Visitor visit) const {
+        for (size_t i = begin; i < end && i < capacity_; ++i) {
+            ChainedHashNode<K, V>* current = table[i];
+            while (current != nullptr) {
+                visit(current->key, current->value);
+                current = current->next;
+            }
+        }
+    }
+
+    Vector<std::string> keys() const {
+        Vector<std::string> result;
+        for (size_t i = 0; i < capacity_; ++i) {
+            ChainedHashNode<K, V>* current = table[i];
+            while (current != nullptr) {
+                result.push_back(current->key);
+                current = current->next;
+            }
+        }
+        return result;
+    }
+
+    Vector<V> values() const {
+        Vector<V> result;
+        for (size_t i = 0; i < capacity_; ++i) {
+            ChainedHashNode<K, V>* current = table[i];
+            while (current != nullptr) {
+                result.push_back(current->value);
+                current = current->next;
+            }
+        }
+        return result;
+    }
+    
+};
+
+#endif
\ No newline at end of file
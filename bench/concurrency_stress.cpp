@@ -0,0 +1,180 @@
+// одновременные читатели, писатели и контрольные точки одной коллекции: чтения под readLock
+// должны видеть согласованную коллекцию, а после перезагрузки - ровно то, что осталось в памяти
+// запуск: ./concurrency_stress [писателей] [пачек на писателя] [читателей] (по умолчанию 4 500 2)
+#include "../collection.h"
+#include "../parser.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+const size_t BATCH = 4;
+
+std::string writerQuery(size_t writer) {
+    return "{\"writer\": " + std::to_string(writer) + "}";
+}
+
+// индекс по writer, полный обход и курсор должны дать одно и то же в пределах одной отметки
+bool consistentRead(const Collection& collection, size_t writers, std::string& problem) {
+    Collection::ReadGuard guard = collection.readLock();
+    size_t total = collection.size();
+    size_t indexed = 0;
+    for (size_t w = 0; w < writers; ++w) {
+        indexed += collection.count(writerQuery(w));
+    }
+    size_t scanned = collection.count(std::string("{\"seq\": {\"$gte\": 0}}"));
+    QueryParser parser;
+    Cursor cursor = collection.findCursor(parser.parse(writerQuery(0)));
+    size_t by_cursor = 0;
+    while (cursor.next()) {
+        by_cursor++;
+    }
+    size_t first = collection.count(writerQuery(0));
+    if (indexed != total || scanned != total || by_cursor != first) {
+        problem = "size " + std::to_string(total) + ", by index " + std::to_string(indexed) + ", by range " +
+                  std::to_string(scanned) + ", cursor " + std::to_string(by_cursor) + " of " + std::to_string(first);
+        return false;
+    }
+    return true;
+}
+
+// пачки вставляются по BATCH, каждая третья пачка удаляет половину предыдущей
+size_t runWriter(Collection& collection, size_t writer, size_t batches) {
+    size_t alive = 0;
+    Vector<std::string> previous;
+    for (size_t b = 0; b < batches; ++b) {
+        Vector<DocumentWrapper> batch;
+        Vector<std::string> ids;
+        for (size_t i = 0; i < BATCH; ++i) {
+            std::string id = "w" + std::to_string(writer) + "-" + std::to_string(b * BATCH + i);
+            Document doc = {{"_id", id}, {"writer", writer}, {"seq", b * BATCH + i}};
+            batch.push_back(DocumentWrapper(doc));
+            ids.push_back(id);
+        }
+        {
+            Collection::WriteGuard lock = collection.writeLock();
+            alive += collection.insertMany(batch);
+            if (b % 3 == 2) {
+                Vector<std::string> doomed;
+                for (size_t i = 0; i < previous.size(); i += 2) {
+                    doomed.push_back(previous[i]);
+                }
+                alive -= collection.removeMany(doomed);
+            }
+        }
+        collection.maybeCheckpoint();
+        previous = ids;
+    }
+    return alive;
+}
+
+size_t indexedTotal(const Collection& collection, size_t writers) {
+    size_t total = 0;
+    for (size_t w = 0; w < writers; ++w) {
+        total += collection.count(writerQuery(w));
+    }
+    return total;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t writers = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4;
+    size_t batches = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+    size_t readers = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 2;
+    if (writers == 0 || batches == 0) {
+        std::cerr << "Need at least one writer and one batch" << std::endl;
+        return 1;
+    }
+    std::filesystem::path base_path = std::filesystem::temp_directory_path() /
+                                      ("concurrency_stress_" + std::to_string(getpid()));
+    bool ok = true;
+    try {
+        std::filesystem::create_directories(base_path);
+        size_t expected = 0;
+        size_t reads = 0;
+        size_t checkpoints = 0;
+        {
+            Collection collection("stress", base_path.string());
+            collection.createIndex("writer");
+            collection.createIndex("seq", IndexType::Ordered);
+            // маленький журнал: контрольные точки идут прямо во время записи
+            CheckpointPolicy policy;
+            policy.max_log_bytes = 32 * 1024;
+            collection.setCheckpointPolicy(policy);
+
+            std::atomic<bool> done{false};
+            std::atomic<bool> failed{false};
+            std::atomic<size_t> read_count{0};
+            std::atomic<size_t> alive{0};
+            Vector<std::thread> threads;
+            for (size_t r = 0; r < readers; ++r) {
+                threads.push_back(std::thread([&] {
+                    std::string problem;
+                    while (!done && !failed) {
+                        if (!consistentRead(collection, writers, problem)) {
+                            std::cerr << "Inconsistent read: " << problem << std::endl;
+                            failed = true;
+                        }
+                        read_count++;
+                    }
+                }));
+            }
+            std::thread checkpointer([&] {
+                while (!done) {
+                    if (collection.saveToFile()) {
+                        checkpoints++;
+                    }
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                }
+            });
+            Vector<std::thread> writer_threads;
+            for (size_t w = 0; w < writers; ++w) {
+                writer_threads.push_back(std::thread([&, w] { alive += runWriter(collection, w, batches); }));
+            }
+            for (size_t w = 0; w < writer_threads.size(); ++w) {
+                writer_threads[w].join();
+            }
+            done = true;
+            checkpointer.join();
+            for (size_t r = 0; r < threads.size(); ++r) {
+                threads[r].join();
+            }
+            expected = alive;
+            reads = read_count;
+            ok = !failed;
+
+            Collection::ReadGuard guard = collection.readLock();
+            if (collection.size() != expected || indexedTotal(collection, writers) != expected) {
+                std::cerr << "After writers: size " << collection.size() << ", by index " << indexedTotal(collection, writers)
+                          << ", expected " << expected << std::endl;
+                ok = false;
+            }
+        }
+        // снимок и журнал после последней контрольной точки дают ту же коллекцию
+        Collection reloaded("stress", base_path.string());
+        if (reloaded.size() != expected || indexedTotal(reloaded, writers) != expected) {
+            std::cerr << "After reload: size " << reloaded.size() << ", by index " << indexedTotal(reloaded, writers)
+                      << ", expected " << expected << std::endl;
+            ok = false;
+        }
+        printf("%zu writers x %zu batches, %zu readers: %zu documents, %zu consistent reads, %zu explicit checkpoints\n",
+               writers, batches, readers, expected, reads, checkpoints);
+    } catch (const std::exception& e) {
+        std::cerr << "Concurrency stress failed: " << e.what() << std::endl;
+        ok = false;
+    }
+    std::filesystem::remove_all(base_path);
+    if (!ok) {
+        std::cerr << "FAILED" << std::endl;
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+// сравнение HashMap с прежней таблицей на цепочках: вставка, поиск, промахи, удаление
+// запуск: ./hash_map_bench [число ключей] (по умолчанию 1000000)
+#include "../hash_map.h"
+#include "chained_hash_map.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+
+// ключи в формате сгенерированных _id, чтобы хэш работал на тех же строках, что и в коллекции
+Vector<std::string> makeKeys(size_t count, unsigned prefix) {
+    Vector<std::string> keys;
+    keys.reserve(count);
+    char buffer[64];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(buffer, sizeof(buffer), "doc_1700000000%03u_%08zx", prefix, i * 2654435761u);
+        keys.push_back(buffer);
+    }
+    return keys;
+}
+
+template<typename Body>
+double measureMs(Body body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct Timings {
+    double insert_ms = 0;
+    double hit_ms = 0;
+    double miss_ms = 0;
+    double remove_ms = 0;
+    size_t checksum = 0;
+};
+
+template<typename Map>
+Timings run(const Vector<std::string>& keys, const Vector<std::string>& missing) {
+    Timings t;
+    Map map;
+    t.insert_ms = measureMs([&] {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            map.put(keys[i], i);
+        }
+    });
+    t.hit_ms = measureMs([&] {
+        for (size_t i = 0; i < keys.size(); ++i) {
+            const size_t* value = map.find(keys[i]);
+            t.checksum += value != nullptr ? *value : 0;
+        }
+    });
+    t.miss_ms = measureMs([&] {
+        for (size_t i = 0; i < missing.size(); ++i) {
+            t.checksum += map.find(missing[i]) != nullptr ? 1 : 0;
+        }
+    });
+    // удаляется каждый второй ключ - остаются надгробия/разреженные цепочки
+    t.remove_ms = measureMs([&] {
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            t.checksum += map.remove(keys[i]) ? 1 : 0;
+        }
+    });
+    return t;
+}
+
+void printRow(const char* operation, size_t count, double baseline_ms, double current_ms) {
+    printf("%-10s %14.1f %14.1f %10.2fx\n", operation,
+           baseline_ms * 1e6 / count, current_ms * 1e6 / count,
+           current_ms > 0 ? baseline_ms / current_ms : 0.0);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = 1000000;
+    if (argc > 1) {
+        count = std::strtoul(argv[1], nullptr, 10);
+    }
+    if (count == 0) {
+        std::cerr << "Key count must be positive" << std::endl;
+        return 1;
+    }
+    Vector<std::string> keys = makeKeys(count, 1);
+    Vector<std::string> missing = makeKeys(count, 2);
+
+    Timings baseline = run<ChainedHashMap<std::string, size_t>>(keys, missing);
+    Timings current = run<HashMap<std::string, size_t>>(keys, missing);
+    if (baseline.checksum != current.checksum) {
+        std::cerr << "Checksum mismatch: " << baseline.checksum << " vs " << current.checksum << std::endl;
+        return 1;
+    }
+
+    printf("%zu keys, ns per operation\n", count);
+    printf("%-10s %14s %14s %11s\n", "operation", "chained", "open", "speedup");
+    printRow("insert", count, baseline.insert_ms, current.insert_ms);
+    printRow("hit", count, baseline.hit_ms, current.hit_ms);
+    printRow("miss", count, baseline.miss_ms, current.miss_ms);
+    printRow("remove", (count + 1) / 2, baseline.remove_ms, current.remove_ms);
+    return 0;
+}
\ No newline at end of file
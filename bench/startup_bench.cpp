@@ -0,0 +1,112 @@
+// время запуска: ленивое открытие одной коллекции против загрузки всех (как было до user-017)
+// запуск: ./startup_bench [коллекций] [документов в коллекции] [повторов] (по умолчанию 200 2000 5)
+#include "../database.h"
+#include "../parser.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+
+// сообщения Database/Collection о загрузке не должны попадать в замер вывода
+class QuietOutput {
+private:
+    std::streambuf* saved;
+
+public:
+    QuietOutput() : saved(std::cout.rdbuf(nullptr)) {}
+    ~QuietOutput() {
+        std::cout.rdbuf(saved);
+        std::cout.clear();
+    }
+};
+
+// каждая коллекция - снимок и непустой журнал, как после обычной работы
+void populate(const std::string& base_path, size_t collection_count, size_t document_count) {
+    QuietOutput quiet;
+    Database db("bench", base_path);
+    for (size_t c = 0; c < collection_count; ++c) {
+        std::string collection_name = "c" + std::to_string(c);
+        db.createCollection(collection_name);
+        Collection& collection = db.getCollection(collection_name);
+        Vector<DocumentWrapper> batch;
+        size_t logged = document_count / 10;
+        for (size_t i = 0; i < document_count; ++i) {
+            Document doc = {{"name", "user" + std::to_string(i)}, {"age", i % 50}, {"city", "city" + std::to_string(i % 17)}};
+            batch.push_back(DocumentWrapper(doc));
+            if (i + 1 == document_count - logged) {
+                collection.insertMany(batch);
+                collection.saveToFile();
+                batch.clear();
+            }
+        }
+        collection.insertMany(batch);
+    }
+}
+
+double measureMs(const std::string& base_path, bool open_all, size_t& counted) {
+    QuietOutput quiet;
+    auto start = std::chrono::steady_clock::now();
+    {
+        Database db("bench", base_path);
+        if (open_all) {
+            Vector<std::string> names = db.getCollectionNames();
+            for (size_t i = 0; i < names.size(); ++i) {
+                db.getCollection(names[i]);
+            }
+        }
+        QueryParser parser;
+        counted = db.getCollection("c7").count(parser.parse(std::string("{\"age\": 5}")));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+double median(Vector<double>& values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    size_t collection_count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200;
+    size_t document_count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000;
+    size_t runs = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 5;
+    if (collection_count < 8 || document_count == 0 || runs == 0) {
+        std::cerr << "Need at least 8 collections, one document and one run" << std::endl;
+        return 1;
+    }
+    std::filesystem::path base_path = std::filesystem::temp_directory_path() /
+                                      ("startup_bench_" + std::to_string(getpid()));
+    try {
+        populate(base_path.string(), collection_count, document_count);
+        Vector<double> lazy_ms;
+        Vector<double> eager_ms;
+        size_t lazy_count = 0;
+        size_t eager_count = 0;
+        for (size_t run = 0; run < runs; ++run) {
+            lazy_ms.push_back(measureMs(base_path.string(), false, lazy_count));
+            eager_ms.push_back(measureMs(base_path.string(), true, eager_count));
+        }
+        std::filesystem::remove_all(base_path);
+        if (lazy_count != eager_count) {
+            std::cerr << "Count mismatch: " << lazy_count << " vs " << eager_count << std::endl;
+            return 1;
+        }
+        printf("%zu collections x %zu documents, median of %zu runs of count c7 {\"age\": 5} (%zu matches)\n",
+               collection_count, document_count, runs, lazy_count);
+        printf("%-28s %10.1f ms\n", "open every collection", median(eager_ms));
+        printf("%-28s %10.1f ms\n", "open on first use", median(lazy_ms));
+    } catch (const std::exception& e) {
+        std::cerr << "Startup benchmark failed: " << e.what() << std::endl;
+        std::filesystem::remove_all(base_path);
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "client.h"
+#include "protocol.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Client::Client() : fd(-1) {}
+
+Client::~Client() {
+    close();
+}
+
+bool Client::connect(const std::string& socket_path) {
+    close();
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid socket path: " << socket_path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        std::cerr << "Cannot connect to " << socket_path << ": " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void Client::close() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool Client::isConnected() const {
+    return fd >= 0;
+}
+
+bool Client::request(const Document& message, Document& response) {
+    std::string payload;
+    std::string body = message.dump(-1, ' ', false, Document::error_handler_t::replace);
+    if (fd < 0 || !FrameCodec::send(fd, body) || !FrameCodec::receive(fd, payload)) {
+        close();
+        return false;
+    }
+    try {
+        response = Document::parse(payload);
+    } catch (const std::exception& e) {
+        std::cerr << "Invalid server response: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Client::insert(const std::string& collection, const Document& document, Document& response,
+                    const Document& options) {
+    Document message = {{"op", "insert"}, {"collection", collection}};
+    message[document.is_array() ? "documents" : "document"] = document;
+    for (auto it = options.begin(); it != options.end(); ++it) {
+        message[it.key()] = it.value();
+    }
+    return request(message, response);
+}
+
+bool Client::find(const std::string& collection, const Document& query, Document& response,
+                  const Document& options) {
+    Document message = {{"op", "find"}, {"collection", collection}, {"query", query}};
+    for (auto it = options.begin(); it != options.end(); ++it) {
+        message[it.key()] = it.value();
+    }
+    return request(message, response);
+}
+
+bool Client::aggregate(const std::string& collection, const Document& pipeline, Document& response) {
+    return request({{"op", "aggregate"}, {"collection", collection}, {"pipeline", pipeline}}, response);
+}
+
+bool Client::count(const std::string& collection, const Document& query, Document& response) {
+    return request({{"op", "count"}, {"collection", collection}, {"query", query}}, response);
+}
+
+bool Client::remove(const std::string& collection, const Document& query, Document& response,
+                    const Document& options) {
+    Document message = {{"op", "delete"}, {"collection", collection}, {"query", query}};
+    for (auto it = options.begin(); it != options.end(); ++it) {
+        message[it.key()] = it.value();
+    }
+    return request(message, response);
+}
+
+bool Client::stats(Document& response) {
+    return request({{"op", "stats"}}, response);
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "document.h"
+#include <string>
+
+// клиент сервера: запросы по одному через unix-сокет, ответ - JSON с полем ok
+class Client {
+private:
+    int fd;
+
+public:
+    Client();
+    ~Client();
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+
+    bool connect(const std::string& socket_path);
+    void close();
+    bool isConnected() const;
+
+    // false - соединение потеряно; ошибки самого запроса приходят в response["error"]
+    bool request(const Document& message, Document& response);
+
+    // options - поле durability ("none", "batched", "strict"), по умолчанию режим сервера
+    bool insert(const std::string& collection, const Document& document, Document& response,
+                const Document& options = Document::object());
+    // options - поля skip, limit, fields и sort как в запросе find сервера
+    bool find(const std::string& collection, const Document& query, Document& response,
+              const Document& options = Document::object());
+    bool count(const std::string& collection, const Document& query, Document& response);
+    bool aggregate(const std::string& collection, const Document& pipeline, Document& response);
+    bool remove(const std::string& collection, const Document& query, Document& response,
+                const Document& options = Document::object());
+    bool stats(Document& response);
+};
+
+#endif
\ No newline at end of file
@@ -1,22 +1,260 @@
 #include "collection.h"
+#include "aggregate.h"
 #include "parser.h"
+#include "planner.h"
+#include "cursor.h"
+#include "sorter.h"
+#include "thread_pool.h"
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <cstdio>
 #include <cstdlib> 
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <sys/stat.h>
+
+namespace {
+
+// отметки чтения, взятые потоком: под отметкой поток читает ту копию, на которой она стоит
+struct HeldSide {
+    const Collection* collection;
+    int side;
+};
+thread_local Vector<HeldSide> held_sides;
+
+int heldSide(const Collection* collection) {
+    for (size_t i = held_sides.size(); i > 0; --i) {
+        if (held_sides[i - 1].collection == collection) {
+            return held_sides[i - 1].side;
+        }
+    }
+    return -1;
+}
+
+void forgetSide(const Collection* collection, int side) {
+    for (size_t i = held_sides.size(); i > 0; --i) {
+        if (held_sides[i - 1].collection == collection && held_sides[i - 1].side == side) {
+            for (size_t j = i; j < held_sides.size(); ++j) {
+                held_sides[j - 1] = held_sides[j];
+            }
+            held_sides.pop_back();
+            return;
+        }
+    }
+}
+
+// совпадение в результат: без проекции - одна копия документа, с проекцией - только нужные поля
+void appendResult(Vector<DocumentWrapper>& results, const DocumentWrapper& doc, const FindOptions& options) {
+    if (options.hasProjection()) {
+        results.push_back(options.project(doc));
+    } else {
+        results.push_back(doc);
+    }
+}
+
+}
 
 Collection::Collection(const std::string& collection_name, const std::string& db_path)
-    : name(collection_name), storage_path(db_path + "/" + collection_name + ".json") {
+    : name(collection_name), storage_path(db_path + "/" + collection_name + ".snap"),
+      json_path(db_path + "/" + collection_name + ".json"),
+      wal(db_path + "/" + collection_name + ".log"),
+      index_path(db_path + "/" + collection_name + ".idx") {
     loadFromFile(); //автоматом загружаем данные
 }
 
+Collection::~Collection() {
+    clearState(states[0]);
+    clearState(states[1]);
+}
+
+thread_local const Collection::ViewPin* Collection::ViewPin::innermost = nullptr;
+
+Collection::ViewPin::ViewPin(const Collection& source)
+    : collection(&source), pinned(&source.view()), outer(innermost) {
+    innermost = this;
+}
+
+Collection::ViewPin::~ViewPin() {
+    innermost = outer;
+}
+
+const Collection::CollectionState& Collection::ViewPin::state() const {
+    return *pinned;
+}
+
+const Collection::CollectionState& Collection::view() const {
+    for (const ViewPin* pin = ViewPin::innermost; pin != nullptr; pin = pin->outer) {
+        if (pin->collection == this) {
+            return *pin->pinned;
+        }
+    }
+    int held = heldSide(this);
+    if (held >= 0) {
+        return states[held];
+    }
+    // копия под отметкой не меняется, даже если активной уже стала другая: писатель повторяет
+    // на ней изменение только после ухода всех её читателей
+    return states[active.load()];
+}
+
+Collection::CollectionState& Collection::standby() {
+    return states[1 - active.load()];
+}
+
+Collection::ReadGuard::ReadGuard(const Collection* source, int reader_side) : collection(source), side(reader_side) {}
+
+Collection::ReadGuard::ReadGuard(ReadGuard&& other) noexcept : collection(other.collection), side(other.side) {
+    other.collection = nullptr;
+}
+
+Collection::ReadGuard& Collection::ReadGuard::operator=(ReadGuard&& other) noexcept {
+    if (this != &other) {
+        unlock();
+        collection = other.collection;
+        side = other.side;
+        other.collection = nullptr;
+    }
+    return *this;
+}
+
+Collection::ReadGuard::~ReadGuard() {
+    unlock();
+}
+
+void Collection::ReadGuard::unlock() {
+    if (collection != nullptr) {
+        forgetSide(collection, side);
+        collection->releaseReader(side);
+        collection = nullptr;
+    }
+}
+
+Collection::ReadGuard Collection::readLock() const {
+    int held = heldSide(this);
+    if (held >= 0) {
+        // вложенная отметка встаёт на ту же копию: писатель, ждущий ухода её читателей, и так ждёт этот поток
+        readers[held].fetch_add(1);
+        held_sides.push_back(HeldSide{this, held});
+        return ReadGuard(this, held);
+    }
+    if (!snapshot_materialized) {
+        // ленивое чтение снимка меняет обе копии: один раз под блокировкой писателя, пока читателей ещё нет
+        std::lock_guard<std::mutex> lock(write_mutex);
+        materializeAll();
+    }
+    while (true) {
+        int side = active.load();
+        readers[side].fetch_add(1);
+        // писатель мог сменить активную копию между чтением номера и отметкой: тогда отметка на прежней
+        // уже не учитывается им, и читатель переходит на новую
+        if (active.load() == side) {
+            held_sides.push_back(HeldSide{this, side});
+            return ReadGuard(this, side);
+        }
+        releaseReader(side);
+    }
+}
+
+void Collection::releaseReader(int side) const {
+    if (readers[side].fetch_sub(1) == 1 && draining.load()) {
+        std::lock_guard<std::mutex> lock(drain_mutex);
+        drained.notify_all();
+    }
+}
+
+Collection::WriteGuard Collection::writeLock() {
+    return WriteGuard(write_mutex);
+}
+
+void Collection::waitForReaders(int side) const {
+    if (readers[side].load() == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(drain_mutex);
+    draining = true;
+    drained.wait(lock, [this, side] { return readers[side].load() == 0; });
+    draining = false;
+}
+
+void Collection::publish(const std::function<void(CollectionState&, const CollectionState&)>& repeat) {
+    int written = 1 - active.load();
+    active.store(written);
+    // новые читатели уже идут на изменённую копию, прежнюю можно трогать после ухода её читателей
+    waitForReaders(1 - written);
+    repeat(states[1 - written], states[written]);
+}
+
+void Collection::mirrorDocuments(CollectionState& target, const CollectionState& source, const Vector<std::string>& ids) {
+    target.field_names.appendFrom(source.field_names);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const DocumentWrapper* old_doc = target.data.find(ids[i]);
+        if (old_doc != nullptr && target.indexes.size() > 0) {
+            unindexDocument(target, ids[i], *old_doc);
+        }
+        const DocumentWrapper* doc = source.data.find(ids[i]);
+        if (doc == nullptr) {
+            target.data.remove(ids[i]);
+            continue;
+        }
+        // номера имён у копий совпадают: словари пополняются одними и теми же именами в одном порядке
+        DocumentWrapper stored = doc->shared(target.field_names);
+        if (target.indexes.size() > 0) {
+            indexDocument(target, ids[i], stored);
+        }
+        target.data.put(ids[i], std::move(stored));
+    }
+}
+
+void Collection::copyState(CollectionState& target, const CollectionState& source) {
+    clearState(target);
+    target.field_names.appendFrom(source.field_names);
+    target.data.reserve(source.data.size());
+    source.data.forEachInBuckets(0, source.data.capacity(), [&target](const std::string& id, const DocumentWrapper& doc) {
+        target.data.put(id, doc.shared(target.field_names));
+    });
+    // индексы покрывают и документы, ещё лежащие в снимке, поэтому копируются, а не строятся заново
+    Vector<Index*> source_indexes = source.indexes.values();
+    for (size_t i = 0; i < source_indexes.size(); ++i) {
+        Index* index = nullptr;
+        if (source_indexes[i]->type() == IndexType::Ordered) {
+            index = new OrderedIndex(source_indexes[i]->getField());
+        } else {
+            index = new HashIndex(source_indexes[i]->getField());
+        }
+        index->fromJson(source_indexes[i]->toJson());
+        target.indexes.put(index->getField(), index);
+    }
+}
+
+void Collection::clearState(CollectionState& state) {
+    Vector<Index*> all_indexes = state.indexes.values();
+    for (size_t i = 0; i < all_indexes.size(); ++i) {
+        delete all_indexes[i];
+    }
+    state.indexes.clear();
+    state.data.clear();
+    state.field_names.clear();
+}
+
 bool Collection::insert(const DocumentWrapper& document) {
     DocumentWrapper doc_copy = document;
     if (!doc_copy.hasField("_id")) { //нет id - генерируем
         doc_copy.setGeneratedId();
     }
     std::string id = doc_copy.getField<std::string>("_id");
-    data.put(id, doc_copy);
-    return saveToFile();
+    // сначала журнал: если запись не удалась, коллекция не меняется
+    if (!wal.appendInsert(doc_copy)) { // дописываем одну запись вместо перезаписи всего файла
+        return false;
+    }
+    storeDocument(standby(), id, doc_copy);
+    publish([&id, this](CollectionState& target, const CollectionState& source) {
+        mirrorDocuments(target, source, Vector<std::string>(1, id));
+    });
+    return commitLog();
 }
 bool Collection::insert(const std::string& json_str) {
     DocumentWrapper doc(json_str);
@@ -26,91 +264,730 @@ bool Collection::insert(const Document& json_doc) {
     DocumentWrapper doc(json_doc);
     return insert(doc);
 }
+size_t Collection::insertMany(const Vector<DocumentWrapper>& documents) {
+    Vector<DocumentWrapper> batch;
+    batch.reserve(documents.size());
+    size_t missing_ids = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (!documents[i].hasField("_id")) {
+            missing_ids++;
+        }
+    }
+    Vector<std::string> ids = DocumentWrapper::generateIds(missing_ids);
+    size_t next_id = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        batch.push_back(documents[i]);
+        DocumentWrapper& doc = batch.back();
+        if (!doc.hasField("_id")) {
+            doc.setField("_id", ids[next_id++]);
+        }
+    }
+    // пачка видна только после записи в журнал: при ошибке в памяти не остаётся ни одного документа
+    if (!wal.appendInsertBatch(batch)) {
+        return 0;
+    }
+    Vector<std::string> batch_ids;
+    batch_ids.reserve(batch.size());
+    CollectionState& target = standby();
+    for (size_t i = 0; i < batch.size(); ++i) {
+        batch_ids.push_back(batch[i].getField<std::string>("_id"));
+        storeDocument(target, batch_ids.back(), batch[i]);
+    }
+    // вся пачка становится видна читателям разом
+    publish([&batch_ids, this](CollectionState& other, const CollectionState& source) {
+        mirrorDocuments(other, source, batch_ids);
+    });
+    if (!commitLog()) {
+        return 0;
+    }
+    return batch.size();
+}
+
+size_t Collection::importNdjson(std::istream& input, size_t batch_size) {
+    return readNdjson(input, batch_size, [this](const Vector<DocumentWrapper>& batch) {
+        size_t inserted = insertMany(batch);
+        maybeCheckpoint();
+        return inserted;
+    });
+}
+
+size_t Collection::readNdjson(std::istream& input, size_t batch_size,
+                              const std::function<size_t(const Vector<DocumentWrapper>&)>& insert_batch) {
+    Vector<DocumentWrapper> batch;
+    batch.reserve(batch_size);
+    size_t imported = 0;
+    size_t line_number = 0;
+    std::string line;
+    while (std::getline(input, line)) {
+        line_number++;
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue; // пустая строка
+        }
+        try {
+            Document parsed = nlohmann::json::parse(line);
+            if (!parsed.is_object()) {
+                std::cerr << "Line " << line_number << ": document must be a JSON object, skipped" << std::endl;
+                continue;
+            }
+            batch.emplace_back(std::move(parsed));
+        } catch (const nlohmann::json::parse_error& e) {
+            std::cerr << "Line " << line_number << ": " << e.what() << ", skipped" << std::endl;
+            continue;
+        }
+        if (batch.size() >= batch_size) {
+            imported += insert_batch(batch);
+            batch.clear();
+        }
+    }
+    imported += insert_batch(batch);
+    return imported;
+}
+
 bool Collection::findById(const std::string& id, DocumentWrapper& result) const {
-    return data.get(id, result);
+    const DocumentWrapper* doc = findPointer(view(), id);
+    if (doc == nullptr) {
+        return false;
+    }
+    result = *doc;
+    return true;
+}
+
+void Collection::storeDocument(CollectionState& state, const std::string& id, const DocumentWrapper& document) {
+    // в таблице документ компактный, вместо имён полей - номера из словаря коллекции;
+    // сжимается до правки индексов, чтобы индексы и таблица не разошлись, если сжатие не удастся
+    DocumentWrapper stored = document.isCompact() ? DocumentWrapper::compacted(document.toDocument(), state.field_names)
+                                                  : DocumentWrapper::compacted(document.getRawDocument(), state.field_names);
+    if (state.indexes.size() > 0) {
+        const DocumentWrapper* old_doc = findPointer(state, id);
+        if (old_doc != nullptr) {
+            unindexDocument(state, id, *old_doc);
+        }
+        indexDocument(state, id, document);
+    }
+    state.data.put(id, std::move(stored));
+    // новая версия перекрывает снимок; с индексами старая уже перенесена в обе копии поиском выше
+    pending.remove(id);
+}
+
+bool Collection::eraseDocument(CollectionState& state, const std::string& id) {
+    if (state.indexes.size() > 0) {
+        // документ из индексов убирается на месте, без копии
+        const DocumentWrapper* old_doc = findPointer(state, id);
+        if (old_doc != nullptr) {
+            unindexDocument(state, id, *old_doc);
+        }
+    }
+    bool removed = state.data.remove(id);
+    if (pending.remove(id)) {
+        removed = true;
+    }
+    return removed;
+}
+
+void Collection::indexDocument(CollectionState& state, const std::string& id, const DocumentWrapper& document) {
+    Vector<Index*> all_indexes = state.indexes.values();
+    for (size_t i = 0; i < all_indexes.size(); ++i) {
+        all_indexes[i]->add(id, document);
+    }
+}
+
+void Collection::unindexDocument(CollectionState& state, const std::string& id, const DocumentWrapper& document) {
+    Vector<Index*> all_indexes = state.indexes.values();
+    for (size_t i = 0; i < all_indexes.size(); ++i) {
+        all_indexes[i]->remove(id, document);
+    }
+}
+
+bool Collection::createIndex(const std::string& field, IndexType type) {
+    if (hasIndex(field)) {
+        std::cerr << "Index on '" << field << "' already exists." << std::endl;
+        return false;
+    }
+    // индекс строится по каждой копии: сначала по второй, потом, когда читатели ушли, по прежней активной
+    auto build = [this, &field, type](CollectionState& state) {
+        Index* index = nullptr;
+        if (type == IndexType::Ordered) {
+            index = new OrderedIndex(field);
+        } else {
+            index = new HashIndex(field);
+        }
+        Vector<const DocumentWrapper*> all_docs = allDocuments(state);
+        for (size_t i = 0; i < all_docs.size(); ++i) {
+            index->add(all_docs[i]->getField<std::string>("_id"), *all_docs[i]);
+        }
+        state.indexes.put(field, index);
+    };
+    build(standby());
+    publish([&build](CollectionState& target, const CollectionState&) { build(target); });
+    return saveIndexes();
+}
+
+bool Collection::dropIndex(const std::string& field) {
+    if (!hasIndex(field)) {
+        std::cerr << "Index on '" << field << "' does not exist." << std::endl;
+        return false;
+    }
+    auto drop = [&field](CollectionState& state) {
+        Index* index = nullptr;
+        if (state.indexes.get(field, index)) {
+            delete index;
+            state.indexes.remove(field);
+        }
+    };
+    drop(standby());
+    // указатель на индекс прежней активной копии мог взять планировщик читателя: удаляется после его ухода
+    publish([&drop](CollectionState& target, const CollectionState&) { drop(target); });
+    return saveIndexes();
+}
+
+bool Collection::hasIndex(const std::string& field) const {
+    Index* index = nullptr;
+    return view().indexes.get(field, index);
+}
+
+const Index* Collection::getIndex(const std::string& field) const {
+    Index* index = nullptr;
+    if (!view().indexes.get(field, index)) {
+        return nullptr;
+    }
+    return index;
+}
+
+Vector<std::string> Collection::getIndexedFields() const {
+    return view().indexes.keys();
+}
+
+// по какому снимку построены индексы: размер и время изменения файла
+Document Collection::snapshotIdentity() const {
+    struct stat st;
+    if (stat(storage_path.c_str(), &st) != 0) {
+        return Document();
+    }
+    return Document{{"size", static_cast<long long>(st.st_size)},
+                    {"mtime_ns", static_cast<long long>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec}};
+}
+
+Document Collection::indexData(const CollectionState& state) const {
+    if (state.indexes.size() == 0) {
+        return Document();
+    }
+    Document index_data = Document::object();
+    index_data["indexes"] = Document::array();
+    Vector<Index*> all_indexes = state.indexes.values();
+    for (size_t i = 0; i < all_indexes.size(); ++i) {
+        index_data["indexes"].push_back(Document{{"field", all_indexes[i]->getField()},
+                                                 {"type", Index::typeName(all_indexes[i]->type())},
+                                                 {"entries", all_indexes[i]->toJson()}});
+    }
+    return index_data;
+}
+
+bool Collection::writeIndexFile(Document index_data) const {
+    if (index_data.is_null()) {
+        std::remove(index_path.c_str());
+        return true;
+    }
+    index_data["snapshot"] = snapshotIdentity();
+    std::string tmp_path = index_path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file for writing: " << tmp_path << std::endl;
+        return false;
+    }
+    std::vector<uint8_t> encoded = nlohmann::json::to_msgpack(index_data);
+    file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    file.close();
+    if (!file || std::rename(tmp_path.c_str(), index_path.c_str()) != 0) {
+        std::cerr << "Error writing indexes: " << index_path << std::endl;
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Collection::saveIndexes() {
+    // контрольная точка, снявшая индексы до этого изменения, свой файл индексов уже не запишет
+    index_generation++;
+    std::lock_guard<std::mutex> lock(index_file_mutex);
+    return writeIndexFile(indexData(view()));
+}
+
+// индексы читаются до применения журнала: журнал поддерживает их сам
+void Collection::loadIndexes(CollectionState& state) {
+    std::ifstream file(index_path, std::ios::binary);
+    if (!file.is_open()) {
+        return;
+    }
+    try {
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        Document index_data = nlohmann::json::from_msgpack(bytes);
+        bool up_to_date = index_data["snapshot"] == snapshotIdentity();
+        for (auto it = index_data["indexes"].begin(); it != index_data["indexes"].end(); ++it) {
+            std::string field = (*it)["field"].get<std::string>();
+            Index* index = nullptr;
+            if (it->value("type", "hash") == "ordered") {
+                index = new OrderedIndex(field);
+            } else {
+                index = new HashIndex(field);
+            }
+            if (up_to_date) {
+                index->fromJson((*it)["entries"]);
+            }
+            state.indexes.put(field, index);
+        }
+        if (!up_to_date) {
+            index_rebuild_needed = true;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error loading indexes: " << e.what() << std::endl;
+    }
+}
+
+void Collection::rebuildIndexes(CollectionState& state) {
+    Vector<Index*> all_indexes = state.indexes.values();
+    for (size_t i = 0; i < all_indexes.size(); ++i) {
+        all_indexes[i]->clear();
+    }
+    Vector<const DocumentWrapper*> all_docs = allDocuments(state);
+    for (size_t i = 0; i < all_docs.size(); ++i) {
+        indexDocument(state, all_docs[i]->getField<std::string>("_id"), *all_docs[i]);
+    }
+    std::cout << "Indexes of collection " << name << " rebuilt" << std::endl;
+}
+
+bool Collection::materialize(const std::string& id) const {
+    SnapshotEntry entry;
+    if (!pending.get(id, entry)) {
+        return false;
+    }
+    Document doc;
+    if (!snapshot.materialize(entry, doc)) {
+        // снимок повреждён: контрольная точка переписала бы его без этого документа, и он пропал бы насовсем
+        if (!load_failed.exchange(true)) {
+            std::cerr << "Snapshot document '" << id << "' of collection " << name
+                      << " cannot be decoded, checkpoints are disabled to keep " << storage_path << std::endl;
+        }
+        return false;
+    }
+    // снимок читается при первом обращении, когда читателей ещё нет: документ кладётся сразу в обе копии
+    DocumentWrapper stored = DocumentWrapper::compacted(doc, states[0].field_names);
+    states[1].field_names.appendFrom(states[0].field_names);
+    states[1].data.put(id, stored.shared(states[1].field_names));
+    states[0].data.put(id, std::move(stored));
+    pending.remove(id);
+    return true;
+}
+
+void Collection::materializeAll() const {
+    if (pending.size() > 0) {
+        for (int side = 0; side < 2; ++side) {
+            states[side].data.reserve(states[side].data.size() + pending.size());
+        }
+        Vector<std::string> ids = pending.keys();
+        for (size_t i = 0; i < ids.size(); ++i) {
+            materialize(ids[i]);
+        }
+        pending.clear();
+    }
+    snapshot_materialized = true;
 }
 
 Vector<DocumentWrapper> Collection::findAll() const {
-    Vector<DocumentWrapper> all_documents;
-    Vector<DocumentWrapper> values = data.values();
-    for (size_t i = 0; i < values.size(); ++i) {
-        all_documents.push_back(values[i]);
+    materializeAll();
+    return view().data.values();
+}
+
+Vector<const DocumentWrapper*> Collection::allDocuments(const CollectionState& state) const {
+    materializeAll();
+    Vector<const DocumentWrapper*> result;
+    result.reserve(state.data.size());
+    state.data.forEachInBuckets(0, state.data.capacity(), [&result](const std::string&, const DocumentWrapper& doc) {
+        result.push_back(&doc);
+    });
+    return result;
+}
+
+const DocumentWrapper* Collection::findPointer(const CollectionState& state, const std::string& id) const {
+    const DocumentWrapper* doc = state.data.find(id);
+    if (doc == nullptr && materialize(id)) {
+        doc = state.data.find(id);
     }
-    return all_documents;
+    return doc;
+}
+
+Cursor Collection::findCursor(const std::string& query_json, size_t batch_size) const {
+    QueryParser parser;
+    return findCursor(parser.parse(query_json), batch_size);
+}
+
+Cursor Collection::findCursor(const ParsedQuery& query, size_t batch_size) const {
+    ViewPin pin(*this);
+    QueryPlanner planner;
+    return Cursor(*this, planner.plan(query, *this), batch_size);
+}
+
+Cursor Collection::findCursor(const ParsedQuery& query, const FindOptions& options, size_t batch_size) const {
+    ViewPin pin(*this);
+    QueryPlanner planner;
+    return Cursor(*this, planner.plan(query, *this), batch_size, options);
 }
+
 Vector<std::string> Collection::getAllIds() const {
     Vector<std::string> ids;
-    Vector<std::string> keys = data.keys();
+    Vector<std::string> keys = view().data.keys();
     for (size_t i = 0; i < keys.size(); ++i) {
         ids.push_back(keys[i]);
     }
+    Vector<std::string> snapshot_keys = pending.keys();
+    for (size_t i = 0; i < snapshot_keys.size(); ++i) {
+        ids.push_back(snapshot_keys[i]);
+    }
     return ids;
 }
 
 bool Collection::removeById(const std::string& id) {
-    bool removed = data.remove(id);
-    if (removed) {
-        saveToFile();
+    if (view().data.find(id) == nullptr && pending.find(id) == nullptr) {
+        return false;
+    }
+    if (!wal.appendRemove(id)) {
+        return false;
+    }
+    eraseDocument(standby(), id);
+    publish([&id, this](CollectionState& target, const CollectionState& source) {
+        mirrorDocuments(target, source, Vector<std::string>(1, id));
+    });
+    return commitLog();
+}
+
+void Collection::applyLogRecord(CollectionState& state, const WalRecord& record) {
+    if (record.operation == WalOperation::Insert) {
+        DocumentWrapper doc(record.payload);
+        storeDocument(state, doc.getField<std::string>("_id"), doc);
+    } else if (record.operation == WalOperation::Remove) {
+        eraseDocument(state, record.payload);
+    } else if (record.operation == WalOperation::RemoveBatch) {
+        Vector<std::string> ids;
+        if (!WriteAheadLog::decodeIds(record.payload, ids)) {
+            std::cerr << "Damaged remove batch in log of collection " << name << std::endl;
+            return;
+        }
+        for (size_t i = 0; i < ids.size(); ++i) {
+            eraseDocument(state, ids[i]);
+        }
     }
-    return removed;
 }
 
-bool Collection::saveToFile() const {
+bool Collection::saveToFile() {
+    std::lock_guard<std::mutex> running(checkpoint_mutex);
+    return checkpoint();
+}
+
+bool Collection::checkpoint() {
+    // копия словаря: коллекция пополняет свой, пока пишется снимок; объявлена до документов, которые на неё ссылаются
+    FieldDictionary names;
+    Vector<DocumentWrapper> documents;
+    Document index_data;
+    uint64_t generation = 0;
+    try {
+        // под блокировкой только согласованный вид: буферы документов делятся, а не копируются,
+        // журнал откладывается - изменения после этого момента идут в новый файл и в снимок не попадают
+        WriteGuard lock = writeLock();
+        // документы снимка читаются до проверки: нечитаемый документ тоже запрещает контрольную точку
+        materializeAll();
+        if (load_failed) {
+            // в памяти не всё, что на диске: снимок из неё затёр бы данные
+            std::cerr << "Collection " << name << " was not loaded correctly, checkpoint refused" << std::endl;
+            return false;
+        }
+        // все документы уже в памяти, отображение старого снимка больше не нужно
+        snapshot.close();
+        // под блокировкой писателя копии одинаковы, активную в это время только читают
+        const CollectionState& state = view();
+        names.appendFrom(state.field_names);
+        documents.reserve(state.data.size());
+        state.data.forEachInBuckets(0, state.data.capacity(), [&](const std::string&, const DocumentWrapper& doc) {
+            documents.push_back(doc.shared(names));
+        });
+        index_data = indexData(state);
+        generation = index_generation;
+        if (!wal.rotate()) {
+            return false;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error saving collection: " << e.what() << std::endl;
+        return false;
+    }
+    try {
+        Vector<const DocumentWrapper*> view;
+        view.reserve(documents.size());
+        for (size_t i = 0; i < documents.size(); ++i) {
+            view.push_back(&documents[i]);
+        }
+        return writeSnapshot(view, std::move(index_data), generation);
+    } catch (const std::exception& e) {
+        // отложенный журнал остаётся и применяется при загрузке, следующая контрольная точка его удалит
+        std::cerr << "Error saving collection: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool Collection::writeSnapshot(const Vector<const DocumentWrapper*>& view, Document index_data, uint64_t generation) {
+    // создаем директорию если не существует
+    std::string directory = storage_path.substr(0, storage_path.find_last_of('/'));
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    // пишем во временный файл и атомарно подменяем: при сбое остаётся старый снимок + журнал
+    std::string tmp_path = storage_path + ".tmp";
+    if (!SnapshotWriter::write(tmp_path, view) || !SnapshotWriter::syncFile(tmp_path)) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    if (std::rename(tmp_path.c_str(), storage_path.c_str()) != 0) {
+        std::cerr << "Cannot replace snapshot: " << storage_path << std::endl;
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    SnapshotWriter::syncFile(directory);
+    {
+        std::lock_guard<std::mutex> lock(index_file_mutex);
+        // индексы менялись во время записи: их файл уже записал createIndex/dropIndex
+        if (generation == index_generation) {
+            writeIndexFile(std::move(index_data));
+        }
+    }
+    // всё из отложенного журнала уже в снимке
+    wal.dropRotated();
+    // старый JSON снимок устарел
+    std::remove(json_path.c_str());
+    last_checkpoint_time = std::time(nullptr);
+    snapshot_exists = true;
+    std::cout << "Collection " << name << " saved to " << storage_path << std::endl;
+    return true;
+}
+
+void Collection::setCheckpointPolicy(const CheckpointPolicy& new_policy) {
+    policy = new_policy;
+}
+
+void Collection::setDurability(const DurabilityOptions& options) {
+    durability = options;
+    wal.setDurability(options);
+}
+
+DurabilityOptions Collection::getDurability() const {
+    return durability;
+}
+
+uint64_t Collection::logPosition() const {
+    return wal.position();
+}
+
+bool Collection::waitDurable(uint64_t position, Durability mode) {
+    return wal.waitDurable(position, mode);
+}
+
+LogSyncStats Collection::logSyncStats() const {
+    return wal.syncStats();
+}
+
+bool Collection::commitLog() {
+    if (durability.caller_waits) {
+        return true;
+    }
+    return wal.waitDurable(wal.position(), durability.mode);
+}
+
+bool Collection::checkpointNeeded() const {
+    if (wal.sizeBytes() == 0) {
+        return false;
+    }
+    if (policy.max_log_bytes > 0 && wal.sizeBytes() >= policy.max_log_bytes) {
+        return true;
+    }
+    return policy.max_age_seconds > 0 &&
+           std::time(nullptr) - last_checkpoint_time >= policy.max_age_seconds;
+}
+
+bool Collection::maybeCheckpoint() {
+    if (!checkpointNeeded()) {
+        return true;
+    }
+    // контрольная точка уже идёт в другом потоке: изменения после её начала дождутся следующей
+    std::unique_lock<std::mutex> running(checkpoint_mutex, std::try_to_lock);
+    if (!running.owns_lock() || !checkpointNeeded()) {
+        return true;
+    }
+    return checkpoint();
+}
+
+bool Collection::isDirty() const {
+    return wal.sizeBytes() > 0 || !snapshot_exists;
+}
+
+bool Collection::exportToJson(std::ostream& out) const {
     try {
         // JSON объект для хранения всех доков
         nlohmann::json collection_data = nlohmann::json::object();
-        Vector<DocumentWrapper> all_docs = findAll();
-        // сохраняем каждый в JSON
+        Vector<const DocumentWrapper*> all_docs = allDocuments(view());
         for (size_t i = 0; i < all_docs.size(); ++i) {
-            const DocumentWrapper& doc = all_docs[i];
+            const DocumentWrapper& doc = *all_docs[i];
             std::string id = doc.getField<std::string>("_id");
-            collection_data[id] = doc.getRawDocument();
-        }
-        // создаем директорию если не существует
-        std::string directory = storage_path.substr(0, storage_path.find_last_of('/'));
-        system(("mkdir -p " + directory).c_str());
-        // Сохраняем в файл
-        std::ofstream file(storage_path);
-        if (!file.is_open()) {
-            std::cerr << "Cannot open file for writing: " << storage_path << std::endl;
-            return false;
+            collection_data[id] = doc.toDocument();
         }
-        file << collection_data.dump(4);  // красивый JSON с отступами
-        file.close();
-        std::cout << "Collection " << name << " saved to " << storage_path << std::endl;
-        return true;
+        out << collection_data.dump(4) << std::endl;  // красивый JSON с отступами
+        return static_cast<bool>(out);
     } catch (const std::exception& e) {
-        std::cerr << "Error saving collection: " << e.what() << std::endl;
+        std::cerr << "Error exporting collection: " << e.what() << std::endl;
         return false;
     }
 }
 
+bool Collection::loadJsonSnapshot(CollectionState& state) {
+    std::ifstream file(json_path);
+    if (!file.is_open()) {
+        return false;
+    }
+    nlohmann::json collection_data;
+    file >> collection_data; //читаем
+    file.close();
+    // загружаем документы из JSON
+    state.data.reserve(collection_data.size());
+    for (auto& [id, doc_json] : collection_data.items()) {
+        state.data.put(id, DocumentWrapper::compacted(doc_json, state.field_names));
+    }
+    return true;
+}
+
 bool Collection::loadFromFile() {
+    load_failed = false;
     try {
-        std::ifstream file(storage_path);
-        if (!file.is_open()) {
+        // загрузка идёт в первую копию, вторая становится её копией в конце; читателей в это время нет
+        clearState(states[0]);
+        clearState(states[1]);
+        active = 0;
+        pending.clear();
+        snapshot_materialized = false;
+        std::string source = storage_path;
+        last_checkpoint_time = std::time(nullptr);
+        struct stat st;
+        snapshot_exists = stat(storage_path.c_str(), &st) == 0;
+        if (snapshot_exists) {
+            last_checkpoint_time = st.st_mtime;
+        }
+        bool snapshot_loaded = false;
+        if (snapshot.open(storage_path)) {
+            // сами документы декодируются при первом обращении
+            // таблица сразу нужного размера: загрузка идёт без перестроек
+            pending.reserve(snapshot.documentCount());
+            snapshot_loaded = snapshot.readDirectory([this](const std::string& id, const SnapshotEntry& entry) {
+                pending.put(id, entry);
+            });
+            if (!snapshot_loaded) {
+                pending.clear();
+                snapshot.close();
+            }
+        }
+        if (!snapshot_loaded && snapshot_exists) {
+            // снимок есть, но не читается: следующая контрольная точка не должна его затереть
+            std::string aside = storage_path + ".corrupt";
+            std::error_code ec;
+            if (std::filesystem::exists(aside, ec)) {
+                aside += "." + std::to_string(std::time(nullptr));
+            }
+            std::filesystem::rename(storage_path, aside, ec);
+            if (ec) {
+                // без переноса нельзя продолжать: контрольная точка заменила бы файл пустым снимком
+                throw std::runtime_error("snapshot " + storage_path + " is damaged and cannot be moved aside: " + ec.message());
+            }
+            std::cerr << "Snapshot " << storage_path << " is damaged, moved to " << aside
+                      << "; collection " << name << " starts from the log only" << std::endl;
+            snapshot_exists = false;
+        } else if (!snapshot_loaded && loadJsonSnapshot(states[0])) {
+            source = json_path;
+        } else if (!snapshot_loaded) {
             std::cout << "Collection file not found, creating new: " << storage_path << std::endl;
-            return true;
-        }
-        nlohmann::json collection_data;
-        file >> collection_data; //читаем
-        file.close();
-        data.clear();
-        // загружаем документы из JSON
-        for (auto& [id, doc_json] : collection_data.items()) {
-            DocumentWrapper doc(doc_json);
-            data.put(id, doc);
-        }
-        std::cout << "Collection " << name << " loaded from " << storage_path << " (" << size() << " documents)" << std::endl;
+        }
+        loadIndexes(states[0]);
+        // изменения после последнего снимка
+        size_t replayed = wal.replay([this](const WalRecord& record) { applyLogRecord(states[0], record); });
+        if (index_rebuild_needed) {
+            // индексы не соответствуют снимку (например, сбой между записью снимка и индексов)
+            rebuildIndexes(states[0]);
+            saveIndexes();
+            index_rebuild_needed = false;
+        }
+        copyState(states[1], states[0]);
+        std::cout << "Collection " << name << " loaded from " << source << " (" << size() << " documents";
+        if (replayed > 0) {
+            std::cout << ", " << replayed << " log records replayed";
+        }
+        std::cout << ")" << std::endl;
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error loading collection: " << e.what() << std::endl;
+        load_failed = true;
         return false;
     }
 }
 
+void Collection::printStats(std::ostream& out) const {
+    ReadGuard guard = readLock();
+    ViewPin pin(*this);
+    const CollectionState& state = pin.state();
+    out << "Collection '" << name << "': " << size() << " documents ("
+        << state.data.size() << " in memory, " << pending.size() << " in snapshot)" << std::endl;
+    // таблица, словарь и индексы есть в каждой из двух копий, буферы документов у них общие
+    out << "  table: " << state.data.capacity() << " slots, load " << state.data.load_factor()
+        << ", " << (state.data.memoryBytes() + pending.memoryBytes()) << " bytes in each of 2 copies" << std::endl;
+    DocumentMemory memory = measureDocuments(state);
+    out << "  documents: " << memory.bytes << " bytes (" << memory.compact_documents << " of " << memory.documents
+        << " compact), " << memory.field_names << " field names in " << memory.dictionary_bytes
+        << " bytes, as json trees ~" << memory.tree_bytes << " bytes";
+    if (memory.tree_bytes > 0) {
+        double used = static_cast<double>(memory.bytes + memory.dictionary_bytes) / memory.tree_bytes;
+        out << ", saved " << (1.0 - used) * 100 << "%";
+    }
+    out << std::endl;
+    Vector<std::string> fields = state.indexes.keys();
+    for (size_t i = 0; i < fields.size(); ++i) {
+        Index* index = nullptr;
+        state.indexes.get(fields[i], index);
+        AllocatorStats index_memory = index->memoryStats();
+        out << "  index '" << fields[i] << "' (" << Index::typeName(index->type()) << "): "
+            << index->distinctValues() << " values, " << index_memory.bytes_in_use << " bytes in use, "
+            << index_memory.bytes_reserved << " reserved in " << index_memory.blocks << " slab blocks" << std::endl;
+    }
+    LogSyncStats sync = wal.syncStats();
+    out << "  log: " << wal.sizeBytes() << " bytes, durability " << DurabilityOptions::modeName(durability.mode)
+        << ", " << sync.syncs << " fsyncs for " << sync.commits << " commits";
+    if (sync.syncs > 0) {
+        out << ", avg " << sync.total_ms / sync.syncs << " ms, max " << sync.max_ms << " ms";
+    }
+    out << std::endl;
+}
+
+DocumentMemory Collection::measureDocuments(const CollectionState& state) const {
+    DocumentMemory memory;
+    state.data.forEachInBuckets(0, state.data.capacity(), [&memory](const std::string&, const DocumentWrapper& doc) {
+        memory.documents++;
+        if (doc.isCompact()) {
+            memory.compact_documents++;
+        }
+        memory.bytes += doc.heapBytes();
+        memory.tree_bytes += doc.treeHeapBytes();
+    });
+    memory.field_names = state.field_names.size();
+    memory.dictionary_bytes = state.field_names.memoryBytes();
+    return memory;
+}
+
+DocumentMemory Collection::documentMemory() const {
+    ReadGuard guard = readLock();
+    return measureDocuments(view());
+}
+
 size_t Collection::size() const {
-    return data.size();
+    return view().data.size() + pending.size();
 }
 std::string Collection::getName() const {
     return name;
@@ -118,6 +995,15 @@ std::string Collection::getName() const {
 std::string Collection::getStoragePath() const {
     return storage_path;
 }
+std::string Collection::getLogPath() const {
+    return wal.getPath();
+}
+std::string Collection::getJsonPath() const {
+    return json_path;
+}
+std::string Collection::getIndexPath() const {
+    return index_path;
+}
 
 // поиск доков по JSON запросу
 Vector<DocumentWrapper> Collection::find(const std::string& query_json) const {
@@ -126,29 +1012,384 @@ Vector<DocumentWrapper> Collection::find(const std::string& query_json) const {
     return find(query);
 }
 Vector<DocumentWrapper> Collection::find(const ParsedQuery& query) const {
+    ViewPin pin(*this);
+    QueryPlanner planner;
+    QueryPlan plan = planner.plan(query, *this);
+    return execute(plan);
+}
+Vector<DocumentWrapper> Collection::find(const ParsedQuery& query, const FindOptions& options) const {
+    ViewPin pin(*this);
+    QueryPlanner planner;
+    QueryPlan plan = planner.plan(query, *this);
+    return execute(plan, options);
+}
+bool Collection::findSorted(const ParsedQuery& query, const FindOptions& options,
+                            const std::function<void(const DocumentWrapper&)>& output) const {
+    ViewPin pin(*this);
+    QueryPlanner planner;
+    QueryPlan plan = planner.plan(query, *this);
+    return executeSorted(plan, options, output);
+}
+
+QueryPlan Collection::explain(const std::string& query_json) const {
+    ViewPin pin(*this);
+    QueryParser parser;
+    QueryPlanner planner;
+    QueryPlan plan = planner.plan(parser.parse(query_json), *this);
+    execute(plan);
+    return plan;
+}
+
+Vector<DocumentWrapper> Collection::execute(QueryPlan& plan) const {
+    return execute(plan, FindOptions());
+}
+
+Vector<DocumentWrapper> Collection::execute(QueryPlan& plan, const FindOptions& options) const {
+    ViewPin pin(*this);
+    const CollectionState& state = pin.state();
+    typedef std::chrono::steady_clock Clock;
+    auto elapsedMs = [](Clock::time_point from) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - from).count();
+    };
     Vector<DocumentWrapper> results;
-    Vector<DocumentWrapper> all_docs = findAll();
-    for (size_t i = 0; i < all_docs.size(); ++i) {
-        if (query.matches(all_docs[i])) {
-            results.push_back(all_docs[i]);
+    if (!options.sort.empty()) {
+        Clock::time_point start = Clock::now();
+        executeSorted(plan, options, [&results](const DocumentWrapper& doc) { results.push_back(doc); });
+        plan.returned = results.size();
+        plan.filter_ms = elapsedMs(start);
+        return results;
+    }
+    size_t needed = options.matchesNeeded();
+    size_t matched = 0;
+    // совпадение попадает в результат только после первых skip
+    auto take = [&](const DocumentWrapper& doc) {
+        if (matched++ >= options.skip) {
+            appendResult(results, doc, options);
+        }
+    };
+
+    if (plan.source == PlanSource::FullScan) {
+        Clock::time_point start = Clock::now();
+        materializeAll();
+        plan.candidates = size();
+        plan.candidates_ms = elapsedMs(start);
+        start = Clock::now();
+        if (needed == 0) {
+            scan([&plan](const DocumentWrapper& doc) { return plan.accepts(doc); }, &results, options);
+            plan.examined = plan.candidates;
+            if (options.skip > 0) {
+                // параллельный обход сливает части в порядке корзин - пропуск тот же, что в одном потоке
+                Vector<DocumentWrapper> rest;
+                rest.reserve(results.size() > options.skip ? results.size() - options.skip : 0);
+                for (size_t i = options.skip; i < results.size(); ++i) {
+                    rest.push_back(std::move(results[i]));
+                }
+                results = std::move(rest);
+            }
+        } else {
+            // нужно skip+limit совпадений: обход в одном потоке до первых needed
+            for (auto it = state.data.iterate(); it.valid() && matched < needed; it.next()) {
+                plan.examined++;
+                if (plan.accepts(it.value())) {
+                    take(it.value());
+                }
+            }
         }
+        plan.returned = results.size();
+        plan.filter_ms = elapsedMs(start);
+        return results;
     }
+
+    Clock::time_point start = Clock::now();
+    Vector<std::string> candidates;
+    plan.collectCandidates(candidates);
+    plan.candidates = candidates.size();
+    plan.candidates_ms = elapsedMs(start);
+
+    start = Clock::now();
+    for (size_t i = 0; i < candidates.size() && (needed == 0 || matched < needed); ++i) {
+        const DocumentWrapper* doc = findPointer(state, candidates[i]);
+        if (doc == nullptr) {
+            continue;
+        }
+        plan.examined++;
+        if (plan.accepts(*doc)) {
+            take(*doc);
+        }
+    }
+    plan.returned = results.size();
+    plan.filter_ms = elapsedMs(start);
     return results;
 }
 
+bool Collection::executeSorted(QueryPlan& plan, const FindOptions& options,
+                               const std::function<void(const DocumentWrapper&)>& output) const {
+    ViewPin pin(*this);
+    const CollectionState& state = pin.state();
+    SortOrder order(options.sort);
+    size_t needed = options.matchesNeeded();
+    TopK top(order, needed);
+    ExternalSorter sorter(order, options.sort_memory, options.sort_directory);
+    bool ok = true;
+    auto visit = [&](const DocumentWrapper& doc) {
+        plan.examined++;
+        if (!plan.accepts(doc)) {
+            return;
+        }
+        if (needed > 0) {
+            top.add(doc);
+        } else if (ok) {
+            ok = sorter.add(doc, options.hasProjection() ? options.project(doc) : DocumentWrapper(doc));
+        }
+    };
+    // куча держит указатели в хранилище: всё нужное читается из снимка до обхода,
+    // иначе догрузка перестроит таблицу под ними
+    if (plan.source == PlanSource::FullScan) {
+        materializeAll();
+        plan.candidates = size();
+        for (auto it = state.data.iterate(); it.valid(); it.next()) {
+            visit(it.value());
+        }
+    } else {
+        Vector<std::string> candidates;
+        plan.collectCandidates(candidates);
+        plan.candidates = candidates.size();
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            materialize(candidates[i]);
+        }
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const DocumentWrapper* doc = state.data.find(candidates[i]);
+            if (doc != nullptr) {
+                visit(*doc);
+            }
+        }
+    }
+
+    if (needed > 0) {
+        Vector<const DocumentWrapper*> best = top.take();
+        for (size_t i = options.skip; i < best.size(); ++i) {
+            if (options.hasProjection()) {
+                output(options.project(*best[i]));
+            } else {
+                output(*best[i]);
+            }
+        }
+        return true;
+    }
+    size_t position = 0;
+    ok = ok && sorter.finish([&](const DocumentWrapper& doc) {
+        if (position++ >= options.skip) {
+            output(doc);
+        }
+    });
+    if (!ok) {
+        std::cerr << "Sort failed for collection '" << name << "'" << std::endl;
+    }
+    return ok;
+}
+
+size_t Collection::scan(const std::function<bool(const DocumentWrapper&)>& predicate, Vector<DocumentWrapper>* results) const {
+    return scan(predicate, results, FindOptions());
+}
+
+size_t Collection::scan(const std::function<bool(const DocumentWrapper&)>& predicate, Vector<DocumentWrapper>* results,
+                        const FindOptions& options) const {
+    materializeAll();
+    // потоки пула не видят отметку вызывающего потока: копия передаётся им явно
+    ViewPin pin(*this);
+    const CollectionState& state = pin.state();
+    size_t buckets = state.data.capacity();
+    size_t parts = scanParts(state);
+    if (parts == 1) {
+        size_t matched = 0;
+        state.data.forEachInBuckets(0, buckets, [&](const std::string&, const DocumentWrapper& doc) {
+            if (predicate(doc)) {
+                matched++;
+                if (results != nullptr) {
+                    appendResult(*results, doc, options);
+                }
+            }
+        });
+        return matched;
+    }
+    // каждый поток проверяет свой диапазон корзин и складывает совпадения в свой буфер
+    Vector<Vector<DocumentWrapper>> partial(parts);
+    Vector<size_t> counts(parts, 0);
+    ThreadPool::shared().parallelFor(parts, [&](size_t part) {
+        size_t begin = buckets * part / parts;
+        size_t end = buckets * (part + 1) / parts;
+        size_t matched = 0;
+        Vector<DocumentWrapper>& local = partial[part];
+        state.data.forEachInBuckets(begin, end, [&](const std::string&, const DocumentWrapper& doc) {
+            if (predicate(doc)) {
+                matched++;
+                if (results != nullptr) {
+                    appendResult(local, doc, options);
+                }
+            }
+        });
+        counts[part] = matched;
+    });
+    // слияние в порядке корзин - тот же порядок, что и при обходе в одном потоке
+    size_t matched = 0;
+    for (size_t part = 0; part < parts; ++part) {
+        matched += counts[part];
+    }
+    if (results != nullptr) {
+        // частичные результаты переносятся, документы не копируются второй раз
+        results->reserve(results->size() + matched);
+        for (size_t part = 0; part < parts; ++part) {
+            for (size_t i = 0; i < partial[part].size(); ++i) {
+                results->push_back(std::move(partial[part][i]));
+            }
+        }
+    }
+    return matched;
+}
+
+size_t Collection::scanParts(const CollectionState& state) const {
+    size_t threads = scan_options.threads == 0 ? ThreadPool::shared().size() : scan_options.threads;
+    if (threads <= 1 || state.data.size() < scan_options.parallel_threshold) {
+        return 1;
+    }
+    return threads * 2;  // частей больше потоков - неравные цепочки выравниваются
+}
+
+Vector<DocumentWrapper> Collection::aggregate(const std::string& pipeline_json) const {
+    AggregationPipeline pipeline;
+    if (!pipeline.parse(pipeline_json)) {
+        return Vector<DocumentWrapper>();
+    }
+    return aggregate(pipeline);
+}
+
+Vector<DocumentWrapper> Collection::aggregate(const AggregationPipeline& pipeline) const {
+    GroupTable groups(pipeline);
+    aggregateInto(pipeline, groups);
+    return pipeline.finish(groups);
+}
+
+void Collection::aggregateInto(const AggregationPipeline& pipeline, GroupTable& groups) const {
+    ViewPin pin(*this);
+    const CollectionState& state = pin.state();
+    QueryPlanner planner;
+    QueryPlan plan = planner.plan(pipeline.match, *this);
+    if (plan.source != PlanSource::FullScan) {
+        Vector<std::string> candidates;
+        plan.collectCandidates(candidates);
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const DocumentWrapper* doc = findPointer(state, candidates[i]);
+            if (doc != nullptr && plan.accepts(*doc)) {
+                groups.add(*doc);
+            }
+        }
+        return;
+    }
+
+    materializeAll();
+    size_t buckets = state.data.capacity();
+    size_t parts = scanParts(state);
+    if (parts == 1) {
+        state.data.forEachInBuckets(0, buckets, [&](const std::string&, const DocumentWrapper& doc) {
+            if (plan.accepts(doc)) {
+                groups.add(doc);
+            }
+        });
+        return;
+    }
+    // у каждой части своя таблица групп, таблицы сливаются после обхода
+    Vector<std::unique_ptr<GroupTable>> partial;
+    for (size_t part = 0; part < parts; ++part) {
+        partial.push_back(std::unique_ptr<GroupTable>(new GroupTable(pipeline)));
+    }
+    ThreadPool::shared().parallelFor(parts, [&](size_t part) {
+        size_t begin = buckets * part / parts;
+        size_t end = buckets * (part + 1) / parts;
+        GroupTable& local = *partial[part];
+        state.data.forEachInBuckets(begin, end, [&](const std::string&, const DocumentWrapper& doc) {
+            if (plan.accepts(doc)) {
+                local.add(doc);
+            }
+        });
+    });
+    for (size_t part = 0; part < parts; ++part) {
+        groups.merge(*partial[part]);
+    }
+}
+
+void Collection::setScanOptions(const ScanOptions& options) {
+    scan_options = options;
+}
+
+size_t Collection::count(const std::string& query_json) const {
+    QueryParser parser;
+    ParsedQuery query = parser.parse(query_json);
+    return count(query);
+}
+size_t Collection::count(const ParsedQuery& query) const {
+    ViewPin pin(*this);
+    QueryPlanner planner;
+    QueryPlan plan = planner.plan(query, *this);
+    if (plan.source != PlanSource::FullScan) {
+        // кандидаты из индексов проверяются на месте, без копий документов
+        Vector<std::string> candidates;
+        plan.collectCandidates(candidates);
+        size_t matched = 0;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const DocumentWrapper* doc = findPointer(pin.state(), candidates[i]);
+            if (doc != nullptr && plan.accepts(*doc)) {
+                matched++;
+            }
+        }
+        return matched;
+    }
+    // при полном обходе документы не копируются, только считаются
+    return scan([&plan](const DocumentWrapper& doc) { return plan.accepts(doc); }, nullptr);
+}
+
 size_t Collection::remove(const std::string& query_json) {
     QueryParser parser;
     ParsedQuery query = parser.parse(query_json);
     return remove(query);
 }
 size_t Collection::remove(const ParsedQuery& query) {
-    Vector<DocumentWrapper> docs_to_remove = find(query);
-    size_t removed_count = 0;
-    for (size_t i = 0; i < docs_to_remove.size(); ++i) {
-        std::string id = docs_to_remove[i].getField<std::string>("_id");
-        if (removeById(id)) {
-            removed_count++;
+    // нужны только id: документы читаются курсором без копирования
+    Vector<std::string> ids_to_remove;
+    Cursor cursor = findCursor(query);
+    while (cursor.next()) {
+        ids_to_remove.push_back(cursor.current().getField<std::string>("_id"));
+    }
+    return removeMany(ids_to_remove);
+}
+
+size_t Collection::removeMany(const Vector<std::string>& ids) {
+    Vector<std::string> present;
+    present.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (view().data.find(ids[i]) != nullptr || pending.find(ids[i]) != nullptr) {
+            present.push_back(ids[i]);
+        }
+    }
+    if (present.empty()) {
+        return 0;
+    }
+    // сначала журнал: если запись не удалась, документы остаются на месте
+    if (!wal.appendRemoveBatch(present)) {
+        std::cerr << "Remove of " << present.size() << " documents from collection " << name << " is not logged" << std::endl;
+        return 0;
+    }
+    size_t removed = 0;
+    CollectionState& target = standby();
+    for (size_t i = 0; i < present.size(); ++i) {
+        if (eraseDocument(target, present[i])) {
+            removed++;
         }
     }
-    return removed_count;
+    publish([&present, this](CollectionState& other, const CollectionState& source) {
+        mirrorDocuments(other, source, present);
+    });
+    if (!commitLog()) {
+        return 0;
+    }
+    return removed;
 }
\ No newline at end of file
@@ -3,42 +3,288 @@
 
 #include "document.h"
 #include "hash_map.h"  
+#include "index.h"
+#include <atomic>
+#include <condition_variable>
+#include <ctime>
+#include <functional>
+#include <mutex>
 #include <string>
 #include "vector.h"
+#include "snapshot.h"
+#include "wal.h"
+#include "cursor.h"
 
 class QueryParser;
 struct ParsedQuery;
+struct QueryPlan;
+struct FindOptions;
+class AggregationPipeline;
+class GroupTable;
+
+// полный обход коллекции
+struct ScanOptions {
+    size_t threads = 0;                  // 0 - по числу потоков общего пула
+    size_t parallel_threshold = 10000;   // меньше документов - обход в одном потоке
+};
+
+// когда писать снимок сам: 0 - условие отключено
+struct CheckpointPolicy {
+    size_t max_log_bytes = 64 * 1024 * 1024;   // размер журнала
+    long long max_age_seconds = 600;           // время с последнего снимка
+};
+
+// память документов в таблице: компактный вид против тех же документов деревьями nlohmann::json
+struct DocumentMemory {
+    size_t documents = 0;
+    size_t compact_documents = 0;   // остальные (с binary) хранятся деревом
+    size_t bytes = 0;               // буферы документов в куче
+    size_t tree_bytes = 0;          // оценка кучи, если бы все были деревьями
+    size_t field_names = 0;         // словарь имён полей
+    size_t dictionary_bytes = 0;
+};
+
 //коллекция документов, использует хэш табл для хранения
+// документы, словарь имён и индексы хранятся в двух копиях (left-right): читатели работают с активной
+// без блокировок, писатель меняет вторую, делает её активной, дожидается ухода читателей прежней
+// и повторяет изменение на ней; буферы компактных документов у копий общие
 class Collection {
 private:
+    // одна из двух копий; между изменениями обе одинаковы
+    struct CollectionState {
+        HashMap<std::string, DocumentWrapper> data;  // хранилище доков (id, doc), доки в компактном виде
+        FieldDictionary field_names;           // имена полей всех доков, пополняется при записи
+        HashMap<std::string, Index*> indexes;  // поле -> вторичный индекс
+    };
+
+    // копия, с которой работает операция чтения, закрепляется на её время в потоке:
+    // планировщик и вложенные вызовы (getIndex, size) видят ту же копию, даже если писатель уже сменил активную
+    class ViewPin {
+    private:
+        const Collection* collection;
+        const CollectionState* pinned;
+        const ViewPin* outer;
+        static thread_local const ViewPin* innermost;
+        friend class Collection;
+
+    public:
+        explicit ViewPin(const Collection& source);
+        ~ViewPin();
+        ViewPin(const ViewPin&) = delete;
+        ViewPin& operator=(const ViewPin&) = delete;
+        const CollectionState& state() const;
+    };
+
     std::string name;                    
-    HashMap<std::string, DocumentWrapper> data;  // хранилище доков (id, doc)
-    std::string storage_path;            // путь для сохранения на диск
+    mutable CollectionState states[2];
+    std::atomic<int> active{0};                   // копия для новых читателей
+    mutable std::atomic<size_t> readers[2] = {};  // читатели на каждой копии
+    mutable std::atomic<bool> draining{false};    // писатель ждёт ухода читателей
+    mutable std::mutex drain_mutex;
+    mutable std::condition_variable drained;
+    mutable std::mutex write_mutex;               // изменения по одному
+    std::string storage_path;            // путь к бинарному снимку
+    std::string json_path;               // старый формат снимка, читается если бинарного нет
+    WriteAheadLog wal;                   // журнал изменений поверх последнего снимка
+    SnapshotReader snapshot;             // отображённый в память снимок
+    // ещё не прочитанные из снимка доки, общие для копий; пусты, как только появился первый читатель (readLock)
+    mutable HashMap<std::string, SnapshotEntry> pending;
+    mutable std::atomic<bool> snapshot_materialized{false};
+    CheckpointPolicy policy;
+    // читаются проверкой контрольной точки без блокировки коллекции
+    std::atomic<std::time_t> last_checkpoint_time{0};
+    std::atomic<bool> snapshot_exists{false};
+    // одна контрольная точка за раз; снимок пишется без блокировки коллекции
+    std::mutex checkpoint_mutex;
+    // файл индексов пишут и контрольная точка, и createIndex/dropIndex; поколение меняется с набором индексов
+    std::mutex index_file_mutex;
+    std::atomic<uint64_t> index_generation{0};
+    // загрузка не удалась или документ снимка не декодируется: контрольные точки запрещены, чтобы не затереть файлы
+    mutable std::atomic<bool> load_failed{false};
+    std::string index_path;              // индексы хранятся рядом со снимком
+    bool index_rebuild_needed = false;
+    ScanOptions scan_options;
+    DurabilityOptions durability;
+
+    // копия для чтения: закреплённая операцией этого потока, затем копия его отметки чтения, иначе активная
+    const CollectionState& view() const;
+    // копия, которую меняет писатель
+    CollectionState& standby();
+    // standby становится активной; когда читатели прежней активной ушли, на ней повторяется repeat(прежняя, новая)
+    void publish(const std::function<void(CollectionState&, const CollectionState&)>& repeat);
+    void waitForReaders(int side) const;
+    void releaseReader(int side) const;
+    // документы ids на target - как на source: буферы общие, индексы target правятся
+    void mirrorDocuments(CollectionState& target, const CollectionState& source, const Vector<std::string>& ids);
+    // target - полная копия source (после загрузки)
+    void copyState(CollectionState& target, const CollectionState& source);
+    void clearState(CollectionState& state);
+
+    // подтверждение записи в журнал по режиму durability (если его не ждёт вызывающий)
+    bool commitLog();
+    void applyLogRecord(CollectionState& state, const WalRecord& record);
+    DocumentMemory measureDocuments(const CollectionState& state) const;
+    void storeDocument(CollectionState& state, const std::string& id, const DocumentWrapper& document);
+    bool eraseDocument(CollectionState& state, const std::string& id);
+    // перенос документов из снимка в обе копии при первом обращении; без читателей (однопоточно или под write_mutex)
+    bool materialize(const std::string& id) const;
+    void materializeAll() const;
+    // на сколько частей делить полный обход, 1 - обход в одном потоке
+    size_t scanParts(const CollectionState& state) const;
+    // совпадения в порядке options.sort (после skip, с проекцией); false - ошибка временных файлов сортировки
+    bool executeSorted(QueryPlan& plan, const FindOptions& options,
+                       const std::function<void(const DocumentWrapper&)>& output) const;
+    // документ прямо в хранилище, без копии
+    const DocumentWrapper* findPointer(const CollectionState& state, const std::string& id) const;
+    // все документы без копий; указатели действительны до следующего изменения
+    Vector<const DocumentWrapper*> allDocuments(const CollectionState& state) const;
+
+    friend class Cursor;
+    bool loadJsonSnapshot(CollectionState& state);
+    // контрольная точка под checkpoint_mutex
+    bool checkpoint();
+    // снимок из view и индексы, снятые вместе с ним, если набор индексов с тех пор не менялся
+    bool writeSnapshot(const Vector<const DocumentWrapper*>& view, Document index_data, uint64_t generation);
+    void indexDocument(CollectionState& state, const std::string& id, const DocumentWrapper& document);
+    void unindexDocument(CollectionState& state, const std::string& id, const DocumentWrapper& document);
+    Document snapshotIdentity() const;
+    // содержимое индексов для файла; null - индексов нет
+    Document indexData(const CollectionState& state) const;
+    // index_data с отметкой текущего снимка, под index_file_mutex
+    bool writeIndexFile(Document index_data) const;
+    bool saveIndexes();
+    void loadIndexes(CollectionState& state);
+    void rebuildIndexes(CollectionState& state);
 
 public:
-    Collection(): name(), data(), storage_path() {};
+    // отметка читателя на активной копии: не ждёт писателей и не мешает другим читателям,
+    // писатель перед повтором изменения на этой копии ждёт её снятия; можно снять из другого потока
+    class ReadGuard {
+    private:
+        const Collection* collection = nullptr;
+        int side = 0;
+
+    public:
+        ReadGuard() = default;
+        ReadGuard(const Collection* source, int reader_side);
+        ReadGuard(ReadGuard&& other) noexcept;
+        ReadGuard& operator=(ReadGuard&& other) noexcept;
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+        ~ReadGuard();
+        void unlock();
+    };
+    typedef std::unique_lock<std::mutex> WriteGuard;
+
+    Collection(): name(), storage_path(), json_path(), wal("") {};
     Collection(const std::string& collection_name, const std::string& db_path);
+    ~Collection();
+
+    // для нескольких потоков: чтения (find, count, курсоры, aggregate) под readLock,
+    // изменения под writeLock, пока отметка или блокировка жива
+    // чтения не ждут писателей; писатель, держащий writeLock, ждёт ухода читателей, начатых до его изменения
+    // (долгий курсор задерживает следующее изменение, но не другие чтения)
+    // все чтения потока под отметкой видят одну копию; отметку отпускает тот поток, что её взял
+    // первый readLock переносит в память весь снимок: после этого чтения ничего не меняют в коллекции
+    ReadGuard readLock() const;
+    WriteGuard writeLock();
     
     bool insert(const DocumentWrapper& document);
     bool insert(const std::string& json_str);
     bool insert(const Document& json_doc);
+    // вставка пачки: id генерируются разом, в журнал пишется одна запись на всю пачку
+    size_t insertMany(const Vector<DocumentWrapper>& documents);
+    // потоковый импорт NDJSON (один документ на строку), пачки по batch_size документов,
+    // после каждой - контрольная точка по политике (вызывается без блокировки коллекции)
+    size_t importNdjson(std::istream& input, size_t batch_size = 1000);
+    // разбор NDJSON пачками по batch_size документов, пачка уходит в insert_batch; возвращает сумму его ответов
+    static size_t readNdjson(std::istream& input, size_t batch_size,
+                             const std::function<size_t(const Vector<DocumentWrapper>&)>& insert_batch);
     bool findById(const std::string& id, DocumentWrapper& result) const;
     //для парсера
     Vector<DocumentWrapper> find(const std::string& query_json) const;
     Vector<DocumentWrapper> find(const ParsedQuery& query) const;
+    // skip/limit останавливают обход после skip+limit совпадений, в результат копируются только поля проекции
+    Vector<DocumentWrapper> find(const ParsedQuery& query, const FindOptions& options) const;
+    // сортировка с потоковой выдачей: с limit - куча на skip+limit указателей,
+    // без limit - внешняя сортировка, в памяти не больше options.sort_memory байт копий
+    bool findSorted(const ParsedQuery& query, const FindOptions& options,
+                    const std::function<void(const DocumentWrapper&)>& output) const;
+    // потоковый результат: документы читаются из хранилища по одному, без копирования
+    // курсор действителен, пока держится readLock (без него - пока коллекция не меняется)
+    Cursor findCursor(const std::string& query_json, size_t batch_size = Cursor::DEFAULT_BATCH_SIZE) const;
+    Cursor findCursor(const ParsedQuery& query, size_t batch_size = Cursor::DEFAULT_BATCH_SIZE) const;
+    Cursor findCursor(const ParsedQuery& query, const FindOptions& options, size_t batch_size = Cursor::DEFAULT_BATCH_SIZE) const;
+    // выполняет план от QueryPlanner, заполняя в нём фактические числа и время этапов
+    Vector<DocumentWrapper> execute(QueryPlan& plan) const;
+    Vector<DocumentWrapper> execute(QueryPlan& plan, const FindOptions& options) const;
+    QueryPlan explain(const std::string& query_json) const;
+    size_t count(const std::string& query_json) const;
+    size_t count(const ParsedQuery& query) const;
+    // проверяет predicate на каждом документе без копирования, совпавшие копирует в results (если не nullptr)
+    // большие коллекции обходятся параллельно по диапазонам корзин хэш-таблицы
+    size_t scan(const std::function<bool(const DocumentWrapper&)>& predicate, Vector<DocumentWrapper>* results) const;
+    // то же, но в results попадают копии с полями проекции из options (skip/limit не применяются)
+    size_t scan(const std::function<bool(const DocumentWrapper&)>& predicate, Vector<DocumentWrapper>* results,
+                const FindOptions& options) const;
+    void setScanOptions(const ScanOptions& options);
+    // конвейер $match/$group/$count за один проход: документы не копируются,
+    // у каждого потока обхода своя таблица групп, таблицы сливаются в конце
+    // ошибка в конвейере - пустой результат и сообщение в std::cerr
+    Vector<DocumentWrapper> aggregate(const std::string& pipeline_json) const;
+    Vector<DocumentWrapper> aggregate(const AggregationPipeline& pipeline) const;
+    // только группировка: документы по $match конвейера добавляются в groups, без итоговых стадий
+    void aggregateInto(const AggregationPipeline& pipeline, GroupTable& groups) const;
     
     size_t remove(const std::string& query_json);
     size_t remove(const ParsedQuery& query);
+    // удаление пачки: индексы правятся по документам на месте, в журнал - одна запись на всю пачку
+    size_t removeMany(const Vector<std::string>& ids);
+
+    // индекс по полю, используется find/remove: хэш - для $eq и $in,
+    // упорядоченный - ещё и для $gt/$gte/$lt/$lte, результат тогда отсортирован по полю
+    bool createIndex(const std::string& field, IndexType type = IndexType::Hash);
+    bool dropIndex(const std::string& field);
+    bool hasIndex(const std::string& field) const;
+    const Index* getIndex(const std::string& field) const;
+    Vector<std::string> getIndexedFields() const;
 
     Vector<DocumentWrapper> findAll() const; 
     Vector<std::string> getAllIds() const;
     
     bool removeById(const std::string& id);
-    bool saveToFile() const;
+    // контрольная точка: под блокировкой записи только снимает ссылки на документы и откладывает журнал,
+    // снимок пишется во временный файл, проходит fsync и подменяет старый уже без неё
+    // блокировку коллекции берёт сама, вызывающий не должен её держать
+    bool saveToFile();
+    // контрольная точка по политике (размер или возраст журнала); вызывается после изменений,
+    // когда блокировка коллекции снята; если контрольная точка уже идёт в другом потоке - ничего не делает
+    bool maybeCheckpoint();
+    bool checkpointNeeded() const;
+    void setCheckpointPolicy(const CheckpointPolicy& new_policy);
+    // режим подтверждения изменений: insert/remove возвращаются после fsync журнала по этому режиму
+    void setDurability(const DurabilityOptions& options);
+    DurabilityOptions getDurability() const;
+    // при caller_waits: позиция журнала после изменения и ожидание её fsync в нужном режиме
+    uint64_t logPosition() const;
+    bool waitDurable(uint64_t position, Durability mode);
+    LogSyncStats logSyncStats() const;
+    // есть изменения, которых нет в снимке
+    bool isDirty() const;
+    // читает снимок и применяет поверх него журнал
     bool loadFromFile();
+    // выгрузка коллекции в JSON (id -> документ)
+    bool exportToJson(std::ostream& out) const;
+    // документы, таблицы и память индексов; сама берёт блокировку чтения
+    void printStats(std::ostream& out) const;
+    // память документов в памяти (не в снимке) и словаря имён; сама берёт блокировку чтения
+    DocumentMemory documentMemory() const;
     size_t size() const;
     std::string getName() const;
     std::string getStoragePath() const;
+    std::string getLogPath() const;
+    std::string getJsonPath() const;
+    std::string getIndexPath() const;
 };
 
 #endif
\ No newline at end of file
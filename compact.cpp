@@ -0,0 +1,438 @@
+#include "compact.h"
+#include <limits>
+
+namespace {
+
+const size_t COUNT_SIZE = 4;
+const size_t REFERENCES_SIZE = 4;   // счётчик ссылок перед буфером документа
+
+template<typename N>
+N readAt(const char* at) {
+    N value;
+    std::memcpy(&value, at, sizeof(N));
+    return value;
+}
+
+template<typename N>
+void writeAt(std::string& out, size_t position, N value) {
+    std::memcpy(&out[position], &value, sizeof(N));
+}
+
+template<typename N>
+void append(std::string& out, N value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(N));
+}
+
+uint32_t slotTag(const char* block, uint32_t index) {
+    return readAt<uint32_t>(block + COUNT_SIZE + index * CompactDocument::SLOT_SIZE);
+}
+
+uint32_t slotPayload(const char* block, uint32_t index) {
+    return readAt<uint32_t>(block + COUNT_SIZE + index * CompactDocument::SLOT_SIZE + 4);
+}
+
+// блок malloc под n байт: 8 байт заголовка, выравнивание 16, не меньше 32
+size_t mallocChunk(size_t n) {
+    size_t chunk = (n + 8 + 15) & ~static_cast<size_t>(15);
+    return chunk < 32 ? 32 : chunk;
+}
+
+// std::string держит до 15 символов в себе, длиннее - отдельным блоком
+size_t stringHeap(size_t length) {
+    return length > 15 ? mallocChunk(length + 1) : 0;
+}
+
+// узел std::map<std::string, json>: заголовок красно-чёрного дерева, ключ и значение
+const size_t MAP_NODE = mallocChunk(32 + sizeof(std::string) + sizeof(Document));
+const size_t MAP_OBJECT = mallocChunk(sizeof(Document::object_t));
+const size_t ARRAY_OBJECT = mallocChunk(sizeof(Document::array_t));
+const size_t STRING_OBJECT = mallocChunk(sizeof(std::string));
+
+bool encodeBlock(const Document& value, FieldDictionary& dictionary, std::string& out);
+
+// значение в ячейку: мелкие числа прямо в неё, остальное - в конец данных блока со смещением от start
+bool encodeValue(const Document& value, FieldDictionary& dictionary, std::string& out, size_t start,
+                 CompactType& kind, uint32_t& payload) {
+    switch (value.type()) {
+        case Document::value_t::null:
+            kind = CompactType::Null;
+            return true;
+        case Document::value_t::boolean:
+            kind = value.get<bool>() ? CompactType::True : CompactType::False;
+            return true;
+        case Document::value_t::number_integer: {
+            int64_t number = value.get<int64_t>();
+            if (number >= std::numeric_limits<int32_t>::min() && number <= std::numeric_limits<int32_t>::max()) {
+                kind = CompactType::Int32;
+                payload = static_cast<uint32_t>(static_cast<int32_t>(number));
+                return true;
+            }
+            kind = CompactType::Int64;
+            payload = static_cast<uint32_t>(out.size() - start);
+            append(out, number);
+            return true;
+        }
+        case Document::value_t::number_unsigned: {
+            uint64_t number = value.get<uint64_t>();
+            if (number <= std::numeric_limits<uint32_t>::max()) {
+                kind = CompactType::Uint32;
+                payload = static_cast<uint32_t>(number);
+                return true;
+            }
+            kind = CompactType::Uint64;
+            payload = static_cast<uint32_t>(out.size() - start);
+            append(out, number);
+            return true;
+        }
+        case Document::value_t::number_float:
+            kind = CompactType::Double;
+            payload = static_cast<uint32_t>(out.size() - start);
+            append(out, value.get<double>());
+            return true;
+        case Document::value_t::string: {
+            const std::string& text = value.get_ref<const std::string&>();
+            payload = static_cast<uint32_t>(out.size() - start);
+            if (text.size() <= std::numeric_limits<uint8_t>::max()) {
+                kind = CompactType::ShortString;
+                append(out, static_cast<uint8_t>(text.size()));
+            } else {
+                kind = CompactType::String;
+                append(out, static_cast<uint32_t>(text.size()));
+            }
+            out.append(text);
+            return true;
+        }
+        case Document::value_t::object:
+        case Document::value_t::array:
+            kind = value.is_object() ? CompactType::Object : CompactType::Array;
+            payload = static_cast<uint32_t>(out.size() - start);
+            return encodeBlock(value, dictionary, out);
+        default:
+            return false; // binary и discarded остаются в дереве
+    }
+}
+
+bool encodeBlock(const Document& value, FieldDictionary& dictionary, std::string& out) {
+    size_t start = out.size();
+    uint32_t count = static_cast<uint32_t>(value.size());
+    append(out, count);
+    out.resize(out.size() + count * CompactDocument::SLOT_SIZE);
+    size_t slot = start + COUNT_SIZE;
+    for (auto it = value.begin(); it != value.end(); ++it, slot += CompactDocument::SLOT_SIZE) {
+        uint32_t name = 0;
+        if (value.is_object() && !dictionary.intern(it.key(), name)) {
+            return false;
+        }
+        CompactType kind = CompactType::Null;
+        uint32_t payload = 0;
+        if (!encodeValue(it.value(), dictionary, out, start, kind, payload)) {
+            return false;
+        }
+        writeAt(out, slot, (name << 8) | static_cast<uint32_t>(kind));
+        writeAt(out, slot + 4, payload);
+    }
+    return true;
+}
+
+CompactValue valueAt(const char* block, uint32_t index, const FieldDictionary* dictionary) {
+    uint32_t tag = slotTag(block, index);
+    return CompactValue(block, static_cast<CompactType>(tag & 0xFF), slotPayload(block, index), dictionary);
+}
+
+Document blockToDocument(const char* block, bool is_object, const FieldDictionary* dictionary) {
+    uint32_t count = readAt<uint32_t>(block);
+    if (!is_object) {
+        Document result = Document::array();
+        Document::array_t& items = result.get_ref<Document::array_t&>();
+        items.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            items.push_back(valueAt(block, i, dictionary).toDocument());
+        }
+        return result;
+    }
+    Document result = Document::object();
+    Document::object_t& fields = result.get_ref<Document::object_t&>();
+    for (uint32_t i = 0; i < count; ++i) {
+        // поля уже по порядку имён - каждое встаёт в конец дерева без поиска места
+        fields.emplace_hint(fields.end(), dictionary->name(slotTag(block, i) >> 8),
+                            valueAt(block, i, dictionary).toDocument());
+    }
+    return result;
+}
+
+size_t blockTreeBytes(const char* block, bool is_object, const FieldDictionary* dictionary) {
+    uint32_t count = readAt<uint32_t>(block);
+    size_t bytes = 0;
+    if (is_object) {
+        bytes += MAP_OBJECT + count * MAP_NODE;
+    } else if (count > 0) {
+        bytes += ARRAY_OBJECT + mallocChunk(count * sizeof(Document));
+    } else {
+        bytes += ARRAY_OBJECT;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t tag = slotTag(block, i);
+        CompactType kind = static_cast<CompactType>(tag & 0xFF);
+        if (is_object) {
+            bytes += stringHeap(dictionary->name(tag >> 8).size());
+        }
+        if (kind == CompactType::ShortString || kind == CompactType::String) {
+            bytes += STRING_OBJECT + stringHeap(valueAt(block, i, dictionary).text().size());
+        } else if (kind == CompactType::Object || kind == CompactType::Array) {
+            bytes += blockTreeBytes(block + slotPayload(block, i), kind == CompactType::Object, dictionary);
+        }
+    }
+    return bytes;
+}
+
+}
+
+bool FieldDictionary::intern(const std::string& name, uint32_t& id) {
+    const uint32_t* found = ids.find(name);
+    if (found != nullptr) {
+        id = *found;
+        return true;
+    }
+    if (names.size() >= MAX_NAMES) {
+        return false;
+    }
+    id = static_cast<uint32_t>(names.size());
+    names.push_back(name);
+    ids.put(name, id);
+    return true;
+}
+
+bool FieldDictionary::lookup(const std::string& name, uint32_t& id) const {
+    const uint32_t* found = ids.find(name);
+    if (found == nullptr) {
+        return false;
+    }
+    id = *found;
+    return true;
+}
+
+void FieldDictionary::appendFrom(const FieldDictionary& source) {
+    for (size_t i = names.size(); i < source.names.size(); ++i) {
+        uint32_t id = 0;
+        intern(source.names[i], id);
+    }
+}
+
+const std::string& FieldDictionary::name(uint32_t id) const {
+    return names[id];
+}
+
+size_t FieldDictionary::size() const {
+    return names.size();
+}
+
+size_t FieldDictionary::memoryBytes() const {
+    size_t bytes = ids.memoryBytes() + names.size() * sizeof(std::string);
+    for (size_t i = 0; i < names.size(); ++i) {
+        // строка есть и в ключе таблицы, и в списке
+        bytes += 2 * stringHeap(names[i].size());
+    }
+    return bytes;
+}
+
+void FieldDictionary::clear() {
+    ids.clear();
+    names.clear();
+}
+
+Document::value_t CompactValue::type() const {
+    switch (kind) {
+        case CompactType::False:
+        case CompactType::True:
+            return Document::value_t::boolean;
+        case CompactType::Int32:
+        case CompactType::Int64:
+            return Document::value_t::number_integer;
+        case CompactType::Uint32:
+        case CompactType::Uint64:
+            return Document::value_t::number_unsigned;
+        case CompactType::Double:
+            return Document::value_t::number_float;
+        case CompactType::ShortString:
+        case CompactType::String:
+            return Document::value_t::string;
+        case CompactType::Object:
+            return Document::value_t::object;
+        case CompactType::Array:
+            return Document::value_t::array;
+        default:
+            return Document::value_t::null;
+    }
+}
+
+bool CompactValue::is_number() const {
+    return kind >= CompactType::Int32 && kind <= CompactType::Double;
+}
+
+bool CompactValue::is_string() const {
+    return kind == CompactType::ShortString || kind == CompactType::String;
+}
+
+std::string_view CompactValue::text() const {
+    if (kind == CompactType::ShortString) {
+        const char* at = block + payload;
+        return std::string_view(at + 1, static_cast<uint8_t>(*at));
+    }
+    if (kind == CompactType::String) {
+        const char* at = block + payload;
+        return std::string_view(at + 4, readAt<uint32_t>(at));
+    }
+    return std::string_view();
+}
+
+Document CompactValue::toDocument() const {
+    switch (kind) {
+        case CompactType::False:
+            return false;
+        case CompactType::True:
+            return true;
+        case CompactType::Int32:
+        case CompactType::Int64:
+            return get<int64_t>();
+        case CompactType::Uint32:
+        case CompactType::Uint64:
+            return get<uint64_t>();
+        case CompactType::Double:
+            return get<double>();
+        case CompactType::ShortString:
+        case CompactType::String:
+            return std::string(text());
+        case CompactType::Object:
+        case CompactType::Array:
+            return blockToDocument(block + payload, kind == CompactType::Object, dictionary);
+        default:
+            return Document();
+    }
+}
+
+CompactValue::CompactValue(const char* value_block, CompactType value_kind, uint32_t value_payload,
+                           const FieldDictionary* names)
+    : block(value_block), kind(value_kind), payload(value_payload), dictionary(names) {}
+
+bool CompactDocument::encode(const Document& document, FieldDictionary& dictionary, CompactDocument& out) {
+    if (!document.is_object()) {
+        return false;
+    }
+    std::string buffer;
+    append(buffer, static_cast<uint32_t>(0));
+    if (!encodeBlock(document, dictionary, buffer)) {
+        return false;
+    }
+    writeAt(buffer, 0, static_cast<uint32_t>(buffer.size()));
+    out.release();
+    out.bytes = new char[REFERENCES_SIZE + buffer.size()];
+    new (out.bytes) std::atomic<uint32_t>(1);
+    std::memcpy(out.bytes + REFERENCES_SIZE, buffer.data(), buffer.size());
+    out.dictionary = &dictionary;
+    return true;
+}
+
+CompactDocument::~CompactDocument() {
+    release();
+}
+
+CompactDocument::CompactDocument(CompactDocument&& other) noexcept
+    : bytes(other.bytes), dictionary(other.dictionary) {
+    other.bytes = nullptr;
+    other.dictionary = nullptr;
+}
+
+CompactDocument& CompactDocument::operator=(CompactDocument&& other) noexcept {
+    if (this != &other) {
+        release();
+        bytes = other.bytes;
+        dictionary = other.dictionary;
+        other.bytes = nullptr;
+        other.dictionary = nullptr;
+    }
+    return *this;
+}
+
+std::atomic<uint32_t>& CompactDocument::references() const {
+    return *reinterpret_cast<std::atomic<uint32_t>*>(bytes);
+}
+
+void CompactDocument::release() {
+    if (bytes != nullptr && references().fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        references().~atomic();
+        delete[] bytes;
+    }
+    bytes = nullptr;
+}
+
+CompactDocument CompactDocument::share(const FieldDictionary& names) const {
+    CompactDocument result;
+    if (bytes != nullptr) {
+        references().fetch_add(1, std::memory_order_relaxed);
+        result.bytes = bytes;
+        result.dictionary = &names;
+    }
+    return result;
+}
+
+bool CompactDocument::empty() const {
+    return bytes == nullptr;
+}
+
+bool CompactDocument::find(const std::string& field, CompactValue& value) const {
+    uint32_t id = 0;
+    if (bytes == nullptr || !dictionary->lookup(field, id)) {
+        return false;
+    }
+    const char* block = bytes + REFERENCES_SIZE + 4;
+    uint32_t count = readAt<uint32_t>(block);
+    for (uint32_t i = 0; i < count; ++i) {
+        if ((slotTag(block, i) >> 8) == id) {
+            value = valueAt(block, i, dictionary);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CompactDocument::contains(const std::string& field) const {
+    CompactValue value;
+    return find(field, value);
+}
+
+Document CompactDocument::toDocument() const {
+    if (bytes == nullptr) {
+        return Document::object();
+    }
+    return blockToDocument(bytes + REFERENCES_SIZE + 4, true, dictionary);
+}
+
+size_t CompactDocument::heapBytes() const {
+    return bytes == nullptr ? 0 : mallocChunk(REFERENCES_SIZE + readAt<uint32_t>(bytes + REFERENCES_SIZE));
+}
+
+size_t CompactDocument::treeHeapBytes() const {
+    return bytes == nullptr ? 0 : blockTreeBytes(bytes + REFERENCES_SIZE + 4, true, dictionary);
+}
+
+size_t treeHeapBytes(const Document& value) {
+    size_t bytes = 0;
+    switch (value.type()) {
+        case Document::value_t::string:
+            return STRING_OBJECT + stringHeap(value.get_ref<const std::string&>().size());
+        case Document::value_t::object:
+            bytes = MAP_OBJECT + value.size() * MAP_NODE;
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                bytes += stringHeap(it.key().size()) + treeHeapBytes(it.value());
+            }
+            return bytes;
+        case Document::value_t::array:
+            bytes = ARRAY_OBJECT + (value.empty() ? 0 : mallocChunk(value.size() * sizeof(Document)));
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                bytes += treeHeapBytes(*it);
+            }
+            return bytes;
+        default:
+            return 0;
+    }
+}
\ No newline at end of file
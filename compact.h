@@ -0,0 +1,150 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include "hash_map.h"
+#include "vector.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+
+using Document = nlohmann::json;
+
+// имена полей коллекции: каждое хранится один раз, документы ссылаются на его номер
+// пополняется только при изменении коллекции (под её блокировкой записи), читается без блокировок
+class FieldDictionary {
+private:
+    HashMap<std::string, uint32_t> ids;
+    Vector<std::string> names;
+
+public:
+    // предел словаря: ключи-данные во вложенных объектах ({"scores": {"<user>": 1}}) иначе растят его без конца;
+    // документ с новым именем сверх предела хранится деревом (номер поместился бы и в 24 бита ячейки)
+    static const uint32_t MAX_NAMES = 1u << 16;
+
+    // номер имени, новое имя добавляется; false - словарь заполнен, имени в нём нет
+    bool intern(const std::string& name, uint32_t& id);
+    // false - имени нет ни в одном документе коллекции
+    bool lookup(const std::string& name, uint32_t& id) const;
+    // дописывает имена source, которых здесь ещё нет; номера совпадают, если словари пополнялись в одном порядке
+    // (для пустого словаря - полная копия)
+    void appendFrom(const FieldDictionary& source);
+    const std::string& name(uint32_t id) const;
+    size_t size() const;
+    size_t memoryBytes() const;
+    void clear();
+};
+
+enum class CompactType : uint8_t {
+    Null,
+    False,
+    True,
+    Int32,        // число прямо в ячейке
+    Uint32,
+    Int64,        // 8 байт в области данных блока
+    Uint64,
+    Double,
+    ShortString,  // [length:1][байты] в области данных
+    String,       // [length:4][байты]
+    Object,       // вложенный блок
+    Array
+};
+
+// значение поля компактного документа, читается на месте без разворачивания в Document
+// проверки типа и чтение чисел названы как у nlohmann::json: сравнения пишутся одним шаблоном для обоих видов
+class CompactValue {
+private:
+    const char* block = nullptr;   // блок, которому принадлежит значение
+    CompactType kind = CompactType::Null;
+    uint32_t payload = 0;          // число или смещение данных от начала блока
+    const FieldDictionary* dictionary = nullptr;
+
+    template<typename N>
+    N read() const {
+        N value;
+        std::memcpy(&value, block + payload, sizeof(N));
+        return value;
+    }
+
+public:
+    CompactValue() = default;
+    CompactValue(const char* value_block, CompactType value_kind, uint32_t value_payload,
+                 const FieldDictionary* names);
+
+    Document::value_t type() const;
+    bool is_number() const;
+    bool is_string() const;
+    // только числа: int64_t, uint64_t или double, с приведением как у nlohmann::json
+    template<typename T>
+    T get() const;
+    // строка прямо из буфера документа; пустая, если значение не строка
+    std::string_view text() const;
+    Document toDocument() const;
+};
+
+// документ одним блоком памяти: [счётчик ссылок:4][size:4][корневой блок]
+// блок объекта или массива: [count:4][ячейки по 8 байт][данные]
+// ячейка: [номер имени << 8 | тип : 4][число или смещение данных : 4], поля в порядке имён, как в nlohmann::json
+// строки лежат в самом буфере, вложенные объекты и массивы - блоками в области данных родителя
+// буфер не меняется после кодирования, поэтому его могут делить несколько владельцев (share)
+class CompactDocument {
+private:
+    char* bytes = nullptr;
+    const FieldDictionary* dictionary = nullptr;
+
+    std::atomic<uint32_t>& references() const;
+    void release();
+
+public:
+    static const size_t SLOT_SIZE = 8;
+
+    CompactDocument() = default;
+    ~CompactDocument();
+    CompactDocument(CompactDocument&& other) noexcept;
+    CompactDocument& operator=(CompactDocument&& other) noexcept;
+    CompactDocument(const CompactDocument&) = delete;
+    CompactDocument& operator=(const CompactDocument&) = delete;
+
+    // тот же буфер без копирования, имена из names - словаря с теми же номерами
+    // (копии словаря коллекции или словаря, пополняемого в том же порядке)
+    CompactDocument share(const FieldDictionary& names) const;
+
+    // false - значение не объект, содержит binary или новое имя при полном словаре: такой документ остаётся деревом
+    static bool encode(const Document& document, FieldDictionary& dictionary, CompactDocument& out);
+
+    bool empty() const;
+    // поле верхнего уровня; false - поля нет
+    bool find(const std::string& field, CompactValue& value) const;
+    bool contains(const std::string& field) const;
+    Document toDocument() const;
+    // занято в куче самим буфером
+    size_t heapBytes() const;
+    // сколько занимал бы в куче тот же документ деревом nlohmann::json
+    size_t treeHeapBytes() const;
+};
+
+// оценка кучи дерева nlohmann::json по устройству libstdc++ (std::map, std::string, std::vector) и блоков malloc
+size_t treeHeapBytes(const Document& value);
+
+template<typename T>
+T CompactValue::get() const {
+    switch (kind) {
+        case CompactType::Int32:
+            return static_cast<T>(static_cast<int32_t>(payload));
+        case CompactType::Uint32:
+            return static_cast<T>(payload);
+        case CompactType::Int64:
+            return static_cast<T>(read<int64_t>());
+        case CompactType::Uint64:
+            return static_cast<T>(read<uint64_t>());
+        case CompactType::Double:
+            return static_cast<T>(read<double>());
+        default:
+            return T();
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "cursor.h"
+#include "collection.h"
+
+Cursor::Cursor(const Collection& source, QueryPlan query_plan, size_t batch, const FindOptions& options)
+    : collection(&source), documents(&source.view().data), plan(std::move(query_plan)), scan_position(documents),
+      candidate_position(0), current_doc(nullptr), batch_size(batch == 0 ? 1 : batch),
+      returned(0), skip(options.skip), limit(options.limit) {
+    if (plan.source == PlanSource::FullScan) {
+        // при обходе снимок читается целиком заранее, иначе таблица перестроится под итератором
+        collection->materializeAll();
+        scan_position = documents->iterate();
+        plan.candidates = collection->size();
+    } else {
+        plan.collectCandidates(candidates);
+        plan.candidates = candidates.size();
+        // кандидаты читаются из снимка сразу: догрузка позже могла бы перестроить таблицу
+        // и сдвинуть уже отданные указатели
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            collection->materialize(candidates[i]);
+        }
+    }
+}
+
+bool Cursor::next() {
+    current_doc = nullptr;
+    if (limit != 0 && returned >= limit) {
+        // дальше не читаем: остаток коллекции не проверяется
+        return false;
+    }
+    if (skip > 0) {
+        size_t skipped = 0;
+        while (skipped < skip && advance()) {
+            skipped++;
+        }
+        skip = 0;
+    }
+    if (!advance()) {
+        return false;
+    }
+    returned++;
+    plan.returned = returned;
+    return true;
+}
+
+bool Cursor::advance() {
+    current_doc = nullptr;
+    if (plan.source == PlanSource::FullScan) {
+        while (scan_position.valid()) {
+            const DocumentWrapper& doc = scan_position.value();
+            scan_position.next();
+            plan.examined++;
+            if (plan.accepts(doc)) {
+                current_doc = &doc;
+                break;
+            }
+        }
+    } else {
+        while (candidate_position < candidates.size()) {
+            const DocumentWrapper* doc = documents->find(candidates[candidate_position++]);
+            if (doc == nullptr) {
+                continue;
+            }
+            plan.examined++;
+            if (plan.accepts(*doc)) {
+                current_doc = doc;
+                break;
+            }
+        }
+    }
+    return current_doc != nullptr;
+}
+
+const DocumentWrapper& Cursor::current() const {
+    return *current_doc;
+}
+
+size_t Cursor::nextBatch(Vector<const DocumentWrapper*>& batch) {
+    batch.clear();
+    while (batch.size() < batch_size && next()) {
+        batch.push_back(current_doc);
+    }
+    return batch.size();
+}
+
+void Cursor::setBatchSize(size_t batch) {
+    batch_size = batch == 0 ? 1 : batch;
+}
+
+size_t Cursor::batchSize() const {
+    return batch_size;
+}
+
+size_t Cursor::count() const {
+    return returned;
+}
+
+const QueryPlan& Cursor::getPlan() const {
+    return plan;
+}
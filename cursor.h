@@ -0,0 +1,51 @@
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include "document.h"
+#include "hash_map.h"
+#include "planner.h"
+#include "vector.h"
+#include <string>
+
+class Collection;
+
+// потоковый результат запроса: документы отдаются ссылками прямо из хранилища коллекции
+// действителен, пока держится readLock коллекции (без него - пока коллекция не меняется)
+class Cursor {
+private:
+    const Collection* collection;
+    const HashMap<std::string, DocumentWrapper>* documents;  // копия коллекции, видимая при создании
+    QueryPlan plan;
+    HashMap<std::string, DocumentWrapper>::ConstIterator scan_position;  // для полного обхода
+    Vector<std::string> candidates;      // id из индексов
+    size_t candidate_position;
+    const DocumentWrapper* current_doc;
+    size_t batch_size;
+    size_t returned;
+    size_t skip;                         // совпадений пропустить до первого отданного
+    size_t limit;                        // 0 - без ограничения
+
+    // следующее совпадение без учёта skip/limit
+    bool advance();
+
+public:
+    static const size_t DEFAULT_BATCH_SIZE = 100;
+
+    // skip/limit берутся из options; проекцию курсор не делает - документы отдаются как есть
+    Cursor(const Collection& source, QueryPlan query_plan, size_t batch = DEFAULT_BATCH_SIZE,
+           const FindOptions& options = FindOptions());
+
+    // переход к следующему подходящему документу, false - документы закончились или достигнут limit
+    bool next();
+    const DocumentWrapper& current() const;
+
+    // до batch_size следующих документов; указатели действительны до следующего вызова
+    size_t nextBatch(Vector<const DocumentWrapper*>& batch);
+
+    void setBatchSize(size_t batch);
+    size_t batchSize() const;
+    size_t count() const;               // сколько документов уже отдано
+    const QueryPlan& getPlan() const;
+};
+
+#endif
@@ -2,12 +2,42 @@
 #include <iostream>
 #include <fstream>
 #include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+// имена коллекций в directory, у которых журнал <имя>.log или отложенный <имя>.log.<n> не пуст:
+// эти записи ещё не попали в снимок
+void collectionsWithLog(const std::string& directory, HashMap<std::string, bool>& names) {
+    std::error_code error;
+    std::filesystem::directory_iterator it(directory, error);
+    for (; !error && it != std::filesystem::directory_iterator(); it.increment(error)) {
+        std::filesystem::path file = it->path().filename();
+        std::string extension = file.extension().string();
+        if (extension.size() > 1 && extension.find_first_not_of("0123456789", 1) == std::string::npos) {
+            file = file.stem();
+            extension = file.extension().string();
+        }
+        if (extension != ".log") {
+            continue;
+        }
+        std::error_code size_error;
+        uintmax_t bytes = std::filesystem::file_size(it->path(), size_error);
+        if (!size_error && bytes > 0) {
+            names.put(file.stem().string(), true);
+        }
+    }
+}
+
+}
 
 Database::Database(const std::string& db_name, const std::string& base_path) 
     : name(db_name), storage_path(base_path + "/" + db_name) {
     
     ensureStorageDirectory();
-    loadExistingCollections();
+    listExistingCollections();
     
     std::cout << "Database '" << name << "' initialized at: " << storage_path << std::endl;
 }
@@ -20,33 +50,65 @@ Database::~Database() {
             delete collection;
         }
     }
+    Vector<std::string> sharded_keys = sharded_collections.keys();
+    for (size_t i = 0; i < sharded_keys.size(); ++i) {
+        ShardedCollection* collection = nullptr;
+        if (sharded_collections.get(sharded_keys[i], collection)) {
+            delete collection;
+        }
+    }
     std::cout << "Database '" << name << "' destroyed." << std::endl;
 }
 
 // создание директории если не существует
 void Database::ensureStorageDirectory() const {
-    system(("mkdir -p " + storage_path).c_str());
+    std::error_code error;
+    std::filesystem::create_directories(storage_path, error);
+    if (error) {
+        std::cerr << "Cannot create storage directory " << storage_path << ": " << error.message() << std::endl;
+    }
 }
 
-// загрузка существующих коллекций
-void Database::loadExistingCollections() {
-    std::string command = "find " + storage_path + " -name \"*.json\" 2>/dev/null";
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) return;
-    
-    char buffer[256];
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        std::string file_path(buffer);
-        file_path.erase(file_path.find_last_not_of(" \n\r\t") + 1);
-        size_t last_slash = file_path.find_last_of('/');
-        size_t last_dot = file_path.find_last_of('.');
-        if (last_slash == std::string::npos || last_dot == std::string::npos) continue;
-        std::string collection_name = file_path.substr(last_slash + 1, last_dot - last_slash - 1);
-        Collection* collection = new Collection(collection_name, storage_path);
-        collections.put(collection_name, collection);
-        std::cout << "Loaded collection: " << collection_name << std::endl;
+// только имена коллекций: данные читаются при первом getCollection
+void Database::listExistingCollections() {
+    std::error_code error;
+    std::filesystem::directory_iterator it(storage_path, error);
+    if (error) {
+        return;
     }
-    pclose(pipe);
+    for (; it != std::filesystem::directory_iterator(); it.increment(error)) {
+        if (error) {
+            break;
+        }
+        std::string extension = it->path().extension().string();
+        // каталог частей секционированной коллекции
+        if (extension == ".shards" && it->is_directory()) {
+            sharded_collections.put(it->path().stem().string(), nullptr);
+            continue;
+        }
+        // коллекция может существовать только в виде журнала, без снимка,
+        // или отложенного журнала <имя>.log.<n> после сбоя во время контрольной точки
+        std::string collection_name = it->path().stem().string();
+        if (extension.size() > 1 && extension.find_first_not_of("0123456789", 1) == std::string::npos &&
+            std::filesystem::path(collection_name).extension() == ".log") {
+            extension = ".log";
+            collection_name = std::filesystem::path(collection_name).stem().string();
+        }
+        if (extension != ".snap" && extension != ".json" && extension != ".log") {
+            continue;
+        }
+        if (!collectionExists(collection_name)) {
+            collections.put(collection_name, nullptr);
+        }
+    }
+}
+
+Collection* Database::openCollection(const std::string& collection_name) {
+    Collection* collection = new Collection(collection_name, storage_path);
+    collection->setScanOptions(scan_options);
+    collection->setDurability(durability);
+    collections.put(collection_name, collection);
+    return collection;
 }
 
 bool Database::createCollection(const std::string& collection_name) {
@@ -54,39 +116,104 @@ bool Database::createCollection(const std::string& collection_name) {
         std::cerr << "Collection '" << collection_name << "' already exists." << std::endl;
         return false;
     }
-    Collection* new_collection = new Collection(collection_name, storage_path);
-    collections.put(collection_name, new_collection);
+    openCollection(collection_name);
     std::cout << "Collection '" << collection_name << "' created successfully." << std::endl;
     return true;
 }
 
 Collection& Database::getCollection(const std::string& collection_name) {
+    if (isSharded(collection_name)) {
+        throw std::runtime_error("collection '" + collection_name + "' is sharded");
+    }
     Collection* collection = nullptr;
     
-    if (collections.get(collection_name, collection)) {
+    if (collections.get(collection_name, collection) && collection != nullptr) {
         return *collection; 
     }
-    
-    collection = new Collection(collection_name, storage_path);
-    collections.put(collection_name, collection);
-    return *collection;  
+    // коллекция с диска или новая
+    return *openCollection(collection_name);
+}
+
+bool Database::createShardedCollection(const std::string& collection_name, size_t shard_count) {
+    if (collectionExists(collection_name)) {
+        std::cerr << "Collection '" << collection_name << "' already exists." << std::endl;
+        return false;
+    }
+    if (shard_count == 0) {
+        std::cerr << "Sharded collection needs at least one shard." << std::endl;
+        return false;
+    }
+    ShardedCollection* collection = new ShardedCollection(collection_name, storage_path, shard_count);
+    collection->setScanOptions(scan_options);
+    collection->setDurability(durability);
+    sharded_collections.put(collection_name, collection);
+    std::cout << "Sharded collection '" << collection_name << "' created with " << shard_count << " shards." << std::endl;
+    return true;
+}
+
+bool Database::isSharded(const std::string& collection_name) const {
+    ShardedCollection* temp = nullptr;
+    return sharded_collections.get(collection_name, temp);
+}
+
+ShardedCollection& Database::getShardedCollection(const std::string& collection_name) {
+    ShardedCollection* collection = nullptr;
+    if (!sharded_collections.get(collection_name, collection)) {
+        throw std::runtime_error("collection '" + collection_name + "' is not sharded");
+    }
+    if (collection == nullptr) {
+        collection = new ShardedCollection(collection_name, storage_path);
+        collection->setScanOptions(scan_options);
+        collection->setDurability(durability);
+        sharded_collections.put(collection_name, collection);
+    }
+    return *collection;
 }
 
 // Проверка существования коллекции
 bool Database::collectionExists(const std::string& collection_name) const {
     Collection* temp = nullptr;
-    return collections.get(collection_name, temp);
+    return collections.get(collection_name, temp) || isSharded(collection_name);
 }
 
 bool Database::dropCollection(const std::string& collection_name) {
+    ShardedCollection* sharded = nullptr;
+    if (sharded_collections.get(collection_name, sharded)) {
+        std::string directory = ShardedCollection::directoryFor(collection_name, storage_path);
+        delete sharded;
+        sharded_collections.remove(collection_name);
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+        if (error) {
+            std::cerr << "Failed to delete shard directory " << directory << ": " << error.message() << std::endl;
+            return false;
+        }
+        std::cout << "Collection '" << collection_name << "' dropped successfully." << std::endl;
+        return true;
+    }
     Collection* collection = nullptr;
     if (!collections.get(collection_name, collection)) {
         std::cerr << "Collection '" << collection_name << "' does not exist." << std::endl;
         return false;
     }
     
-    std::string file_path = storage_path + "/" + collection_name + ".json";
-    if (remove(file_path.c_str()) == 0) {
+    // файлы незагруженной коллекции удаляются без чтения данных
+    std::string base = storage_path + "/" + collection_name;
+    std::string file_path = collection != nullptr ? collection->getStoragePath() : base + ".snap";
+    std::string log_path = collection != nullptr ? collection->getLogPath() : base + ".log";
+    std::string json_path = collection != nullptr ? collection->getJsonPath() : base + ".json";
+    std::string index_path = collection != nullptr ? collection->getIndexPath() : base + ".idx";
+    bool snapshot_removed = remove(file_path.c_str()) == 0;
+    bool log_removed = remove(log_path.c_str()) == 0;
+    Vector<std::string> rotated_logs = WriteAheadLog::rotatedFiles(log_path);
+    for (size_t i = 0; i < rotated_logs.size(); ++i) {
+        if (remove(rotated_logs[i].c_str()) == 0) {
+            log_removed = true;
+        }
+    }
+    bool json_removed = remove(json_path.c_str()) == 0;
+    remove(index_path.c_str());
+    if (snapshot_removed || log_removed || json_removed) {
         // сначала удаляем из памяти, потом из HashMap
         delete collection;
         collections.remove(collection_name);
@@ -98,6 +225,46 @@ bool Database::dropCollection(const std::string& collection_name) {
     }
 }
 
+void Database::setScanOptions(const ScanOptions& options) {
+    scan_options = options;
+    Vector<std::string> names = collections.keys();
+    for (size_t i = 0; i < names.size(); ++i) {
+        Collection* collection = nullptr;
+        if (collections.get(names[i], collection) && collection != nullptr) {
+            collection->setScanOptions(options);
+        }
+    }
+    Vector<std::string> sharded_names = sharded_collections.keys();
+    for (size_t i = 0; i < sharded_names.size(); ++i) {
+        ShardedCollection* collection = nullptr;
+        if (sharded_collections.get(sharded_names[i], collection) && collection != nullptr) {
+            collection->setScanOptions(options);
+        }
+    }
+}
+
+void Database::setDurability(const DurabilityOptions& options) {
+    durability = options;
+    Vector<std::string> names = collections.keys();
+    for (size_t i = 0; i < names.size(); ++i) {
+        Collection* collection = nullptr;
+        if (collections.get(names[i], collection) && collection != nullptr) {
+            collection->setDurability(options);
+        }
+    }
+    Vector<std::string> sharded_names = sharded_collections.keys();
+    for (size_t i = 0; i < sharded_names.size(); ++i) {
+        ShardedCollection* collection = nullptr;
+        if (sharded_collections.get(sharded_names[i], collection) && collection != nullptr) {
+            collection->setDurability(options);
+        }
+    }
+}
+
+DurabilityOptions Database::getDurability() const {
+    return durability;
+}
+
 // Информационные методы (без изменений)
 std::string Database::getName() const {
     return name;
@@ -108,25 +275,104 @@ std::string Database::getStoragePath() const {
 }
 
 size_t Database::getCollectionCount() const {
-    return collections.size();
+    return collections.size() + sharded_collections.size();
 }
 
 Vector<std::string> Database::getCollectionNames() const {
-    return collections.keys();
+    Vector<std::string> names = collections.keys();
+    Vector<std::string> sharded_names = sharded_collections.keys();
+    for (size_t i = 0; i < sharded_names.size(); ++i) {
+        names.push_back(sharded_names[i]);
+    }
+    return names;
+}
+
+void Database::printStats(std::ostream& out) const {
+    out << "Database '" << name << "' at " << storage_path << ": "
+        << getCollectionCount() << " collections" << std::endl;
+    Vector<std::string> names = collections.keys();
+    for (size_t i = 0; i < names.size(); ++i) {
+        Collection* collection = nullptr;
+        if (!collections.get(names[i], collection)) {
+            continue;
+        }
+        if (collection == nullptr) {
+            out << "Collection '" << names[i] << "': not loaded" << std::endl;
+        } else {
+            collection->printStats(out);
+        }
+    }
+    Vector<std::string> sharded_names = sharded_collections.keys();
+    for (size_t i = 0; i < sharded_names.size(); ++i) {
+        ShardedCollection* collection = nullptr;
+        if (!sharded_collections.get(sharded_names[i], collection)) {
+            continue;
+        }
+        if (collection == nullptr) {
+            out << "Sharded collection '" << sharded_names[i] << "': not loaded" << std::endl;
+        } else {
+            collection->printStats(out);
+        }
+    }
+    AllocatorStats heap = HeapAllocator::shared().stats();
+    out << "Hash tables (heap): " << heap.allocations << " allocations, "
+        << heap.deallocations << " frees, " << heap.bytes_in_use << " bytes in use" << std::endl;
 }
 
 bool Database::saveAllCollections() {
     bool success = true;
     Vector<std::string> collection_names = collections.keys();
+    // незагруженная коллекция могла меняться прошлыми запусками: её журнал ещё не в снимке
+    HashMap<std::string, bool> logged;
+    collectionsWithLog(storage_path, logged);
     
     for (size_t i = 0; i < collection_names.size(); ++i) {
         Collection* collection = nullptr;
-        if (collections.get(collection_names[i], collection)) {
+        // по одной коллекции за раз: остальные в это время не затрагиваются
+        if (!collections.get(collection_names[i], collection)) {
+            continue;
+        }
+        if (collection == nullptr && logged.find(collection_names[i]) != nullptr) {
+            collection = openCollection(collection_names[i]);
+        }
+        if (collection != nullptr && collection->isDirty()) {
             if (!collection->saveToFile()) { 
                 success = false;
             }
         }
     }
+    Vector<std::string> sharded_names = sharded_collections.keys();
+    for (size_t i = 0; i < sharded_names.size(); ++i) {
+        ShardedCollection* collection = nullptr;
+        if (!sharded_collections.get(sharded_names[i], collection)) {
+            continue;
+        }
+        // части лежат в своём каталоге: журнал любой из них - повод открыть коллекцию
+        if (collection == nullptr) {
+            HashMap<std::string, bool> logged_shards;
+            collectionsWithLog(ShardedCollection::directoryFor(sharded_names[i], storage_path), logged_shards);
+            if (logged_shards.size() > 0) {
+                collection = &getShardedCollection(sharded_names[i]);
+            }
+        }
+        if (collection != nullptr && collection->isDirty()) {
+            if (!collection->saveToFile()) {
+                success = false;
+            }
+        }
+    }
     
     return success;
 }
+
+bool Database::maybeCheckpoint(const std::string& collection_name) {
+    ShardedCollection* sharded = nullptr;
+    if (sharded_collections.get(collection_name, sharded)) {
+        return sharded == nullptr || sharded->maybeCheckpoint();
+    }
+    Collection* collection = nullptr;
+    if (collections.get(collection_name, collection) && collection != nullptr) {
+        return collection->maybeCheckpoint();
+    }
+    return true;
+}
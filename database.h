@@ -3,16 +3,22 @@
 
 #include "collection.h"
 #include "hash_map.h"
+#include "sharded_collection.h"
+#include <iostream>
 #include <string>
 
 class Database {
 private:
     std::string name;
     std::string storage_path;//путь к месту хранения
-    HashMap<std::string, Collection*> collections;
+    HashMap<std::string, Collection*> collections;  // nullptr - коллекция есть на диске, но ещё не загружена
+    HashMap<std::string, ShardedCollection*> sharded_collections;  // так же, имена не пересекаются с collections
+    ScanOptions scan_options;
+    DurabilityOptions durability;
     
     void ensureStorageDirectory() const;
-    void loadExistingCollections();
+    void listExistingCollections();
+    Collection* openCollection(const std::string& collection_name);
 
 public:
     Database(const std::string& db_name, const std::string& base_path = "./data");
@@ -20,7 +26,12 @@ public:
     
     // Управление коллекциями
     bool createCollection(const std::string& collection_name);
+    // для секционированной коллекции бросает std::runtime_error - её берут через getShardedCollection
     Collection& getCollection(const std::string& collection_name);
+    // коллекция из shard_count частей по хэшу _id
+    bool createShardedCollection(const std::string& collection_name, size_t shard_count);
+    bool isSharded(const std::string& collection_name) const;
+    ShardedCollection& getShardedCollection(const std::string& collection_name);
     bool collectionExists(const std::string& collection_name) const;
     bool dropCollection(const std::string& collection_name);
     
@@ -30,11 +41,22 @@ public:
     size_t getCollectionCount() const;
     Vector<std::string> getCollectionNames() const;
     
+    // параметры обхода для всех коллекций, в том числе открытых позже
+    void setScanOptions(const ScanOptions& options);
+    // режим подтверждения изменений для всех коллекций
+    void setDurability(const DurabilityOptions& options);
+    DurabilityOptions getDurability() const;
+
     // Статистика
-    void printStats() const;
+    void printStats(std::ostream& out = std::cout) const;
     
     // Персистентность
+    // контрольные точки по очереди для коллекций с изменениями после снимка; незагруженные
+    // с непустым журналом открываются - вызывать, пока другие потоки не открывают коллекции
+    // открытые коллекции блокируются сами: их можно в это время читать и менять
     bool saveAllCollections();
+    // контрольная точка коллекции по её политике, после изменения; незагруженную в этом запуске не меняли
+    bool maybeCheckpoint(const std::string& collection_name);
 };
 
 #endif
\ No newline at end of file
@@ -1,7 +1,10 @@
 #include "document.h"
+#include <cstdio>
+#include <stdexcept>
 
 DocumentWrapper::DocumentWrapper() : doc(nlohmann::json::object()) {}
 DocumentWrapper::DocumentWrapper(const Document& document) : doc(document) {}
+DocumentWrapper::DocumentWrapper(Document&& document) : doc(std::move(document)) {}
 DocumentWrapper::DocumentWrapper(const std::string& json_str) {
     try {
         doc = nlohmann::json::parse(json_str);
@@ -11,18 +14,55 @@ DocumentWrapper::DocumentWrapper(const std::string& json_str) {
     }
 }
 
-DocumentWrapper::DocumentWrapper(const DocumentWrapper& other) : doc(other.doc) {}
+DocumentWrapper::DocumentWrapper(const DocumentWrapper& other) : doc(other.toDocument()) {}
+// перенос без копирования дерева: таблица перемещает документы при росте
+DocumentWrapper::DocumentWrapper(DocumentWrapper&& other) noexcept
+    : doc(std::move(other.doc)), compact(std::move(other.compact)) {}
 DocumentWrapper& DocumentWrapper::operator=(const DocumentWrapper& other) {
     if (this != &other) {
-        doc = other.doc;
+        doc = other.toDocument();
+        compact = CompactDocument();
     }
     return *this;
 }
+DocumentWrapper& DocumentWrapper::operator=(DocumentWrapper&& other) noexcept {
+    doc = std::move(other.doc);
+    compact = std::move(other.compact);
+    return *this;
+}
+
+DocumentWrapper DocumentWrapper::compacted(const Document& document, FieldDictionary& dictionary) {
+    DocumentWrapper result{Document()};
+    if (!CompactDocument::encode(document, dictionary, result.compact)) {
+        result.doc = document;
+    }
+    return result;
+}
+
+DocumentWrapper DocumentWrapper::shared(const FieldDictionary& names) const {
+    if (compact.empty()) {
+        return DocumentWrapper(doc);
+    }
+    DocumentWrapper result{Document()};
+    result.compact = compact.share(names);
+    return result;
+}
+
+bool DocumentWrapper::isCompact() const {
+    return !compact.empty();
+}
+
+void DocumentWrapper::expand() {
+    if (!compact.empty()) {
+        doc = compact.toDocument();
+        compact = CompactDocument();
+    }
+}
 
 std::string DocumentWrapper::generateId() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_int_distribution<> dis(0, 15);
+    // генератор у каждого потока свой: вставки в разные коллекции и части идут параллельно
+    static thread_local std::mt19937 gen(std::random_device{}());
+    static thread_local std::uniform_int_distribution<> dis(0, 15);
     
     std::stringstream ss;
     ss << "doc_";
@@ -39,28 +79,100 @@ std::string DocumentWrapper::generateId() {
     return ss.str();
 }
 
+// пачка id: одна метка времени на всю пачку, случайное начало и счётчик - без повторов внутри пачки
+Vector<std::string> DocumentWrapper::generateIds(size_t count) {
+    static thread_local std::mt19937 gen(std::random_device{}());
+    static thread_local std::uniform_int_distribution<uint32_t> dis;
+
+    Vector<std::string> ids;
+    ids.reserve(count);
+    auto now = std::chrono::system_clock::now();
+    long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now.time_since_epoch()).count();
+    uint32_t suffix = dis(gen);
+    char buffer[64];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(buffer, sizeof(buffer), "doc_%lld_%08x", timestamp, suffix++);
+        ids.push_back(buffer);
+    }
+    return ids;
+}
+
 void DocumentWrapper::setGeneratedId() {
-    if (!doc.contains("_id")) {
+    if (!hasField("_id")) {
+        expand();
         doc["_id"] = generateId();
     }
 }
 // проверка наличия поля
 bool DocumentWrapper::hasField(const std::string& field_name) const {
+    if (!compact.empty()) {
+        return compact.contains(field_name);
+    }
     return doc.contains(field_name);
 }
+const Document* DocumentWrapper::findField(const std::string& field_name, Document& scratch) const {
+    if (!compact.empty()) {
+        CompactValue value;
+        if (!compact.find(field_name, value)) {
+            return nullptr;
+        }
+        scratch = value.toDocument();
+        return &scratch;
+    }
+    if (!doc.is_object()) {
+        return nullptr;
+    }
+    auto it = doc.find(field_name);
+    return it == doc.end() ? nullptr : &*it;
+}
+bool DocumentWrapper::findCompactField(const std::string& field_name, CompactValue& value) const {
+    return compact.find(field_name, value);
+}
 //сериализайия
 std::string DocumentWrapper::toJson() const {
+    if (!compact.empty()) {
+        return compact.toDocument().dump();
+    }
     return doc.dump(); // из JSON в строку
 }
 std::string DocumentWrapper::toPrettyJson() const {
+    if (!compact.empty()) {
+        return compact.toDocument().dump(4);
+    }
     return doc.dump(4);
 }
+Document DocumentWrapper::toDocument() const {
+    if (!compact.empty()) {
+        return compact.toDocument();
+    }
+    return doc;
+}
 const Document& DocumentWrapper::getRawDocument() const {
+    if (!compact.empty()) {
+        throw std::logic_error("compact document has no json tree, use toDocument()");
+    }
     return doc;
 }
+size_t DocumentWrapper::heapBytes() const {
+    if (!compact.empty()) {
+        return compact.heapBytes();
+    }
+    return ::treeHeapBytes(doc);
+}
+size_t DocumentWrapper::treeHeapBytes() const {
+    if (!compact.empty()) {
+        return compact.treeHeapBytes();
+    }
+    return ::treeHeapBytes(doc);
+}
 Document& DocumentWrapper::operator[](const std::string& key) {
+    expand();
     return doc[key];
 }
 const Document& DocumentWrapper::operator[](const std::string& key) const {
+    if (!compact.empty()) {
+        throw std::logic_error("compact document has no json tree, use findField()");
+    }
     return doc.at(key);
 }
\ No newline at end of file
@@ -8,26 +8,50 @@
 #include <random>
 #include <sstream>
 #include <nlohmann/json.hpp>
+#include "compact.h"
+#include "vector.h"
 
 using Document = nlohmann::json;
 
+// документ деревом nlohmann::json или, внутри коллекции, компактным буфером с её словарём имён
+// копия компактного документа - всегда дерево: она не зависит от коллекции и её блокировок
 class DocumentWrapper {
 private:
     Document doc;
+    CompactDocument compact;  // непустой - документ хранится компактно, doc не используется
+
+    // компактный документ перед изменением разворачивается в дерево
+    void expand();
 
 public:
     DocumentWrapper();
     DocumentWrapper(const Document& document);
+    DocumentWrapper(Document&& document);
     DocumentWrapper(const std::string& json_str);
     DocumentWrapper(const DocumentWrapper& other);
+    DocumentWrapper(DocumentWrapper&& other) noexcept;
     
     DocumentWrapper& operator=(const DocumentWrapper& other);
+    DocumentWrapper& operator=(DocumentWrapper&& other) noexcept;
     Document& operator[](const std::string& key);
+    // только для дерева, у компактного документа - std::logic_error
     const Document& operator[](const std::string& key) const;
+
+    // компактная копия документа; если он не объект или содержит binary - дерево как есть
+    static DocumentWrapper compacted(const Document& document, FieldDictionary& dictionary);
+    // тот же компактный буфер без копии, имена из names (см. CompactDocument::share); дерево копируется
+    DocumentWrapper shared(const FieldDictionary& names) const;
+    bool isCompact() const;
     
     static std::string generateId();
+    static Vector<std::string> generateIds(size_t count);
     void setGeneratedId();
     bool hasField(const std::string& field_name) const;
+    // значение поля без копии дерева; у компактного документа поле разворачивается в scratch
+    // nullptr - поля нет
+    const Document* findField(const std::string& field_name, Document& scratch) const;
+    // поле компактного документа без разворачивания; false - поля нет или документ не компактный
+    bool findCompactField(const std::string& field_name, CompactValue& value) const;
     
     template<typename T>
     T getField(const std::string& field_name, const T& default_value = T()) const;
@@ -37,13 +61,21 @@ public:
     
     std::string toJson() const;
     std::string toPrettyJson() const;
+    // копия документа деревом: для выдачи наружу и сериализации
+    Document toDocument() const;
+    // только для дерева, у компактного документа - std::logic_error (нужен toDocument)
     const Document& getRawDocument() const;
+    // память документа в куче и оценка той же памяти, если бы он был деревом
+    size_t heapBytes() const;
+    size_t treeHeapBytes() const;
 };
 template<typename T>
 T DocumentWrapper::getField(const std::string& field_name, const T& default_value) const {
-    if (doc.contains(field_name)) { //проверяет есть ли поле 
+    Document scratch;
+    const Document* value = findField(field_name, scratch);
+    if (value != nullptr) { //проверяет есть ли поле 
         try {
-            return doc[field_name].get<T>(); //получить как тип T
+            return value->get<T>(); //получить как тип T
         } catch (const nlohmann::json::exception& e) {
             std::cerr << "Error getting field '" << field_name << "': " << e.what() << std::endl;
             return default_value;
@@ -53,6 +85,7 @@ T DocumentWrapper::getField(const std::string& field_name, const T& default_valu
 }
 template<typename T>
 void DocumentWrapper::setField(const std::string& field_name, const T& value) {
+    expand();
     doc[field_name] = value;
 }
 
@@ -1,165 +1,493 @@
 #ifndef HASH_MAP_H
 #define HASH_MAP_H
 
+#include "allocator.h"
 #include "vector.h"
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <new>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-template<typename K, typename V>  
+// слот таблицы: ключ и значение хранятся прямо в массиве слотов
+template<typename K, typename V>
 struct HashNode {
-    std::string key;  
+    K key;
     V value;
-    HashNode* next;
-    
-    HashNode(const std::string& k, const V& v) : key(k), value(v), next(nullptr) {}
+
+    HashNode(const K& k, const V& v) : key(k), value(v) {}
+    HashNode(const K& k, V&& v) : key(k), value(std::move(v)) {}
 };
 
+// 64-битный хэш строки по 8 байт за шаг с перемешиванием в конце (как у murmur3)
 struct HashFunction {
-    size_t operator()(const std::string& key, size_t capacity) const {
-        size_t hash = 5381;
-        for (size_t i = 0; i < key.size(); ++i) {
-            hash = ((hash << 5) + hash) + key[i];
+    static uint64_t mix(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    size_t operator()(const std::string& key) const {
+        const char* bytes = key.data();
+        size_t length = key.size();
+        uint64_t hash = 0x9e3779b97f4a7c15ULL ^ (length * 0x87c37b91114253d5ULL);
+        while (length >= 8) {
+            uint64_t word;
+            std::memcpy(&word, bytes, 8);
+            hash = (hash ^ mix(word)) * 0x4cf5ad432745937fULL;
+            bytes += 8;
+            length -= 8;
+        }
+        // хвост собирается побайтно: memcpy переменной длины в слово тормозит на store forwarding
+        uint64_t tail = 0;
+        for (size_t i = 0; i < length; ++i) {
+            tail |= static_cast<uint64_t>(static_cast<unsigned char>(bytes[i])) << (i * 8);
         }
-        return hash % capacity;
+        hash ^= tail;
+        return static_cast<size_t>(mix(hash));
     }
 };
 
-template<typename K, typename V, typename Hash = HashFunction>  
+// служебные байты и поиск по группе из 16 слотов
+namespace hash_map_detail {
+    const int8_t CTRL_EMPTY = -128;    // 0b10000000
+    const int8_t CTRL_DELETED = -2;    // 0b11111110, занятые слоты хранят 7 бит хэша (0..127)
+    const size_t GROUP_WIDTH = 16;
+
+    // битовая маска слотов группы: бит i - слот i подходит
+    struct Group {
+#if defined(__SSE2__)
+        __m128i ctrl;
+        explicit Group(const int8_t* pos) : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(pos))) {}
+        uint32_t match(int8_t fingerprint) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(fingerprint), ctrl)));
+        }
+        uint32_t matchEmpty() const {
+            return match(CTRL_EMPTY);
+        }
+        uint32_t matchFree() const {
+            // у пустых и удалённых старший бит выставлен
+            return static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+        }
+#else
+        const int8_t* ctrl;
+        explicit Group(const int8_t* pos) : ctrl(pos) {}
+        uint32_t match(int8_t fingerprint) const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] == fingerprint) << i;
+            }
+            return mask;
+        }
+        uint32_t matchEmpty() const {
+            return match(CTRL_EMPTY);
+        }
+        uint32_t matchFree() const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < GROUP_WIDTH; ++i) {
+                mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+            }
+            return mask;
+        }
+#endif
+    };
+
+    inline size_t lowestBit(uint32_t mask) {
+        return static_cast<size_t>(__builtin_ctz(mask));
+    }
+}
+
+// открытая адресация в стиле swiss table: массив служебных байтов (7 бит хэша или пусто/удалено)
+// просматривается группами по 16 через SSE2, ключи сравниваются только при совпадении отпечатка
+// слоты и служебные байты лежат в одном блоке от Allocator (HeapAllocator или SlabAllocator)
+// рост большой таблицы постепенный: старая таблица живёт рядом с новой и переносится
+// по MIGRATE_SLOTS слотов за каждое изменение, поиск смотрит в обе
+template<typename K, typename V, typename Hash = HashFunction, typename Allocator = HeapAllocator>
 class HashMap {
 private:
-    Vector<HashNode<K, V>*> table; //массив указателей на цепочки
-    size_t size_;
-    size_t capacity_;
+    static const size_t MIN_CAPACITY = 4;
+    static const size_t MIGRATE_SLOTS = 32;                // слотов старой таблицы за одно изменение
+    static const size_t INCREMENTAL_MIN_CAPACITY = 8192;   // меньшие таблицы перестраиваются сразу
+
+    struct Table {
+        int8_t* ctrl = nullptr;           // служебный байт на слот, не меньше одной группы
+        HashNode<K, V>* slots = nullptr;  // записи, живые только там, где ctrl >= 0
+        size_t capacity = 0;              // степень двойки; меньше группы - вся таблица в одной группе
+        size_t size = 0;
+        size_t deleted = 0;               // удалённые слоты, освобождаются только перестройкой
+
+        size_t groupMask() const {
+            return capacity < hash_map_detail::GROUP_WIDTH ? 0 : capacity / hash_map_detail::GROUP_WIDTH - 1;
+        }
+
+        // в маленькой таблице хвост группы - пустые байты за её концом, слотами они не считаются
+        uint32_t slotMask() const {
+            return capacity < hash_map_detail::GROUP_WIDTH ? (1u << capacity) - 1 : 0xffffu;
+        }
+    };
+
+    Table table;                  // сюда идут новые записи
+    Table old;                    // переносимая таблица, capacity == 0 - переноса нет
+    size_t migrate_position;      // первый ещё не перенесённый слот old
+    bool incremental;
     Hash hash_func;
-    const double LOAD_FACTOR_THRESHOLD = 0.75;
-
-    void rehash() {
-        size_t new_capacity = capacity_ * 2;
-        Vector<HashNode<K, V>*> new_table(new_capacity, nullptr);
-        
-        for (size_t i = 0; i < capacity_; ++i) {
-            HashNode<K, V>* current = table[i];
-            while (current != nullptr) {
-                HashNode<K, V>* next = current->next;
-                size_t new_index = hash_func(current->key, new_capacity);
-                
-                current->next = new_table[new_index];
-                new_table[new_index] = current;
-                
-                current = next;
-            }
+    Allocator* allocator_;
+
+    static size_t roundCapacity(size_t requested) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < requested) {
+            capacity *= 2;
         }
-        
-        table = new_table;
-        capacity_ = new_capacity;
+        return capacity;
     }
 
-public:
-    HashMap(size_t capacity = 16) : size_(0), capacity_(capacity) {
-        table.resize(capacity_, nullptr);
+    static size_t ctrlBytes(size_t capacity) {
+        return capacity < hash_map_detail::GROUP_WIDTH ? hash_map_detail::GROUP_WIDTH : capacity;
     }
 
-    ~HashMap() {
-        clear();
+    static size_t blockBytes(size_t capacity) {
+        return capacity == 0 ? 0 : capacity * sizeof(HashNode<K, V>) + ctrlBytes(capacity);
+    }
+
+    static int8_t fingerprint(size_t hash) {
+        return static_cast<int8_t>(hash & 0x7f);
     }
 
-    void put(const K& key, const V& value) {  
-        if (static_cast<double>(size_) / capacity_ > LOAD_FACTOR_THRESHOLD) {
-            rehash();
+    void allocate(Table& t, size_t capacity) {
+        t.capacity = capacity;
+        char* block = static_cast<char*>(allocator_->allocate(blockBytes(capacity)));
+        t.slots = reinterpret_cast<HashNode<K, V>*>(block);
+        t.ctrl = reinterpret_cast<int8_t*>(block + capacity * sizeof(HashNode<K, V>));
+        std::memset(t.ctrl, hash_map_detail::CTRL_EMPTY, ctrlBytes(capacity));
+        t.size = 0;
+        t.deleted = 0;
+    }
+
+    void release(Table& t) {
+        if (t.capacity != 0) {
+            allocator_->deallocate(t.slots, blockBytes(t.capacity));
         }
-        
-        size_t index = hash_func(key, capacity_);
-        HashNode<K, V>* current = table[index]; //указатель на начало цепочки
-        
-        while (current != nullptr) {
-            if (current->key == key) {
-                current->value = value;
-                return;
+        t = Table();
+    }
+
+    void destroyEntries(Table& t) {
+        for (size_t i = 0; i < t.capacity; ++i) {
+            if (t.ctrl[i] >= 0) {
+                t.slots[i].~HashNode<K, V>();
             }
-            current = current->next;
         }
-        HashNode<K, V>* new_node = new HashNode<K, V>(key, value);
-        new_node->next = table[index];
-        table[index] = new_node;
-        size_++;
     }
 
-    bool get(const K& key, V& value) const {  
-        size_t index = hash_func(key, capacity_);
-        HashNode<K, V>* current = table[index];
-        
-        while (current != nullptr) {
-            if (current->key == key) {
-                value = current->value;
-                return true;
+    // слот с ключом или npos; группы перебираются квадратично - при степени двойки обходятся все
+    size_t findSlot(const Table& t, const K& key, size_t hash) const {
+        int8_t fp = fingerprint(hash);
+        size_t group = (hash >> 7) & t.groupMask();
+        for (size_t step = 1; ; ++step) {
+            size_t base = group * hash_map_detail::GROUP_WIDTH;
+            // слоты группы подтягиваются в кэш параллельно со служебными байтами
+            __builtin_prefetch(t.slots + base);
+            hash_map_detail::Group g(t.ctrl + base);
+            uint32_t candidates = g.match(fp);
+            while (candidates != 0) {
+                size_t slot = base + hash_map_detail::lowestBit(candidates);
+                if (t.slots[slot].key == key) {
+                    return slot;
+                }
+                candidates &= candidates - 1;
             }
-            current = current->next;
+            // в группе с пустым слотом цепочка поиска кончается
+            if (g.matchEmpty() != 0 || step > t.groupMask()) {
+                return npos;
+            }
+            group = (group + step) & t.groupMask();
         }
-        return false;
     }
 
-    bool remove(const K& key) {  
-        size_t index = hash_func(key, capacity_);
-        HashNode<K, V>* current = table[index];
-        HashNode<K, V>* prev = nullptr;
-        
-        while (current != nullptr) {
-            if (current->key == key) {
-                if (prev == nullptr) {
-                    table[index] = current->next;
-                } else {
-                    prev->next = current->next;
+    // занимает первый пустой или удалённый слот на пути ключа
+    size_t claim(Table& t, size_t hash) {
+        size_t group = (hash >> 7) & t.groupMask();
+        for (size_t step = 1; ; ++step) {
+            size_t base = group * hash_map_detail::GROUP_WIDTH;
+            uint32_t available = hash_map_detail::Group(t.ctrl + base).matchFree() & t.slotMask();
+            if (available != 0) {
+                size_t slot = base + hash_map_detail::lowestBit(available);
+                if (t.ctrl[slot] == hash_map_detail::CTRL_DELETED) {
+                    t.deleted--;
                 }
-                delete current;
-                size_--;
+                t.ctrl[slot] = fingerprint(hash);
+                t.size++;
+                return slot;
+            }
+            group = (group + step) & t.groupMask();
+        }
+    }
+
+    void erase(Table& t, size_t slot) {
+        t.slots[slot].~HashNode<K, V>();
+        // в группе уже есть пустой слот - через неё не проходила ни одна цепочка поиска,
+        // иначе нужна метка удаления, чтобы не оборвать поиск других ключей
+        size_t base = slot & ~(hash_map_detail::GROUP_WIDTH - 1);
+        if (hash_map_detail::Group(t.ctrl + base).matchEmpty() != 0) {
+            t.ctrl[slot] = hash_map_detail::CTRL_EMPTY;
+        } else {
+            t.ctrl[slot] = hash_map_detail::CTRL_DELETED;
+            t.deleted++;
+        }
+        t.size--;
+    }
+
+    // переносит слоты old начиная с migrate_position, не больше limit; old освобождается в конце
+    void migrate(size_t limit) {
+        size_t end = old.capacity - migrate_position < limit ? old.capacity : migrate_position + limit;
+        for (; migrate_position < end; ++migrate_position) {
+            if (old.ctrl[migrate_position] >= 0) {
+                HashNode<K, V>& node = old.slots[migrate_position];
+                new (&table.slots[claim(table, hash_func(node.key))]) HashNode<K, V>(std::move(node));
+                node.~HashNode<K, V>();
+                // метка удаления, а не пусто: иначе оборвутся цепочки поиска ещё не перенесённых ключей
+                old.ctrl[migrate_position] = hash_map_detail::CTRL_DELETED;
+                old.size--;
+            }
+        }
+        if (migrate_position == old.capacity) {
+            release(old);
+            migrate_position = 0;
+        }
+    }
+
+    // новая таблица на capacity слотов; старая переносится сразу или по частям
+    void resize(size_t capacity, bool allow_incremental) {
+        if (old.capacity != 0) {
+            migrate(old.capacity);
+        }
+        old = table;
+        allocate(table, capacity);
+        migrate_position = 0;
+        if (!allow_incremental || !incremental || old.capacity < INCREMENTAL_MIN_CAPACITY) {
+            migrate(old.capacity);
+        }
+    }
+
+    // заполнено не больше 7/8 слотов, считая удалённые
+    void growIfNeeded() {
+        if ((table.size + table.deleted + 1) * 8 <= table.capacity * 7) {
+            return;
+        }
+        // если место заняли удалённые слоты, таблица перестраивается без роста
+        size_t live = table.size + old.size;
+        resize((live + 1) * 16 > table.capacity * 7 ? table.capacity * 2 : table.capacity, true);
+    }
+
+    // слот ключа в одной из таблиц
+    bool locate(const K& key, size_t hash, const Table*& where, size_t& slot) const {
+        slot = findSlot(table, key, hash);
+        if (slot != npos) {
+            where = &table;
+            return true;
+        }
+        if (old.capacity != 0) {
+            slot = findSlot(old, key, hash);
+            if (slot != npos) {
+                where = &old;
                 return true;
             }
-            prev = current;
-            current = current->next;
         }
         return false;
     }
 
+    // сквозная нумерация слотов: сначала новая таблица, потом переносимая
+    const Table* tableOf(size_t& position) const {
+        if (position < table.capacity) {
+            return &table;
+        }
+        position -= table.capacity;
+        return position < old.capacity ? &old : nullptr;
+    }
+
+    template<typename Value>
+    void store(const K& key, Value&& value) {
+        if (old.capacity != 0) {
+            migrate(MIGRATE_SLOTS);
+        }
+        size_t hash = hash_func(key);
+        const Table* where = nullptr;
+        size_t slot = 0;
+        if (locate(key, hash, where, slot)) {
+            where->slots[slot].value = std::forward<Value>(value);
+            return;
+        }
+        growIfNeeded();
+        new (&table.slots[claim(table, hash)]) HashNode<K, V>(key, std::forward<Value>(value));
+    }
+
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    HashMap(size_t capacity = 16, Allocator* allocator = &Allocator::shared())
+        : migrate_position(0), incremental(true), allocator_(allocator) {
+        allocate(table, roundCapacity(capacity));
+    }
+
+    ~HashMap() {
+        clear();
+        release(table);
+    }
+
+    // записи принадлежат таблице
+    HashMap(const HashMap&) = delete;
+    HashMap& operator=(const HashMap&) = delete;
+
+    void put(const K& key, const V& value) {
+        store(key, value);
+    }
+
+    // значение переносится в таблицу без копирования
+    void put(const K& key, V&& value) {
+        store(key, std::move(value));
+    }
+
+    bool get(const K& key, V& value) const {
+        const Table* where = nullptr;
+        size_t slot = 0;
+        if (!locate(key, hash_func(key), where, slot)) {
+            return false;
+        }
+        value = where->slots[slot].value;
+        return true;
+    }
+
+    bool remove(const K& key) {
+        if (old.capacity != 0) {
+            migrate(MIGRATE_SLOTS);
+        }
+        const Table* where = nullptr;
+        size_t slot = 0;
+        if (!locate(key, hash_func(key), where, slot)) {
+            return false;
+        }
+        erase(where == &table ? table : old, slot);
+        return true;
+    }
+
     void clear() {
-        for (size_t i = 0; i < capacity_; ++i) {
-            HashNode<K, V>* current = table[i];
-            while (current != nullptr) {
-                HashNode<K, V>* next = current->next;
-                delete current;
-                current = next;
+        destroyEntries(table);
+        std::memset(table.ctrl, hash_map_detail::CTRL_EMPTY, ctrlBytes(table.capacity));
+        table.size = 0;
+        table.deleted = 0;
+        if (old.capacity != 0) {
+            destroyEntries(old);
+            release(old);
+            migrate_position = 0;
+        }
+    }
+
+    // место под n записей без перестроек; идущий перенос при этом завершается
+    void reserve(size_t n) {
+        size_t capacity = roundCapacity(n + n / 7 + 1);
+        if (capacity > table.capacity) {
+            resize(capacity, false);
+        }
+    }
+
+    // false - рост одним проходом, как раньше; на следующий рост
+    void setIncrementalRehash(bool enabled) {
+        incremental = enabled;
+    }
+
+    bool isRehashing() const { return old.capacity != 0; }
+
+    size_t size() const { return table.size + old.size; }
+    // слотов в обеих таблицах - диапазон номеров для forEachInBuckets
+    size_t capacity() const { return table.capacity + old.capacity; }
+    double load_factor() const { return static_cast<double>(size()) / capacity(); }
+    // память под слоты и служебные байты (без содержимого ключей и значений)
+    size_t memoryBytes() const { return blockBytes(table.capacity) + blockBytes(old.capacity); }
+
+    // указатель на значение в таблице без копирования, nullptr - ключа нет
+    // действителен до следующего изменения таблицы
+    const V* find(const K& key) const {
+        const Table* where = nullptr;
+        size_t slot = 0;
+        return locate(key, hash_func(key), where, slot) ? &where->slots[slot].value : nullptr;
+    }
+    // то же для изменения значения на месте; поиск таблицу не перестраивает
+    V* find(const K& key) {
+        return const_cast<V*>(static_cast<const HashMap*>(this)->find(key));
+    }
+
+    // последовательный обход записей на месте, без копирования значений
+    class ConstIterator {
+    private:
+        const HashMap* map;
+        size_t position;
+        const Table* current;
+        size_t slot;
+
+        void skipEmpty() {
+            while (true) {
+                slot = position;
+                current = map->tableOf(slot);
+                if (current == nullptr || current->ctrl[slot] >= 0) {
+                    return;
+                }
+                position++;
             }
-            table[i] = nullptr;
         }
-        size_ = 0;
+
+    public:
+        ConstIterator(const HashMap* m) : map(m), position(0), current(nullptr), slot(0) { skipEmpty(); }
+        bool valid() const { return current != nullptr; }
+        const K& key() const { return current->slots[slot].key; }
+        const V& value() const { return current->slots[slot].value; }
+        void next() {
+            position++;
+            skipEmpty();
+        }
+    };
+
+    ConstIterator iterate() const {
+        return ConstIterator(this);
     }
 
-    size_t size() const { return size_; }
-    size_t capacity() const { return capacity_; }
-    double load_factor() const { return static_cast<double>(size_) / capacity_; }
+    // обход слотов [begin, end) в сквозной нумерации - для разбиения таблицы между потоками
+    template<typename Visitor>
+    void forEachInBuckets(size_t begin, size_t end, Visitor visit) const {
+        for (size_t position = begin; position < end; ++position) {
+            size_t slot = position;
+            const Table* t = tableOf(slot);
+            if (t == nullptr) {
+                return;
+            }
+            if (t->ctrl[slot] >= 0) {
+                visit(t->slots[slot].key, t->slots[slot].value);
+            }
+        }
+    }
 
     Vector<std::string> keys() const {
         Vector<std::string> result;
-        for (size_t i = 0; i < capacity_; ++i) {
-            HashNode<K, V>* current = table[i];
-            while (current != nullptr) {
-                result.push_back(current->key);
-                current = current->next;
-            }
-        }
+        result.reserve(size());
+        forEachInBuckets(0, capacity(), [&result](const K& key, const V&) {
+            result.push_back(key);
+        });
         return result;
     }
 
     Vector<V> values() const {
         Vector<V> result;
-        for (size_t i = 0; i < capacity_; ++i) {
-            HashNode<K, V>* current = table[i];
-            while (current != nullptr) {
-                result.push_back(current->value);
-                current = current->next;
-            }
-        }
+        result.reserve(size());
+        forEachInBuckets(0, capacity(), [&result](const K&, const V& value) {
+            result.push_back(value);
+        });
         return result;
     }
-    
+
 };
 
 #endif
\ No newline at end of file
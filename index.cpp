@@ -0,0 +1,492 @@
+#include "index.h"
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <new>
+
+namespace {
+
+// целые числа с плавающей точкой приводим к целому типу, чтобы 1.0 и 1 совпадали
+Document canonicalValue(const Document& value) {
+    if (value.is_number_float()) {
+        double number = value.get<double>();
+        if (std::isfinite(number) && number == std::floor(number) && std::fabs(number) < 9.0e18) {
+            return static_cast<int64_t>(number);
+        }
+        return value;
+    }
+    if (value.is_array()) {
+        Document result = Document::array();
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            result.push_back(canonicalValue(*it));
+        }
+        return result;
+    }
+    if (value.is_object()) {
+        Document result = Document::object();
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            result[it.key()] = canonicalValue(it.value());
+        }
+        return result;
+    }
+    return value;
+}
+
+// список id в памяти индекса
+PostingSet* createPostings(SlabAllocator& memory) {
+    return new (memory.allocate(sizeof(PostingSet))) PostingSet(1, &memory);
+}
+
+void destroyPostings(SlabAllocator& memory, PostingSet* ids) {
+    ids->~PostingSet();
+    memory.deallocate(ids, sizeof(PostingSet));
+}
+
+}
+
+const char* Index::typeName(IndexType type) {
+    return type == IndexType::Ordered ? "ordered" : "hash";
+}
+
+bool Index::hasWideUnsigned(const Document& value) {
+    if (value.is_number_unsigned()) {
+        return value.get<uint64_t>() > static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    }
+    if (value.is_array() || value.is_object()) {
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            if (hasWideUnsigned(*it)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool Index::addWide(const std::string& id, const Document& value) {
+    if (!hasWideUnsigned(value)) {
+        return false;
+    }
+    wide_values.put(id, value);
+    return true;
+}
+
+bool Index::removeWide(const std::string& id, const Document& value) {
+    if (!hasWideUnsigned(value)) {
+        return false;
+    }
+    wide_values.remove(id);
+    return true;
+}
+
+void Index::appendWide(Document& entries) const {
+    Vector<std::string> ids = wide_values.keys();
+    for (size_t i = 0; i < ids.size(); ++i) {
+        const Document* value = wide_values.find(ids[i]);
+        entries.push_back(Document::array({*value, Document::array({ids[i]})}));
+    }
+}
+
+bool RangeBounds::addCondition(const std::string& op, const Document& value) {
+    if (op == "$gt" || op == "$gte") {
+        bool inclusive = op == "$gte";
+        // оставляем более строгую нижнюю границу
+        if (!has_low || low < value || (low == value && !inclusive)) {
+            low = value;
+            low_inclusive = inclusive;
+            has_low = true;
+        }
+        return true;
+    }
+    if (op == "$lt" || op == "$lte") {
+        bool inclusive = op == "$lte";
+        if (!has_high || value < high || (high == value && !inclusive)) {
+            high = value;
+            high_inclusive = inclusive;
+            has_high = true;
+        }
+        return true;
+    }
+    if (op == "$eq" || op == "") {
+        return addCondition("$gte", value) && addCondition("$lte", value);
+    }
+    return false;
+}
+
+bool RangeBounds::isEmpty() const {
+    if (!has_low || !has_high) {
+        return false;
+    }
+    if (high < low) {
+        return true;
+    }
+    return low == high && !(low_inclusive && high_inclusive);
+}
+
+bool RangeBounds::aboveLow(const Document& value) const {
+    if (!has_low) {
+        return true;
+    }
+    return low_inclusive ? value >= low : value > low;
+}
+
+bool RangeBounds::belowHigh(const Document& value) const {
+    if (!has_high) {
+        return true;
+    }
+    return high_inclusive ? value <= high : value < high;
+}
+
+HashIndex::HashIndex(const std::string& field_name) : Index(field_name) {}
+
+HashIndex::~HashIndex() {
+    clear();
+}
+
+std::string HashIndex::keyOf(const Document& value) {
+    if (value.is_number_float() || value.is_array() || value.is_object()) {
+        return canonicalValue(value).dump();
+    }
+    return value.dump();
+}
+
+void HashIndex::add(const std::string& id, const DocumentWrapper& doc) {
+    Document scratch;
+    const Document* value = doc.findField(field, scratch);
+    if (value == nullptr || addWide(id, *value)) {
+        return; // документы без поля в индекс не попадают
+    }
+    std::string key = keyOf(*value);
+    PostingSet* ids = nullptr;
+    if (!entries.get(key, ids)) {
+        ids = createPostings(memory);
+        entries.put(key, ids);
+    }
+    ids->put(id, true);
+}
+
+void HashIndex::remove(const std::string& id, const DocumentWrapper& doc) {
+    Document scratch;
+    const Document* value = doc.findField(field, scratch);
+    if (value == nullptr || removeWide(id, *value)) {
+        return;
+    }
+    std::string key = keyOf(*value);
+    PostingSet* ids = nullptr;
+    if (!entries.get(key, ids)) {
+        return;
+    }
+    ids->remove(id);
+    if (ids->size() == 0) {
+        destroyPostings(memory, ids);
+        entries.remove(key);
+    }
+}
+
+void HashIndex::clear() {
+    Vector<PostingSet*> sets = entries.values();
+    for (size_t i = 0; i < sets.size(); ++i) {
+        sets[i]->~PostingSet();
+    }
+    entries.clear();
+    wide_values.clear();
+    // таблицы списков не возвращаются по одной - блоки слабов освобождаются все сразу
+    memory.release();
+}
+
+void HashIndex::lookup(const Document& value, IdSet& result) const {
+    PostingSet* ids = nullptr;
+    if (!entries.get(keyOf(value), ids)) {
+        return;
+    }
+    Vector<std::string> keys = ids->keys();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        result.put(keys[i], true);
+    }
+}
+
+size_t HashIndex::countOf(const Document& value) const {
+    PostingSet* ids = nullptr;
+    if (!entries.get(keyOf(value), ids)) {
+        return 0;
+    }
+    return ids->size();
+}
+
+size_t HashIndex::distinctValues() const {
+    return entries.size();
+}
+
+AllocatorStats HashIndex::memoryStats() const {
+    return memory.stats();
+}
+
+Document HashIndex::toJson() const {
+    Document result = Document::array();
+    Vector<std::string> keys = entries.keys();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        PostingSet* ids = nullptr;
+        entries.get(keys[i], ids);
+        Document id_list = Document::array();
+        Vector<std::string> id_keys = ids->keys();
+        for (size_t j = 0; j < id_keys.size(); ++j) {
+            id_list.push_back(id_keys[j]);
+        }
+        result.push_back(Document::array({Document::parse(keys[i]), id_list}));
+    }
+    appendWide(result);
+    return result;
+}
+
+void HashIndex::fromJson(const Document& entries_json) {
+    clear();
+    entries.reserve(entries_json.size());
+    for (auto it = entries_json.begin(); it != entries_json.end(); ++it) {
+        const Document& entry = *it;
+        if (!entry.is_array() || entry.size() != 2 || !entry[1].is_array()) {
+            continue;
+        }
+        if (hasWideUnsigned(entry[0])) {
+            for (auto id_it = entry[1].begin(); id_it != entry[1].end(); ++id_it) {
+                wide_values.put(id_it->get<std::string>(), entry[0]);
+            }
+            continue;
+        }
+        std::string key = keyOf(entry[0]);
+        PostingSet* ids = nullptr;
+        if (!entries.get(key, ids)) {
+            ids = createPostings(memory);
+            entries.put(key, ids);
+        }
+        ids->reserve(ids->size() + entry[1].size());
+        for (auto id_it = entry[1].begin(); id_it != entry[1].end(); ++id_it) {
+            ids->put(id_it->get<std::string>(), true);
+        }
+    }
+}
+
+OrderedIndex::OrderedIndex(const std::string& field_name)
+    : Index(field_name), head(nullptr), level_count(1), node_count(0), level_gen(12345) {
+    head = createNode(Document(), MAX_LEVEL);
+}
+
+OrderedIndex::~OrderedIndex() {
+    OrderedIndexNode* current = head;
+    while (current != nullptr) {
+        OrderedIndexNode* next = current->next[0];
+        destroyNode(current);
+        current = next;
+    }
+}
+
+OrderedIndexNode* OrderedIndex::createNode(const Document& key, size_t levels) {
+    return new (memory.allocate(sizeof(OrderedIndexNode))) OrderedIndexNode(key, levels, &memory);
+}
+
+void OrderedIndex::destroyNode(OrderedIndexNode* node) {
+    node->~OrderedIndexNode();
+    memory.deallocate(node, sizeof(OrderedIndexNode));
+}
+
+size_t OrderedIndex::randomLevel() {
+    // каждый следующий уровень с вероятностью 1/4
+    size_t level = 1;
+    while (level < MAX_LEVEL && (level_gen() & 3) == 0) {
+        level++;
+    }
+    return level;
+}
+
+OrderedIndexNode* OrderedIndex::findPredecessors(const Document& key, OrderedIndexNode** update) const {
+    OrderedIndexNode* current = head;
+    for (size_t i = level_count; i-- > 0;) {
+        while (current->next[i] != nullptr && current->next[i]->key < key) {
+            current = current->next[i];
+        }
+        if (update != nullptr) {
+            update[i] = current;
+        }
+    }
+    return current;
+}
+
+OrderedIndexNode* OrderedIndex::findNode(const Document& key) const {
+    OrderedIndexNode* candidate = findPredecessors(key, nullptr)->next[0];
+    if (candidate != nullptr && !(key < candidate->key)) {
+        return candidate;
+    }
+    return nullptr;
+}
+
+OrderedIndexNode* OrderedIndex::firstInRange(const RangeBounds& bounds) const {
+    if (!bounds.has_low) {
+        return head->next[0];
+    }
+    OrderedIndexNode* current = findPredecessors(bounds.low, nullptr)->next[0];
+    if (current != nullptr && !bounds.low_inclusive && !(bounds.low < current->key)) {
+        current = current->next[0];  // пропускаем само значение границы
+    }
+    return current;
+}
+
+void OrderedIndex::insertId(const Document& key, const std::string& id) {
+    OrderedIndexNode* update[MAX_LEVEL];
+    OrderedIndexNode* candidate = findPredecessors(key, update)->next[0];
+    if (candidate != nullptr && !(key < candidate->key)) {
+        candidate->ids.put(id, true);
+        return;
+    }
+    size_t levels = randomLevel();
+    if (levels > level_count) {
+        for (size_t i = level_count; i < levels; ++i) {
+            update[i] = head;
+        }
+        level_count = levels;
+    }
+    OrderedIndexNode* node = createNode(key, levels);
+    for (size_t i = 0; i < levels; ++i) {
+        node->next[i] = update[i]->next[i];
+        update[i]->next[i] = node;
+    }
+    node->ids.put(id, true);
+    node_count++;
+}
+
+void OrderedIndex::eraseId(const Document& key, const std::string& id) {
+    OrderedIndexNode* update[MAX_LEVEL];
+    OrderedIndexNode* node = findPredecessors(key, update)->next[0];
+    if (node == nullptr || key < node->key) {
+        return;
+    }
+    node->ids.remove(id);
+    if (node->ids.size() > 0) {
+        return;
+    }
+    for (size_t i = 0; i < node->next.size(); ++i) {
+        if (update[i]->next[i] == node) {
+            update[i]->next[i] = node->next[i];
+        }
+    }
+    destroyNode(node);
+    node_count--;
+    while (level_count > 1 && head->next[level_count - 1] == nullptr) {
+        level_count--;
+    }
+}
+
+void OrderedIndex::add(const std::string& id, const DocumentWrapper& doc) {
+    Document scratch;
+    const Document* value = doc.findField(field, scratch);
+    if (value == nullptr || addWide(id, *value)) {
+        return;
+    }
+    insertId(*value, id);
+}
+
+void OrderedIndex::remove(const std::string& id, const DocumentWrapper& doc) {
+    Document scratch;
+    const Document* value = doc.findField(field, scratch);
+    if (value == nullptr || removeWide(id, *value)) {
+        return;
+    }
+    eraseId(*value, id);
+}
+
+void OrderedIndex::clear() {
+    // узлы только разрушаются, их память уходит вместе с блоками слабов
+    OrderedIndexNode* current = head;
+    while (current != nullptr) {
+        OrderedIndexNode* next = current->next[0];
+        current->~OrderedIndexNode();
+        current = next;
+    }
+    memory.release();
+    wide_values.clear();
+    head = createNode(Document(), MAX_LEVEL);
+    level_count = 1;
+    node_count = 0;
+}
+
+void OrderedIndex::lookup(const Document& value, IdSet& result) const {
+    OrderedIndexNode* node = findNode(value);
+    if (node == nullptr) {
+        return;
+    }
+    Vector<std::string> keys = node->ids.keys();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        result.put(keys[i], true);
+    }
+}
+
+size_t OrderedIndex::countOf(const Document& value) const {
+    OrderedIndexNode* node = findNode(value);
+    return node == nullptr ? 0 : node->ids.size();
+}
+
+AllocatorStats OrderedIndex::memoryStats() const {
+    return memory.stats();
+}
+
+size_t OrderedIndex::distinctValues() const {
+    return node_count;
+}
+
+void OrderedIndex::range(const RangeBounds& bounds, Vector<std::string>& result) const {
+    if (bounds.isEmpty()) {
+        return;
+    }
+    for (OrderedIndexNode* node = firstInRange(bounds); node != nullptr; node = node->next[0]) {
+        if (!bounds.belowHigh(node->key)) {
+            break;
+        }
+        Vector<std::string> keys = node->ids.keys();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            result.push_back(keys[i]);
+        }
+    }
+}
+
+size_t OrderedIndex::countRange(const RangeBounds& bounds, size_t limit) const {
+    if (bounds.isEmpty()) {
+        return 0;
+    }
+    size_t count = 0;
+    for (OrderedIndexNode* node = firstInRange(bounds); node != nullptr && count < limit; node = node->next[0]) {
+        if (!bounds.belowHigh(node->key)) {
+            break;
+        }
+        count += node->ids.size();
+    }
+    return count;
+}
+
+Document OrderedIndex::toJson() const {
+    Document result = Document::array();
+    for (OrderedIndexNode* node = head->next[0]; node != nullptr; node = node->next[0]) {
+        Document id_list = Document::array();
+        Vector<std::string> keys = node->ids.keys();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            id_list.push_back(keys[i]);
+        }
+        result.push_back(Document::array({node->key, id_list}));
+    }
+    appendWide(result);
+    return result;
+}
+
+void OrderedIndex::fromJson(const Document& entries_json) {
+    clear();
+    for (auto it = entries_json.begin(); it != entries_json.end(); ++it) {
+        const Document& entry = *it;
+        if (!entry.is_array() || entry.size() != 2 || !entry[1].is_array()) {
+            continue;
+        }
+        bool wide = hasWideUnsigned(entry[0]);
+        for (auto id_it = entry[1].begin(); id_it != entry[1].end(); ++id_it) {
+            if (wide) {
+                wide_values.put(id_it->get<std::string>(), entry[0]);
+            } else {
+                insertId(entry[0], id_it->get<std::string>());
+            }
+        }
+    }
+}
\ No newline at end of file
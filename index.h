@@ -0,0 +1,161 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "allocator.h"
+#include "document.h"
+#include "hash_map.h"
+#include "vector.h"
+#include <random>
+#include <string>
+
+// множество id документов
+using IdSet = HashMap<std::string, bool>;
+// id документов с одним значением поля внутри индекса; таблицы берутся из слабов индекса
+using PostingSet = HashMap<std::string, bool, HashFunction, SlabAllocator>;
+
+enum class IndexType {
+    Hash,
+    Ordered
+};
+
+// границы диапазона значений для упорядоченного индекса, сравнение как у nlohmann::json
+struct RangeBounds {
+    bool has_low = false;
+    bool low_inclusive = true;
+    Document low;
+    bool has_high = false;
+    bool high_inclusive = true;
+    Document high;
+
+    // сужает диапазон условием $gt/$gte/$lt/$lte/$eq, false - оператор не диапазонный
+    bool addCondition(const std::string& op, const Document& value);
+    bool isEmpty() const;
+    bool aboveLow(const Document& value) const;
+    bool belowHigh(const Document& value) const;
+};
+
+// вторичный индекс по одному полю: значение поля -> id документов
+class Index {
+protected:
+    std::string field;
+    // значения с беззнаковым числом больше INT64_MAX (id -> значение): фильтр сравнивает такое число
+    // с целыми после приведения к int64, ни ключ хэша, ни порядок списка с пропусками так не умеют
+    HashMap<std::string, Document> wide_values;
+
+    // true - значение широкое и хранится в wide_values, а не в самом индексе
+    bool addWide(const std::string& id, const Document& value);
+    bool removeWide(const std::string& id, const Document& value);
+    // широкие значения в формате toJson
+    void appendWide(Document& entries) const;
+
+public:
+    Index(const std::string& field_name) : field(field_name) {}
+    virtual ~Index() = default;
+    Index(const Index&) = delete;
+    Index& operator=(const Index&) = delete;
+
+    virtual IndexType type() const = 0;
+    virtual void add(const std::string& id, const DocumentWrapper& doc) = 0;
+    virtual void remove(const std::string& id, const DocumentWrapper& doc) = 0;
+    virtual void clear() = 0;
+
+    // добавляет в result id документов, у которых поле == value
+    virtual void lookup(const Document& value, IdSet& result) const = 0;
+    virtual size_t countOf(const Document& value) const = 0;
+    virtual size_t distinctValues() const = 0;
+    // память под списки id и узлы индекса
+    virtual AllocatorStats memoryStats() const = 0;
+
+    // [[значение, [id...]], ...]
+    virtual Document toJson() const = 0;
+    virtual void fromJson(const Document& entries_json) = 0;
+
+    const std::string& getField() const { return field; }
+    static const char* typeName(IndexType type);
+    // есть ли в значении (и во вложенных) беззнаковое число больше INT64_MAX
+    static bool hasWideUnsigned(const Document& value);
+    // пока есть широкие значения, выборка по индексу может разойтись с полным обходом
+    bool hasWideValues() const { return wide_values.size() > 0; }
+};
+
+class HashIndex : public Index {
+private:
+    SlabAllocator memory;                       // списки id, освобождаются разом в clear()
+    HashMap<std::string, PostingSet*> entries;  // ключ - каноничная запись значения
+
+public:
+    HashIndex(const std::string& field_name);
+    ~HashIndex();
+
+    // ключ, одинаковый для значений, равных по ==  (1 и 1.0 дают один ключ)
+    static std::string keyOf(const Document& value);
+
+    IndexType type() const override { return IndexType::Hash; }
+    void add(const std::string& id, const DocumentWrapper& doc) override;
+    void remove(const std::string& id, const DocumentWrapper& doc) override;
+    void clear() override;
+
+    void lookup(const Document& value, IdSet& result) const override;
+    size_t countOf(const Document& value) const override;
+    size_t distinctValues() const override;
+    AllocatorStats memoryStats() const override;
+
+    Document toJson() const override;
+    void fromJson(const Document& entries_json) override;
+};
+
+// узел списка с пропусками: одно значение поля и все документы с ним
+struct OrderedIndexNode {
+    Document key;
+    PostingSet ids;
+    Vector<OrderedIndexNode*> next;  // next[i] - следующий узел на уровне i
+
+    OrderedIndexNode(const Document& k, size_t levels, SlabAllocator* memory)
+        : key(k), ids(1, memory), next(levels, nullptr) {}
+};
+
+// упорядоченный индекс на списке с пропусками, порядок ключей - operator< из nlohmann::json
+class OrderedIndex : public Index {
+private:
+    static const size_t MAX_LEVEL = 24;
+
+    SlabAllocator memory;    // узлы и их списки id, освобождаются разом в clear()
+    OrderedIndexNode* head;  // фиктивный узел без ключа
+    size_t level_count;      // сколько уровней сейчас используется
+    size_t node_count;
+    std::mt19937 level_gen;
+
+    size_t randomLevel();
+    OrderedIndexNode* createNode(const Document& key, size_t levels);
+    void destroyNode(OrderedIndexNode* node);
+    // последний узел с ключом < key на каждом уровне
+    OrderedIndexNode* findPredecessors(const Document& key, OrderedIndexNode** update) const;
+    OrderedIndexNode* findNode(const Document& key) const;
+    OrderedIndexNode* firstInRange(const RangeBounds& bounds) const;
+    void insertId(const Document& key, const std::string& id);
+    void eraseId(const Document& key, const std::string& id);
+
+public:
+    OrderedIndex(const std::string& field_name);
+    ~OrderedIndex();
+
+    IndexType type() const override { return IndexType::Ordered; }
+    void add(const std::string& id, const DocumentWrapper& doc) override;
+    void remove(const std::string& id, const DocumentWrapper& doc) override;
+    void clear() override;
+
+    void lookup(const Document& value, IdSet& result) const override;
+    size_t countOf(const Document& value) const override;
+    size_t distinctValues() const override;
+    AllocatorStats memoryStats() const override;
+
+    // id документов из диапазона в порядке возрастания значения поля
+    void range(const RangeBounds& bounds, Vector<std::string>& result) const;
+    // число документов в диапазоне, подсчёт останавливается на limit
+    size_t countRange(const RangeBounds& bounds, size_t limit) const;
+
+    Document toJson() const override;
+    void fromJson(const Document& entries_json) override;
+};
+
+#endif
\ No newline at end of file
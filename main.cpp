@@ -1,5 +1,13 @@
+#include "aggregate.h"
+#include "client.h"
 #include "database.h"
 #include "parser.h"
+#include "planner.h"
+#include "server.h"
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
 
@@ -10,34 +18,261 @@ void printUsage() {
     std::cout << "  insert [collection] <json_document>    - Insert document (default collection: 'default')" << std::endl;
     std::cout << "  find [collection] <query_json>         - Find documents (default collection: 'default')" << std::endl;
     std::cout << "  delete [collection] <query_json>       - Delete documents (default collection: 'default')" << std::endl;
+    std::cout << "  count [collection] <query_json>        - Count matching documents" << std::endl;
+    std::cout << "  explain [collection] <query_json>      - Run query and show the chosen plan" << std::endl;
+    std::cout << "  aggregate [collection] <pipeline_json> - Run $match/$group/$count pipeline in one pass" << std::endl;
+    std::cout << "  import [collection] <file|->           - Import newline-delimited JSON from file or stdin" << std::endl;
+    std::cout << "  export [collection] <file|->           - Export collection as JSON to file or stdout" << std::endl;
+    std::cout << "  create_index [collection] <field> [--ordered] - Create hash (or ordered) index on field" << std::endl;
+    std::cout << "  drop_index [collection] <field>        - Drop index on field" << std::endl;
+    std::cout << "  checkpoint [collection]               - Write snapshot and truncate the operation log" << std::endl;
+    std::cout << "  create_sharded <collection> <shards>  - Create collection split into shards by _id hash" << std::endl;
     std::cout << "  stats                                 - Show database statistics" << std::endl;
     std::cout << std::endl;
+    std::cout << "Server mode:" << std::endl;
+    std::cout << "  ./no_sql_dbms serve <database> --socket <path> [--workers <n>]  - Keep database in memory and serve requests" << std::endl;
+    std::cout << "  ./no_sql_dbms client --socket <path> <command> [collection] <json> - Send insert/find/count/aggregate/delete/stats to a server" << std::endl;
+    std::cout << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --threads <n>                         - Threads for full scans (default: all cores)" << std::endl;
+    std::cout << "  --batch-size <n>                      - Documents per output batch for find (default: 100)" << std::endl;
+    std::cout << "  --socket <path>                       - Unix socket of the server (serve/client)" << std::endl;
+    std::cout << "  --workers <n>                         - Request worker threads of the server (default: all cores)" << std::endl;
+    std::cout << "  --limit <n>                           - find: return at most n documents" << std::endl;
+    std::cout << "  --skip <n>                            - find: skip the first n matches" << std::endl;
+    std::cout << "  --fields <a,b|-a,-b>                  - find: return only these fields (or all but '-' ones)" << std::endl;
+    std::cout << "  --sort <a,-b>                         - find: order by fields, '-' for descending" << std::endl;
+    std::cout << "  --sort-memory <mb>                    - find: memory for sorting before spilling to temp files (default: 64)" << std::endl;
+    std::cout << "  --durability <none|batched|strict>    - When writes are acknowledged: OS buffer, shared fsync, own fsync (default: none)" << std::endl;
+    std::cout << "  --sync-interval <ms>                  - batched: longest wait for a group fsync (default: 10)" << std::endl;
+    std::cout << std::endl;
     std::cout << "Examples:" << std::endl;
     std::cout << "  ./no_sql_dbms mydb insert '{\"name\": \"Alice\"}'          # Default collection" << std::endl;
     std::cout << "  ./no_sql_dbms mydb insert users '{\"name\": \"Alice\"}'    # Specific collection" << std::endl;
     std::cout << "  ./no_sql_dbms mydb find '{\"age\": 25}'                    # Default collection" << std::endl;
     std::cout << "  ./no_sql_dbms mydb find users '{\"age\": 25}'              # Specific collection" << std::endl;
+    std::cout << "  ./no_sql_dbms mydb find users '{}' --limit 20 --fields name,age  # First 20, two fields" << std::endl;
+    std::cout << "  ./no_sql_dbms mydb find users '{}' --sort -age,name --limit 10  # Ten oldest" << std::endl;
+    std::cout << "  ./no_sql_dbms mydb aggregate users '[{\"$group\": {\"_id\": \"$city\", \"n\": {\"$count\": {}}}}]'  # Per-city counts" << std::endl;
+    std::cout << "  ./no_sql_dbms mydb import users users.ndjson               # Bulk import" << std::endl;
     std::cout << "  ./no_sql_dbms mydb stats                                   # Database stats" << std::endl;
 }
 
+// вынимает "--name value" из аргументов, остальные аргументы сдвигаются
+bool takeOption(int& argc, char* argv[], const std::string& name, std::string& value) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (name == argv[i]) {
+            value = argv[i + 1];
+            for (int j = i; j + 2 < argc; ++j) {
+                argv[j] = argv[j + 2];
+            }
+            argc -= 2;
+            return true;
+        }
+    }
+    return false;
+}
+
 // функция для определения, является ли аргумент названием коллекции
 bool looksLikeCollectionName(const std::string& arg) {
     if (arg.empty()) return false;
-    if (arg[0] == '{') return false; // это JSON
-    if (arg == "insert" || arg == "find" || arg == "delete" || arg == "stats") return false;
+    if (arg[0] == '{' || arg[0] == '[') return false; // это JSON
+    if (arg == "insert" || arg == "find" || arg == "delete" || arg == "count" || arg == "explain" || arg == "aggregate" || arg == "import" || arg == "export" || arg == "checkpoint" ||
+        arg == "create_index" || arg == "drop_index" || arg == "create_sharded" || arg == "stats") return false;
     return true;
 }
 
+Server* active_server = nullptr;
+
+void stopServer(int) {
+    if (active_server != nullptr) {
+        active_server->stop();
+    }
+}
+
+// отправляет одну команду работающему серверу и печатает ответ как обычный CLI
+int runClient(int argc, char* argv[], const std::string& socket_path, const Document& find_options,
+              const Document& write_options) {
+    if (argc < 3 || argc > 5 || socket_path.empty()) {
+        std::cout << "Usage: ./no_sql_dbms client --socket <path> <command> [collection] <json>" << std::endl;
+        return 1;
+    }
+    std::string command = argv[2];
+    std::string collection_name = "default";
+    std::string argument;
+    if (argc == 4) {
+        argument = argv[3];
+    } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+        collection_name = argv[3];
+        argument = argv[4];
+    } else if (argc == 5) {
+        std::cerr << "Error: " << command << " requires <json> or <collection> <json>" << std::endl;
+        return 1;
+    }
+    Document payload = Document::object();
+    if (!argument.empty()) {
+        try {
+            payload = Document::parse(argument);
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid JSON: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    Client client;
+    if (!client.connect(socket_path)) {
+        return 1;
+    }
+    Document response;
+    bool sent = false;
+    if (command == "insert") {
+        sent = client.insert(collection_name, payload, response, write_options);
+    } else if (command == "find") {
+        sent = client.find(collection_name, payload, response, find_options);
+    } else if (command == "count") {
+        sent = client.count(collection_name, payload, response);
+    } else if (command == "aggregate") {
+        sent = client.aggregate(collection_name, payload, response);
+    } else if (command == "delete") {
+        sent = client.remove(collection_name, payload, response, write_options);
+    } else if (command == "stats") {
+        sent = client.stats(response);
+    } else {
+        std::cerr << "Unknown client command: " << command << std::endl;
+        return 1;
+    }
+    if (!sent) {
+        std::cerr << "Connection to server lost." << std::endl;
+        return 1;
+    }
+    if (!response.value("ok", false)) {
+        std::cerr << "Server error: " << response.value("error", std::string("unknown")) << std::endl;
+        return 1;
+    }
+
+    if (command == "insert") {
+        std::cout << "Inserted " << response["inserted"].get<size_t>() << " documents into collection '" << collection_name << "'." << std::endl;
+    } else if (command == "find") {
+        const Document& documents = response["documents"];
+        for (auto it = documents.begin(); it != documents.end(); ++it) {
+            std::cout << it->dump() << '\n';
+        }
+        if (documents.empty()) {
+            std::cout << "No documents found in collection '" << collection_name << "'." << std::endl;
+        } else {
+            std::cout << "Found " << documents.size() << " documents in collection '" << collection_name << "'." << std::endl;
+        }
+    } else if (command == "aggregate") {
+        const Document& documents = response["documents"];
+        for (auto it = documents.begin(); it != documents.end(); ++it) {
+            std::cout << it->dump() << '\n';
+        }
+        std::cout << "Aggregated into " << documents.size() << " documents in collection '" << collection_name << "'." << std::endl;
+    } else if (command == "count") {
+        std::cout << "Counted " << response["count"].get<size_t>() << " documents in collection '" << collection_name << "'." << std::endl;
+    } else if (command == "delete") {
+        std::cout << "Deleted " << response["deleted"].get<size_t>() << " documents from collection '" << collection_name << "' in "
+                  << response["elapsed_ms"].get<double>() << " ms." << std::endl;
+    } else {
+        const Document& server = response["server"];
+        std::cout << response["stats"].get<std::string>();
+        std::cout << "Server: " << server["connections"] << " connections, " << server["requests"] << " requests, "
+                  << server["errors"] << " errors, durability " << server["durability"].get<std::string>() << std::endl;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
+    ScanOptions scan_options;
+    std::string option_value;
+    if (takeOption(argc, argv, "--threads", option_value)) {
+        scan_options.threads = std::strtoul(option_value.c_str(), nullptr, 10);
+    }
+    size_t batch_size = Cursor::DEFAULT_BATCH_SIZE;
+    if (takeOption(argc, argv, "--batch-size", option_value)) {
+        batch_size = std::strtoul(option_value.c_str(), nullptr, 10);
+    }
+    std::string socket_path;
+    takeOption(argc, argv, "--socket", socket_path);
+    size_t worker_count = 0;
+    if (takeOption(argc, argv, "--workers", option_value)) {
+        worker_count = std::strtoul(option_value.c_str(), nullptr, 10);
+    }
+    // параметры find; для клиента они же уходят серверу
+    FindOptions find_options;
+    Document client_options = Document::object();
+    if (takeOption(argc, argv, "--limit", option_value)) {
+        find_options.limit = std::strtoul(option_value.c_str(), nullptr, 10);
+        client_options["limit"] = find_options.limit;
+    }
+    if (takeOption(argc, argv, "--skip", option_value)) {
+        find_options.skip = std::strtoul(option_value.c_str(), nullptr, 10);
+        client_options["skip"] = find_options.skip;
+    }
+    if (takeOption(argc, argv, "--fields", option_value)) {
+        if (!find_options.setFields(option_value)) {
+            return 1;
+        }
+        client_options["fields"] = option_value;
+    }
+    if (takeOption(argc, argv, "--sort", option_value)) {
+        if (!find_options.setSort(option_value)) {
+            return 1;
+        }
+        client_options["sort"] = option_value;
+    }
+    if (takeOption(argc, argv, "--sort-memory", option_value)) {
+        find_options.sort_memory = std::strtoul(option_value.c_str(), nullptr, 10) * 1024 * 1024;
+    }
+    // режим подтверждения изменений; клиент передаёт его серверу в insert/delete
+    DurabilityOptions durability;
+    Document write_options = Document::object();
+    if (takeOption(argc, argv, "--durability", option_value)) {
+        if (!durability.setMode(option_value)) {
+            return 1;
+        }
+        write_options["durability"] = option_value;
+    }
+    if (takeOption(argc, argv, "--sync-interval", option_value)) {
+        durability.batch_interval_ms = std::strtoll(option_value.c_str(), nullptr, 10);
+    }
+    if (argc >= 2 && std::string(argv[1]) == "client") {
+        return runClient(argc, argv, socket_path, client_options, write_options);
+    }
     if (argc < 3) {
         printUsage();
         return 1;
     }
+    if (std::string(argv[1]) == "serve") {
+        if (socket_path.empty()) {
+            std::cerr << "Error: serve requires --socket <path>" << std::endl;
+            return 1;
+        }
+        try {
+            Database db(argv[2]);
+            db.setScanOptions(scan_options);
+            db.setDurability(durability);
+            Server server(db, socket_path, worker_count);
+            active_server = &server;
+            std::signal(SIGINT, stopServer);
+            std::signal(SIGTERM, stopServer);
+            bool ok = server.run();
+            active_server = nullptr;
+            // журнал и так на диске, контрольная точка ускоряет следующий запуск
+            db.saveAllCollections();
+            return ok ? 0 : 1;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
     std::string database_name = argv[1];
     std::string command = argv[2];
 
     try {
         Database db(database_name);
+        db.setScanOptions(scan_options);
+        db.setDurability(durability);
         if (command == "insert") {
             std::string collection_name;
             std::string json_document;
@@ -55,9 +290,11 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
-            Collection& collection = db.getCollection(collection_name);
-            if (collection.insert(json_document)) {
+            bool inserted = db.isSharded(collection_name) ? db.getShardedCollection(collection_name).insert(json_document)
+                                                          : db.getCollection(collection_name).insert(json_document);
+            if (inserted) {
                 std::cout << "Document inserted successfully into collection '" << collection_name << "'." << std::endl;
+                db.maybeCheckpoint(collection_name);
             } else {
                 std::cerr << "Failed to insert document." << std::endl;
                 return 1;
@@ -77,16 +314,59 @@ int main(int argc, char* argv[]) {
                 return 1;
             }
             
-            Collection& collection = db.getCollection(collection_name);
-            auto results = collection.find(query_json);
+            // документы печатаются пачками по мере нахождения, без копии всего результата
+            // обход останавливается после skip+limit совпадений
+            QueryParser parser;
+            ParsedQuery query = parser.parse(query_json);
+            size_t found = 0;
+            if (db.isSharded(collection_name)) {
+                // части ищут параллельно, результат собирается целиком
+                ShardedCollection& collection = db.getShardedCollection(collection_name);
+                auto print = [&found](const DocumentWrapper& doc) {
+                    std::cout << doc.toJson() << '\n';
+                    found++;
+                };
+                if (!find_options.sort.empty()) {
+                    if (!collection.findSorted(query, find_options, print)) {
+                        return 1;
+                    }
+                } else {
+                    Vector<DocumentWrapper> results = collection.find(query, find_options);
+                    for (size_t i = 0; i < results.size(); ++i) {
+                        print(results[i]);
+                    }
+                }
+            } else if (!find_options.sort.empty()) {
+                Collection& collection = db.getCollection(collection_name);
+                // сортированный результат тоже печатается по мере слияния, целиком в памяти не держится
+                bool sorted = collection.findSorted(query, find_options, [&found](const DocumentWrapper& doc) {
+                    std::cout << doc.toJson() << '\n';
+                    found++;
+                });
+                if (!sorted) {
+                    return 1;
+                }
+            } else {
+                Collection& collection = db.getCollection(collection_name);
+                Cursor cursor = collection.findCursor(query, find_options, batch_size);
+                Vector<const DocumentWrapper*> batch;
+                while (cursor.nextBatch(batch) > 0) {
+                    for (size_t i = 0; i < batch.size(); ++i) {
+                        if (find_options.hasProjection()) {
+                            std::cout << find_options.project(*batch[i]).toJson() << '\n';
+                        } else {
+                            std::cout << batch[i]->toJson() << '\n';
+                        }
+                    }
+                    std::cout.flush();
+                }
+                found = cursor.count();
+            }
             
-            if (results.empty()) {
+            if (found == 0) {
                 std::cout << "No documents found in collection '" << collection_name << "'." << std::endl;
             } else {
-                std::cout << "Found " << results.size() << " documents in collection '" << collection_name << "':" << std::endl;
-                for (size_t i = 0; i < results.size(); ++i) {
-                    std::cout << results[i].toJson() << std::endl;
-                }
+                std::cout << "Found " << found << " documents in collection '" << collection_name << "'." << std::endl;
             }
             
         } else if (command == "delete") {
@@ -103,10 +383,208 @@ int main(int argc, char* argv[]) {
                 std::cout << "Usage: ./no_sql_dbms <database> delete [collection] <query_json>" << std::endl;
                 return 1;
             }
-            Collection& collection = db.getCollection(collection_name);
-            size_t deleted_count = collection.remove(query_json);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            size_t deleted_count = 0;
+            if (db.isSharded(collection_name)) {
+                QueryParser parser;
+                deleted_count = db.getShardedCollection(collection_name).remove(parser.parse(query_json));
+            } else {
+                deleted_count = db.getCollection(collection_name).remove(query_json);
+            }
+            double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
             
-            std::cout << "Deleted " << deleted_count << " documents from collection '" << collection_name << "'." << std::endl;
+            std::cout << "Deleted " << deleted_count << " documents from collection '" << collection_name << "' in "
+                      << elapsed_ms << " ms." << std::endl;
+            db.maybeCheckpoint(collection_name);
+        } else if (command == "count") {
+            std::string collection_name;
+            std::string query_json;
+            if (argc == 4) {
+                collection_name = "default";
+                query_json = argv[3];
+            } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+                collection_name = argv[3];
+                query_json = argv[4];
+            } else {
+                std::cerr << "Error: count requires <query_json> or <collection> <query_json>" << std::endl;
+                std::cout << "Usage: ./no_sql_dbms <database> count [collection] <query_json>" << std::endl;
+                return 1;
+            }
+            size_t counted = 0;
+            if (db.isSharded(collection_name)) {
+                QueryParser parser;
+                counted = db.getShardedCollection(collection_name).count(parser.parse(query_json));
+            } else {
+                counted = db.getCollection(collection_name).count(query_json);
+            }
+            std::cout << "Counted " << counted << " documents in collection '" << collection_name << "'." << std::endl;
+        } else if (command == "explain") {
+            std::string collection_name;
+            std::string query_json;
+            if (argc == 4) {
+                collection_name = "default";
+                query_json = argv[3];
+            } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+                collection_name = argv[3];
+                query_json = argv[4];
+            } else {
+                std::cerr << "Error: explain requires <query_json> or <collection> <query_json>" << std::endl;
+                std::cout << "Usage: ./no_sql_dbms <database> explain [collection] <query_json>" << std::endl;
+                return 1;
+            }
+            if (db.isSharded(collection_name)) {
+                std::cerr << "Error: explain is not supported for sharded collection '" << collection_name << "'" << std::endl;
+                return 1;
+            }
+            Collection& collection = db.getCollection(collection_name);
+            QueryPlan plan = collection.explain(query_json);
+            std::cout << plan.explain();
+        } else if (command == "aggregate") {
+            std::string collection_name;
+            std::string pipeline_json;
+            if (argc == 4) {
+                collection_name = "default";
+                pipeline_json = argv[3];
+            } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+                collection_name = argv[3];
+                pipeline_json = argv[4];
+            } else {
+                std::cerr << "Error: aggregate requires <pipeline_json> or <collection> <pipeline_json>" << std::endl;
+                std::cout << "Usage: ./no_sql_dbms <database> aggregate [collection] <pipeline_json>" << std::endl;
+                return 1;
+            }
+            AggregationPipeline pipeline;
+            if (!pipeline.parse(pipeline_json)) {
+                return 1;
+            }
+            Vector<DocumentWrapper> results = db.isSharded(collection_name) ? db.getShardedCollection(collection_name).aggregate(pipeline)
+                                                                            : db.getCollection(collection_name).aggregate(pipeline);
+            for (size_t i = 0; i < results.size(); ++i) {
+                std::cout << results[i].toJson() << '\n';
+            }
+            std::cout << "Aggregated into " << results.size() << " documents in collection '" << collection_name << "'." << std::endl;
+        } else if (command == "import") {
+            std::string collection_name;
+            std::string source;
+            if (argc == 4) {
+                collection_name = "default";
+                source = argv[3];
+            } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+                collection_name = argv[3];
+                source = argv[4];
+            } else {
+                std::cerr << "Error: import requires <file|-> or <collection> <file|->" << std::endl;
+                std::cout << "Usage: ./no_sql_dbms <database> import [collection] <file|->" << std::endl;
+                return 1;
+            }
+            std::ifstream file;
+            if (source != "-") {
+                file.open(source);
+                if (!file.is_open()) {
+                    std::cerr << "Cannot open file: " << source << std::endl;
+                    return 1;
+                }
+            }
+            std::istream& input = source == "-" ? std::cin : file;
+            size_t imported = db.isSharded(collection_name) ? db.getShardedCollection(collection_name).importNdjson(input)
+                                                            : db.getCollection(collection_name).importNdjson(input);
+            std::cout << "Imported " << imported << " documents into collection '" << collection_name << "'." << std::endl;
+        } else if (command == "export") {
+            std::string collection_name;
+            std::string target;
+            if (argc == 4) {
+                collection_name = "default";
+                target = argv[3];
+            } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+                collection_name = argv[3];
+                target = argv[4];
+            } else {
+                std::cerr << "Error: export requires <file|-> or <collection> <file|->" << std::endl;
+                std::cout << "Usage: ./no_sql_dbms <database> export [collection] <file|->" << std::endl;
+                return 1;
+            }
+            bool sharded = db.isSharded(collection_name);
+            auto exportTo = [&](std::ostream& out) {
+                return sharded ? db.getShardedCollection(collection_name).exportToJson(out)
+                               : db.getCollection(collection_name).exportToJson(out);
+            };
+            if (target == "-") {
+                if (!exportTo(std::cout)) {
+                    return 1;
+                }
+            } else {
+                std::ofstream output(target);
+                if (!output.is_open() || !exportTo(output)) {
+                    std::cerr << "Cannot export to file: " << target << std::endl;
+                    return 1;
+                }
+                size_t exported = sharded ? db.getShardedCollection(collection_name).size() : db.getCollection(collection_name).size();
+                std::cout << "Exported " << exported << " documents from collection '" << collection_name << "' to " << target << "." << std::endl;
+            }
+        } else if (command == "create_index" || command == "drop_index") {
+            std::string collection_name;
+            std::string field;
+            IndexType index_type = IndexType::Hash;
+            if (command == "create_index" && std::string(argv[argc - 1]) == "--ordered") {
+                index_type = IndexType::Ordered;
+                argc--;
+            }
+            if (argc == 4) {
+                collection_name = "default";
+                field = argv[3];
+            } else if (argc == 5 && looksLikeCollectionName(argv[3])) {
+                collection_name = argv[3];
+                field = argv[4];
+            } else {
+                std::cerr << "Error: " << command << " requires <field> or <collection> <field>" << std::endl;
+                std::cout << "Usage: ./no_sql_dbms <database> " << command << " [collection] <field>" << std::endl;
+                return 1;
+            }
+            bool sharded = db.isSharded(collection_name);
+            if (command == "create_index") {
+                bool created = sharded ? db.getShardedCollection(collection_name).createIndex(field, index_type)
+                                       : db.getCollection(collection_name).createIndex(field, index_type);
+                if (!created) {
+                    return 1;
+                }
+                std::cout << "Index on '" << field << "' (" << Index::typeName(index_type) << ") created in collection '" << collection_name << "'." << std::endl;
+            } else {
+                bool dropped = sharded ? db.getShardedCollection(collection_name).dropIndex(field)
+                                       : db.getCollection(collection_name).dropIndex(field);
+                if (!dropped) {
+                    return 1;
+                }
+                std::cout << "Index on '" << field << "' dropped from collection '" << collection_name << "'." << std::endl;
+            }
+        } else if (command == "checkpoint") {
+            bool ok = false;
+            if (argc == 3) {
+                ok = db.saveAllCollections();
+            } else if (argc == 4) {
+                if (!db.collectionExists(argv[3])) {
+                    std::cerr << "Collection '" << argv[3] << "' does not exist." << std::endl;
+                    return 1;
+                }
+                ok = db.isSharded(argv[3]) ? db.getShardedCollection(argv[3]).saveToFile() : db.getCollection(argv[3]).saveToFile();
+            } else {
+                std::cout << "Usage: ./no_sql_dbms <database> checkpoint [collection]" << std::endl;
+                return 1;
+            }
+            if (!ok) {
+                std::cerr << "Checkpoint failed." << std::endl;
+                return 1;
+            }
+            std::cout << "Checkpoint completed." << std::endl;
+        } else if (command == "create_sharded") {
+            if (argc != 5) {
+                std::cout << "Usage: ./no_sql_dbms <database> create_sharded <collection> <shards>" << std::endl;
+                return 1;
+            }
+            if (!db.createShardedCollection(argv[3], std::strtoul(argv[4], nullptr, 10))) {
+                return 1;
+            }
+        } else if (command == "stats") {
+            db.printStats();
         } else {
             std::cerr << "Unknown command: " << command << std::endl;
             printUsage();
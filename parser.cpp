@@ -1,122 +1,125 @@
 #include "parser.h"
+#include "predicate.h"
 #include <iostream>
 
 bool QueryCondition::matches(const DocumentWrapper& doc) const {
-    if (!doc.hasField(field)) {
-        return false;
-    }
-    try {
-        if (operator_ == "$eq" || operator_ == "") {
-            return doc.getField<Document>(field) == value;
-            
-        } else if (operator_ == "$like") {
-            std::string field_value = doc.getField<std::string>(field);
-            std::string pattern = value.get<std::string>();
-            return matchLikePattern(field_value, pattern);
-            
-        } else if (operator_ == "$in") {
-            return matchInCondition(doc);
-            
-        } else {
-            return matchComparison(doc); // операторы сравнения
-        }
-        
-    } catch (const std::exception& e) {
-        std::cerr << "Error comparing field '" << field << "': " << e.what() << std::endl;
-        return false;
-    }
+    return Predicate::compile(*this).matches(doc);
 }
 
-bool QueryCondition::matchLikePattern(const std::string& field_value, const std::string& pattern) const {
-    return matchSimplePattern(field_value, pattern, 0, 0); // рекурсия для простого сравнения
+bool ParsedQuery::matches(const DocumentWrapper& doc) const {
+    return Predicate::compile(*this).matches(doc);
 }
 
-bool QueryCondition::matchSimplePattern(const std::string& text, const std::string& pattern, size_t text_pos, size_t pattern_pos) const {
-    if (pattern_pos == pattern.length()) {
-        return text_pos == text.length();
-    }
-    char pattern_char = pattern[pattern_pos];
-    if (pattern_char == '%') {
-        // пробуем все возможные позиции, начиная с текущей
-        for (size_t i = text_pos; i <= text.length(); ++i) {
-            if (matchSimplePattern(text, pattern, i, pattern_pos + 1)) {
-                return true;
-            }
+bool FindOptions::setFields(const std::string& list) {
+    fields.clear();
+    exclude_fields = false;
+    bool has_include = false;
+    bool has_exclude = false;
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
         }
-        return false;
-    } 
-    else if (pattern_char == '_') {
-        // хотя бы один символ в тексте
-        if (text_pos < text.length()) {
-            return matchSimplePattern(text, pattern, text_pos + 1, pattern_pos + 1);
+        std::string field = list.substr(start, comma - start);
+        start = comma + 1;
+        if (field.empty()) {
+            continue;
         }
-        return false;
-    }
-    else {
-        // обычный символ - должен точно совпадать
-        if (text_pos < text.length() && text[text_pos] == pattern_char) {
-            return matchSimplePattern(text, pattern, text_pos + 1, pattern_pos + 1);
+        if (field[0] == '-') {
+            field.erase(0, 1);
+            has_exclude = true;
+        } else {
+            has_include = true;
+        }
+        if (field.empty()) {
+            continue;
         }
+        fields.push_back(field);
+    }
+    if (has_include && has_exclude) {
+        std::cerr << "Projection cannot mix included and excluded fields: " << list << std::endl;
+        fields.clear();
         return false;
     }
+    exclude_fields = has_exclude;
+    return true;
 }
 
-bool QueryCondition::matchInCondition(const DocumentWrapper& doc) const {
-    if (!value.is_array()) {
-        return false;
-    }
-    try {
-        Document field_value = doc.getField<Document>(field);
-        // ручной перебор элементов массива
-        for (auto it = value.begin(); it != value.end(); ++it) {
-            if (*it == field_value) {
-                return true;
-            }
+bool FindOptions::setSort(const std::string& list) {
+    sort.clear();
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
         }
-        return false;
-    } catch (const std::exception& e) {
+        SortKey key;
+        key.field = list.substr(start, comma - start);
+        start = comma + 1;
+        if (!key.field.empty() && key.field[0] == '-') {
+            key.field.erase(0, 1);
+            key.descending = true;
+        }
+        if (key.field.empty()) {
+            continue;
+        }
+        sort.push_back(key);
+    }
+    if (sort.empty() && !list.empty()) {
+        std::cerr << "Invalid sort specification: " << list << std::endl;
         return false;
     }
+    return true;
 }
 
-bool QueryCondition::matchComparison(const DocumentWrapper& doc) const {
-    try {
-        Document field_value = doc.getField<Document>(field);
-        
-        if (operator_ == "$gt") {
-            return field_value > value;
-        } else if (operator_ == "$lt") {
-            return field_value < value;
-        } else if (operator_ == "$gte") {
-            return field_value >= value;
-        } else if (operator_ == "$lte") {
-            return field_value <= value;
-        } else if (operator_ == "$ne") {
-            return field_value != value;
-        }
-    } catch (const std::exception& e) {
-        return false;
-    }
-    
-    return false;
+bool FindOptions::hasProjection() const {
+    return !fields.empty();
 }
 
-bool ParsedQuery::matches(const DocumentWrapper& doc) const {
-    if (has_or_operator) {
-        for (size_t i = 0; i < or_conditions.size(); ++i) {
-            if (or_conditions[i].matches(doc)) {
-                return true;
-            }
+size_t FindOptions::matchesNeeded() const {
+    return limit == 0 ? 0 : skip + limit;
+}
+
+DocumentWrapper FindOptions::project(const DocumentWrapper& doc) const {
+    if (fields.empty() || (!doc.isCompact() && !doc.getRawDocument().is_object())) {
+        return doc;
+    }
+    Document result = Document::object();
+    if (!exclude_fields) {
+        // копируются только запрошенные поля, остальной документ не трогается
+        Document scratch;
+        const Document* id = doc.findField("_id", scratch);
+        if (id != nullptr) {
+            result["_id"] = *id;
         }
-        return false;
-    } else {
-        for (size_t i = 0; i < conditions.size(); ++i) {
-            if (!conditions[i].matches(doc)) {
-                return false;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            const Document* value = doc.findField(fields[i], scratch);
+            if (value != nullptr) {
+                result[fields[i]] = *value;
             }
         }
-        return true;
+        return DocumentWrapper(std::move(result));
+    }
+    if (doc.isCompact()) {
+        // компактный документ разворачивается целиком, исключённые поля из копии убираются
+        result = doc.toDocument();
+        for (size_t i = 0; i < fields.size(); ++i) {
+            result.erase(fields[i]);
+        }
+        return DocumentWrapper(std::move(result));
+    }
+    const Document& source = doc.getRawDocument();
+    for (auto it = source.begin(); it != source.end(); ++it) {
+        bool excluded = false;
+        for (size_t i = 0; i < fields.size() && !excluded; ++i) {
+            excluded = fields[i] == it.key();
+        }
+        if (!excluded) {
+            result[it.key()] = it.value();
+        }
     }
+    return DocumentWrapper(std::move(result));
 }
 
 ParsedQuery QueryParser::parse(const std::string& json_query) const {
@@ -132,6 +135,14 @@ ParsedQuery QueryParser::parse(const std::string& json_query) const {
     return result;
 }
 
+ParsedQuery QueryParser::parse(const Document& query_doc) const {
+    ParsedQuery result;
+    if (query_doc.is_object()) {
+        parseCondition(query_doc, result);
+    }
+    return result;
+}
+
 void QueryParser::parseCondition(const Document& condition_doc, ParsedQuery& result) const {
     // ручной перебор 
     for (auto it = condition_doc.begin(); it != condition_doc.end(); ++it) {
@@ -189,7 +200,7 @@ void QueryParser::parseLogicalOperator(const std::string& op, const Document& op
 bool QueryParser::isComparisonOperator(const std::string& field) const {
     return field == "$eq" || field == "$gt" || field == "$lt" || 
            field == "$gte" || field == "$lte" || field == "$ne" || 
-           field == "$like" || field == "$in";
+           field == "$like" || field == "$ilike" || field == "$in";
 }
 
 bool QueryParser::isLogicalOperator(const std::string& field) const {
@@ -11,13 +11,8 @@ struct QueryCondition {
     Document value;
     
     // проверяет, удовлетворяет ли документ условию (состоит из поле+оерат+знач)
+    // условие каждый раз компилируется; при проверке многих документов - Predicate::compile
     bool matches(const DocumentWrapper& doc) const;
-    
-private:
-    bool matchLikePattern(const std::string& field_value, const std::string& pattern) const;
-    bool matchSimplePattern(const std::string& text, const std::string& pattern, size_t text_pos, size_t pattern_pos) const;
-    bool matchInCondition(const DocumentWrapper& doc) const;
-    bool matchComparison(const DocumentWrapper& doc) const;
 };
 
 struct ParsedQuery { // парсированный запрос
@@ -25,14 +20,42 @@ struct ParsedQuery { // парсированный запрос
     Vector<ParsedQuery> or_conditions; 
     bool has_or_operator = false;
     
-    // проверяет, удовлетворяет ли документ всему запросу
+    // проверяет, удовлетворяет ли документ всему запросу (через Predicate::compile)
     bool matches(const DocumentWrapper& doc) const;
 };
 
+struct SortKey {
+    std::string field;
+    bool descending = false;
+};
+
+// параметры выдачи find: порядок, сколько совпадений пропустить, сколько отдать и какие поля
+struct FindOptions {
+    size_t skip = 0;
+    size_t limit = 0;               // 0 - без ограничения
+    Vector<std::string> fields;     // пусто - документ целиком
+    bool exclude_fields = false;    // fields - убираемые поля, а не оставляемые
+    Vector<SortKey> sort;           // пусто - порядок хранилища
+    size_t sort_memory = 64 * 1024 * 1024;  // сортировка без limit: больше - серии уходят во временные файлы
+    std::string sort_directory;     // куда писать серии, пусто - системный каталог временных файлов
+
+    // список через запятую: "name,age" - только эти поля (и _id), "-email,-password" - все кроме них
+    bool setFields(const std::string& list);
+    // ключи через запятую, "-поле" - по убыванию: "age,-name"
+    bool setSort(const std::string& list);
+    bool hasProjection() const;
+    // после скольких совпадений обход можно остановить, 0 - нужны все
+    size_t matchesNeeded() const;
+    // копия документа только с нужными полями
+    DocumentWrapper project(const DocumentWrapper& doc) const;
+};
+
 class QueryParser {
 public:
     // парсит JSON запрос в структурированный формат
     ParsedQuery parse(const std::string& json_query) const;
+    // запрос, уже разобранный как JSON (например, из сообщения сервера)
+    ParsedQuery parse(const Document& query_doc) const;
     
 private:
     void parseCondition(const Document& condition_doc, ParsedQuery& result) const; 
@@ -0,0 +1,456 @@
+#include "planner.h"
+#include "collection.h"
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+namespace {
+
+// условные стоимости на один документ или id
+const double COST_SCAN = 1.0;   // обход документа при полном сканировании
+const double COST_FETCH = 2.0;  // поиск документа по id
+const double COST_ID = 0.2;     // чтение одного id из индекса
+
+const char* sourceName(PlanSource source) {
+    switch (source) {
+        case PlanSource::FullScan: return "FullScan";
+        case PlanSource::IndexScan: return "IndexScan";
+        case PlanSource::IndexIntersection: return "IndexIntersection";
+        case PlanSource::IndexUnion: return "IndexUnion";
+    }
+    return "";
+}
+
+bool isRangeOperator(const std::string& op) {
+    return op == "$gt" || op == "$gte" || op == "$lt" || op == "$lte";
+}
+
+bool isEqualityOperator(const std::string& op) {
+    return op == "$eq" || op == "";
+}
+
+bool isLikeOperator(const std::string& op) {
+    return op == "$like" || op == "$ilike";
+}
+
+// строки с префиксом prefix лежат в [prefix, upper): последний байт меньше 0xff увеличивается
+bool prefixUpperBound(const std::string& prefix, std::string& upper) {
+    upper = prefix;
+    while (!upper.empty() && static_cast<unsigned char>(upper.back()) == 0xff) {
+        upper.pop_back();
+    }
+    if (upper.empty()) {
+        return false;
+    }
+    upper.back() = static_cast<char>(static_cast<unsigned char>(upper.back()) + 1);
+    return true;
+}
+
+}
+
+void IndexAccess::collect(Vector<std::string>& ids) const {
+    if (is_range) {
+        static_cast<const OrderedIndex*>(index)->range(bounds, ids);
+        return;
+    }
+    IdSet unique_ids;
+    collect(unique_ids);
+    ids = unique_ids.keys();
+}
+
+void IndexAccess::collect(IdSet& ids) const {
+    if (is_range) {
+        Vector<std::string> ordered;
+        static_cast<const OrderedIndex*>(index)->range(bounds, ordered);
+        for (size_t i = 0; i < ordered.size(); ++i) {
+            ids.put(ordered[i], true);
+        }
+        return;
+    }
+    for (size_t i = 0; i < values.size(); ++i) {
+        index->lookup(values[i], ids);
+    }
+}
+
+std::string IndexAccess::describe() const {
+    std::stringstream ss;
+    if (is_range) {
+        ss << "IndexRange " << index->getField() << " ";
+        ss << (bounds.has_low && bounds.low_inclusive ? "[" : "(");
+        ss << (bounds.has_low ? bounds.low.dump() : "-inf") << ", ";
+        ss << (bounds.has_high ? bounds.high.dump() : "+inf");
+        ss << (bounds.has_high && bounds.high_inclusive ? "]" : ")");
+    } else {
+        ss << "IndexLookup " << index->getField() << " in [";
+        for (size_t i = 0; i < values.size(); ++i) {
+            ss << (i > 0 ? ", " : "") << values[i].dump();
+        }
+        ss << "]";
+    }
+    ss << " (" << Index::typeName(index->type()) << ")";
+    return ss.str();
+}
+
+bool PlanBranch::matchesResidual(const DocumentWrapper& doc) const {
+    return filter.matches(doc);
+}
+
+void PlanBranch::collectCandidates(Vector<std::string>& ids) {
+    typedef std::chrono::steady_clock Clock;
+    // первый доступ самый избирательный, его порядок (у диапазона - по значению поля) сохраняется
+    Clock::time_point start = Clock::now();
+    accesses[0].collect(ids);
+    accesses[0].actual_rows = ids.size();
+    accesses[0].elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    for (size_t i = 1; i < accesses.size(); ++i) {
+        start = Clock::now();
+        IdSet other;
+        accesses[i].collect(other);
+        accesses[i].actual_rows = other.size();
+        Vector<std::string> intersection;
+        bool present = false;
+        for (size_t k = 0; k < ids.size(); ++k) {
+            if (other.get(ids[k], present)) {
+                intersection.push_back(ids[k]);
+            }
+        }
+        ids = intersection;
+        accesses[i].elapsed_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+}
+
+double QueryPlanner::conditionCost(const QueryCondition& condition) const {
+    const std::string& op = condition.operator_;
+    if (isEqualityOperator(op) || op == "$ne") {
+        return 1.0;
+    }
+    if (isRangeOperator(op)) {
+        return 1.5;
+    }
+    if (op == "$in") {
+        return 1.0 + 0.5 * (condition.value.is_array() ? condition.value.size() : 1);
+    }
+    if (isLikeOperator(op) && condition.value.is_string()) {
+        return 4.0 + 0.1 * condition.value.get<std::string>().size();
+    }
+    return 2.0;
+}
+
+double QueryPlanner::conditionSelectivity(const QueryCondition& condition, const Collection& collection) const {
+    const std::string& op = condition.operator_;
+    size_t total = collection.size();
+    const Index* index = collection.getIndex(condition.field);
+    if (isEqualityOperator(op)) {
+        if (index != nullptr && total > 0) {
+            return static_cast<double>(index->countOf(condition.value)) / total;
+        }
+        return 0.1;
+    }
+    if (op == "$ne") {
+        return 0.9;
+    }
+    if (isRangeOperator(op)) {
+        return 0.33;
+    }
+    if (op == "$in") {
+        size_t count = condition.value.is_array() ? condition.value.size() : 1;
+        return std::min(1.0, 0.1 * count);
+    }
+    if (isLikeOperator(op)) {
+        return 0.25;
+    }
+    return 0.5;
+}
+
+// сначала дешёвые условия, которые отсеивают больше документов
+void QueryPlanner::orderResidual(Vector<QueryCondition>& conditions, const Collection& collection) const {
+    Vector<double> rank(conditions.size(), 0.0);
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        double rejected = 1.0 - conditionSelectivity(conditions[i], collection);
+        rank[i] = conditionCost(conditions[i]) / (rejected + 0.01);
+    }
+    // вставками: условий в запросе немного, порядок равных сохраняется
+    for (size_t i = 1; i < conditions.size(); ++i) {
+        QueryCondition condition = conditions[i];
+        double value = rank[i];
+        size_t j = i;
+        while (j > 0 && rank[j - 1] > value) {
+            conditions[j] = conditions[j - 1];
+            rank[j] = rank[j - 1];
+            --j;
+        }
+        conditions[j] = condition;
+        rank[j] = value;
+    }
+}
+
+PlanBranch QueryPlanner::planBranch(const ParsedQuery& query, const Collection& collection) const {
+    PlanBranch branch;
+    size_t total = collection.size();
+    if (query.has_or_operator) {
+        // вложенный $or по индексам не разбираем
+        branch.source = PlanSource::FullScan;
+        branch.estimated_rows = total;
+        branch.cost = total * (COST_SCAN + 2.0);
+        return branch;
+    }
+
+    const Vector<QueryCondition>& conditions = query.conditions;
+    Vector<IndexAccess> candidates;
+    Vector<Vector<size_t>> covered;  // какие условия закрывает каждый доступ
+    size_t range_limit = std::max<size_t>(1, total / 4);  // шире - индекс не поможет
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        const QueryCondition& condition = conditions[i];
+        const Index* index = collection.getIndex(condition.field);
+        if (index == nullptr) {
+            continue;
+        }
+        // беззнаковые больше INT64_MAX фильтр сравнивает с целыми после приведения, индекс - нет:
+        // с ними выборка по индексу разошлась бы с полным обходом
+        if (index->hasWideValues() || Index::hasWideUnsigned(condition.value)) {
+            continue;
+        }
+        if (index->type() == IndexType::Ordered && (isRangeOperator(condition.operator_) || isEqualityOperator(condition.operator_))) {
+            bool first_on_field = true;
+            for (size_t j = 0; j < i; ++j) {
+                if (conditions[j].field == condition.field &&
+                    (isRangeOperator(conditions[j].operator_) || isEqualityOperator(conditions[j].operator_))) {
+                    first_on_field = false;
+                    break;
+                }
+            }
+            if (!first_on_field) {
+                continue;  // уже вошло в диапазон по этому полю
+            }
+            // все диапазонные условия по полю сливаются в один проход
+            IndexAccess access;
+            access.index = index;
+            access.is_range = true;
+            Vector<size_t> covers;
+            bool wide_literal = false;
+            for (size_t j = i; j < conditions.size(); ++j) {
+                if (conditions[j].field != condition.field) {
+                    continue;
+                }
+                if ((isRangeOperator(conditions[j].operator_) || isEqualityOperator(conditions[j].operator_)) &&
+                    Index::hasWideUnsigned(conditions[j].value)) {
+                    wide_literal = true;
+                } else if (access.bounds.addCondition(conditions[j].operator_, conditions[j].value)) {
+                    covers.push_back(j);
+                }
+            }
+            if (wide_literal) {
+                continue;
+            }
+            access.estimated_rows = static_cast<const OrderedIndex*>(index)->countRange(access.bounds, range_limit + 1);
+            if (access.estimated_rows > range_limit) {
+                continue;
+            }
+            candidates.push_back(access);
+            covered.push_back(covers);
+        } else if (index->type() == IndexType::Ordered && condition.operator_ == "$like" && condition.value.is_string()) {
+            // литерал в начале шаблона сужает поиск до диапазона строк,
+            // шаблон сложнее abc% остаётся в фильтре
+            LikePattern pattern(condition.value.get<std::string>(), false);
+            IndexAccess access;
+            access.index = index;
+            access.is_range = true;
+            std::string upper;
+            if (pattern.prefix().empty() || !prefixUpperBound(pattern.prefix(), upper)) {
+                continue;
+            }
+            access.bounds.addCondition("$gte", pattern.prefix());
+            access.bounds.addCondition("$lt", upper);
+            access.estimated_rows = static_cast<const OrderedIndex*>(index)->countRange(access.bounds, range_limit + 1);
+            if (access.estimated_rows > range_limit) {
+                continue;
+            }
+            Vector<size_t> covers;
+            if (pattern.isPrefix()) {
+                covers.push_back(i);
+            }
+            candidates.push_back(access);
+            covered.push_back(covers);
+        } else if (isEqualityOperator(condition.operator_) ||
+                   (condition.operator_ == "$in" && condition.value.is_array())) {
+            IndexAccess access;
+            access.index = index;
+            if (condition.operator_ == "$in") {
+                for (auto it = condition.value.begin(); it != condition.value.end(); ++it) {
+                    access.values.push_back(*it);
+                }
+            } else {
+                access.values.push_back(condition.value);
+            }
+            for (size_t v = 0; v < access.values.size(); ++v) {
+                access.estimated_rows += index->countOf(access.values[v]);
+            }
+            Vector<size_t> covers;
+            covers.push_back(i);
+            candidates.push_back(access);
+            covered.push_back(covers);
+        }
+    }
+
+    // стоимость проверки всех условий на одном документе
+    double filter_cost = 0;
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        filter_cost += conditionCost(conditions[i]);
+    }
+    branch.source = PlanSource::FullScan;
+    branch.estimated_rows = total;
+    branch.cost = total * (COST_SCAN + filter_cost);
+
+    Vector<bool> is_covered(conditions.size(), false);
+    if (!candidates.empty()) {
+        // индексы по возрастанию числа кандидатов
+        Vector<size_t> order;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            order.push_back(i);
+        }
+        std::sort(order.begin(), order.end(), [&candidates](size_t a, size_t b) {
+            return candidates[a].estimated_rows < candidates[b].estimated_rows;
+        });
+        const IndexAccess& first = candidates[order[0]];
+        double rows = static_cast<double>(first.estimated_rows);
+        double cost = COST_ID * rows + (COST_FETCH + filter_cost) * rows;
+        Vector<size_t> chosen;
+        chosen.push_back(order[0]);
+        // каждый следующий индекс добавляем, если пересечение дешевле проверки лишних документов
+        for (size_t k = 1; k < order.size() && total > 0; ++k) {
+            const IndexAccess& next = candidates[order[k]];
+            double rows_after = rows * next.estimated_rows / total;
+            double extra = COST_ID * next.estimated_rows;
+            double saved = (rows - rows_after) * (COST_FETCH + filter_cost);
+            if (saved > extra) {
+                cost += extra - saved;
+                rows = rows_after;
+                chosen.push_back(order[k]);
+            }
+        }
+        if (cost < branch.cost) {
+            branch.source = chosen.size() > 1 ? PlanSource::IndexIntersection : PlanSource::IndexScan;
+            branch.cost = cost;
+            branch.estimated_rows = static_cast<size_t>(rows + 0.5);
+            for (size_t k = 0; k < chosen.size(); ++k) {
+                branch.accesses.push_back(candidates[chosen[k]]);
+                const Vector<size_t>& covers = covered[chosen[k]];
+                for (size_t c = 0; c < covers.size(); ++c) {
+                    is_covered[covers[c]] = true;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        if (!is_covered[i]) {
+            branch.residual.push_back(conditions[i]);
+        }
+    }
+    orderResidual(branch.residual, collection);
+    branch.filter = Predicate::compile(branch.residual);
+    return branch;
+}
+
+QueryPlan QueryPlanner::plan(const ParsedQuery& query, const Collection& collection) const {
+    QueryPlan plan;
+    plan.query = query;
+    plan.filter = Predicate::compile(query);
+    plan.collection_size = collection.size();
+    if (!query.has_or_operator) {
+        PlanBranch branch = planBranch(query, collection);
+        plan.source = branch.source;
+        plan.estimated_examined = branch.estimated_rows;
+        plan.cost = branch.cost;
+        plan.branches.push_back(branch);
+        return plan;
+    }
+
+    // $or: объединение индексов, если индекс есть у каждой ветки и это дешевле обхода
+    plan.source = PlanSource::FullScan;
+    plan.estimated_examined = plan.collection_size;
+    plan.cost = plan.collection_size * (COST_SCAN + 2.0 * query.or_conditions.size());
+    Vector<PlanBranch> branches;
+    double union_cost = 0;
+    size_t union_rows = 0;
+    bool all_indexed = !query.or_conditions.empty();
+    for (size_t i = 0; i < query.or_conditions.size() && all_indexed; ++i) {
+        PlanBranch branch = planBranch(query.or_conditions[i], collection);
+        if (branch.source == PlanSource::FullScan) {
+            all_indexed = false;
+            break;
+        }
+        union_cost += branch.cost;
+        union_rows += branch.estimated_rows;
+        branches.push_back(branch);
+    }
+    if (all_indexed && union_cost < plan.cost) {
+        plan.source = PlanSource::IndexUnion;
+        plan.branches = branches;
+        plan.estimated_examined = std::min(union_rows, plan.collection_size);
+        plan.cost = union_cost;
+    }
+    return plan;
+}
+
+void QueryPlan::collectCandidates(Vector<std::string>& ids) {
+    if (source == PlanSource::IndexUnion) {
+        IdSet united;
+        for (size_t b = 0; b < branches.size(); ++b) {
+            Vector<std::string> branch_ids;
+            branches[b].collectCandidates(branch_ids);
+            for (size_t k = 0; k < branch_ids.size(); ++k) {
+                united.put(branch_ids[k], true);
+            }
+        }
+        ids = united.keys();
+    } else if (!branches.empty() && !branches[0].accesses.empty()) {
+        branches[0].collectCandidates(ids);
+    }
+}
+
+bool QueryPlan::accepts(const DocumentWrapper& doc) const {
+    if (source == PlanSource::IndexUnion || query.has_or_operator || branches.empty()) {
+        return filter.matches(doc);
+    }
+    return branches[0].matchesResidual(doc);
+}
+
+std::string QueryPlan::explain() const {
+    std::stringstream ss;
+    ss.setf(std::ios::fixed);
+    ss.precision(3);
+    ss << "Plan: " << sourceName(source) << " (collection size: " << collection_size
+       << ", estimated cost: " << cost << ")" << std::endl;
+    ss << "  Candidates: estimated " << estimated_examined << ", actual " << candidates
+       << ", time " << candidates_ms << " ms" << std::endl;
+    for (size_t b = 0; b < branches.size(); ++b) {
+        const PlanBranch& branch = branches[b];
+        std::string indent = "    ";
+        if (source == PlanSource::IndexUnion) {
+            ss << "    Branch " << b + 1 << ": " << sourceName(branch.source) << std::endl;
+            indent = "      ";
+        }
+        for (size_t i = 0; i < branch.accesses.size(); ++i) {
+            const IndexAccess& access = branch.accesses[i];
+            ss << indent << access.describe() << ": estimated " << access.estimated_rows
+               << ", actual " << access.actual_rows << ", time " << access.elapsed_ms << " ms" << std::endl;
+        }
+        if (source != PlanSource::IndexUnion && !query.has_or_operator) {
+            ss << "  Filter:";
+            if (branch.residual.empty()) {
+                ss << " (none)";
+            }
+            for (size_t i = 0; i < branch.residual.size(); ++i) {
+                ss << (i > 0 ? "," : "") << " " << branch.residual[i].field << " "
+                   << (branch.residual[i].operator_.empty() ? "$eq" : branch.residual[i].operator_)
+                   << " " << branch.residual[i].value.dump();
+            }
+            ss << std::endl;
+        }
+    }
+    if (source == PlanSource::IndexUnion || query.has_or_operator) {
+        ss << "  Filter: full query" << std::endl;
+    }
+    ss << "  Examined: " << examined << ", returned: " << returned << ", time " << filter_ms << " ms" << std::endl;
+    return ss.str();
+}
\ No newline at end of file
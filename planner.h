@@ -0,0 +1,84 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "index.h"
+#include "parser.h"
+#include "predicate.h"
+#include "vector.h"
+#include <string>
+
+class Collection;
+
+// доступ к одному индексу: точные значения ($eq/$in) или диапазон
+struct IndexAccess {
+    const Index* index = nullptr;
+    bool is_range = false;
+    RangeBounds bounds;
+    Vector<Document> values;
+    size_t estimated_rows = 0;
+    size_t actual_rows = 0;
+    double elapsed_ms = 0;
+
+    // id подходящих документов; у диапазона - по возрастанию значения поля
+    void collect(Vector<std::string>& ids) const;
+    void collect(IdSet& ids) const;
+    std::string describe() const;
+};
+
+enum class PlanSource {
+    FullScan,          // обход всей коллекции
+    IndexScan,         // один индекс
+    IndexIntersection, // пересечение нескольких индексов для условий И
+    IndexUnion         // объединение индексов веток $or
+};
+
+// план одной ветки условий И (или всего запроса без $or)
+struct PlanBranch {
+    PlanSource source = PlanSource::FullScan;
+    Vector<IndexAccess> accesses;
+    Vector<QueryCondition> residual;  // непокрытые индексом условия, дешёвые и селективные первыми
+    Predicate filter;                 // residual, скомпилированные в том же порядке
+    size_t estimated_rows = 0;        // сколько документов придётся проверить
+    double cost = 0;
+
+    bool matchesResidual(const DocumentWrapper& doc) const;
+    // кандидаты по индексам ветки (пересечение), с замером каждого доступа
+    void collectCandidates(Vector<std::string>& ids);
+};
+
+struct QueryPlan {
+    PlanSource source = PlanSource::FullScan;
+    Vector<PlanBranch> branches;    // одна ветка, либо по ветке на каждый $or
+    ParsedQuery query;              // исходный запрос: полная проверка для $or
+    Predicate filter;               // скомпилированный query
+    size_t collection_size = 0;
+    size_t estimated_examined = 0;
+    double cost = 0;
+
+    // фактические значения после выполнения
+    size_t candidates = 0;          // документов взято из индексов (или всего при обходе)
+    size_t examined = 0;            // документов проверено фильтром
+    size_t returned = 0;
+    double candidates_ms = 0;
+    double filter_ms = 0;
+
+    // id документов для проверки фильтром (для полного обхода не вызывается)
+    void collectCandidates(Vector<std::string>& ids);
+    // проходит ли документ фильтр: с $or весь запрос, иначе только непокрытые индексами условия
+    bool accepts(const DocumentWrapper& doc) const;
+    std::string explain() const;
+};
+
+// выбирает способ выполнения запроса по размеру коллекции и статистике индексов
+class QueryPlanner {
+public:
+    QueryPlan plan(const ParsedQuery& query, const Collection& collection) const;
+
+private:
+    PlanBranch planBranch(const ParsedQuery& query, const Collection& collection) const;
+    void orderResidual(Vector<QueryCondition>& conditions, const Collection& collection) const;
+    double conditionCost(const QueryCondition& condition) const;
+    double conditionSelectivity(const QueryCondition& condition, const Collection& collection) const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,491 @@
+#include "predicate.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// операторы выражаются через < и == так же, как у nlohmann::json
+template<typename A, typename B>
+bool ordered(PredicateOp op, const A& a, const B& b) {
+    switch (op) {
+        case PredicateOp::Eq:
+            return a == b;
+        case PredicateOp::Ne:
+            return !(a == b);
+        case PredicateOp::Gt:
+            return b < a;
+        case PredicateOp::Gte:
+            return !(a < b);
+        case PredicateOp::Lt:
+            return a < b;
+        case PredicateOp::Lte:
+            return !(b < a);
+        default:
+            return false;
+    }
+}
+
+// составные значения и разные типы - операторами самого json
+bool compareJson(PredicateOp op, const Document& a, const Document& b) {
+    switch (op) {
+        case PredicateOp::Eq:
+            return a == b;
+        case PredicateOp::Ne:
+            return a != b;
+        case PredicateOp::Gt:
+            return a > b;
+        case PredicateOp::Gte:
+            return a >= b;
+        case PredicateOp::Lt:
+            return a < b;
+        case PredicateOp::Lte:
+            return a <= b;
+        default:
+            return false;
+    }
+}
+
+bool isNumeric(LiteralType type) {
+    return type == LiteralType::Integer || type == LiteralType::Unsigned || type == LiteralType::Float;
+}
+
+// числа разных типов приводятся как в nlohmann: к double, если есть дробное, иначе к int64
+// Value - поле дерева (Document) или компактного документа (CompactValue)
+template<typename Value>
+bool compareNumbers(PredicateOp op, const Value& field_value, const PredicateLiteral& literal) {
+    switch (field_value.type()) {
+        case Document::value_t::number_integer: {
+            int64_t a = field_value.template get<int64_t>();
+            if (literal.type == LiteralType::Integer) {
+                return ordered(op, a, literal.integer);
+            }
+            if (literal.type == LiteralType::Unsigned) {
+                return ordered(op, a, static_cast<int64_t>(literal.unsigned_integer));
+            }
+            return ordered(op, static_cast<double>(a), literal.number);
+        }
+        case Document::value_t::number_unsigned: {
+            uint64_t a = field_value.template get<uint64_t>();
+            if (literal.type == LiteralType::Integer) {
+                return ordered(op, static_cast<int64_t>(a), literal.integer);
+            }
+            if (literal.type == LiteralType::Unsigned) {
+                return ordered(op, a, literal.unsigned_integer);
+            }
+            return ordered(op, static_cast<double>(a), literal.number);
+        }
+        default: {
+            double a = field_value.template get<double>();
+            if (literal.type == LiteralType::Integer) {
+                return ordered(op, a, static_cast<double>(literal.integer));
+            }
+            if (literal.type == LiteralType::Unsigned) {
+                return ordered(op, a, static_cast<double>(literal.unsigned_integer));
+            }
+            return ordered(op, a, literal.number);
+        }
+    }
+}
+
+std::string_view textOf(const Document& field_value) {
+    return field_value.get_ref<const std::string&>();
+}
+
+std::string_view textOf(const CompactValue& field_value) {
+    return field_value.text();
+}
+
+// составные значения компактного документа сравниваются развёрнутыми
+const Document& jsonOf(const Document& field_value) {
+    return field_value;
+}
+
+Document jsonOf(const CompactValue& field_value) {
+    return field_value.toDocument();
+}
+
+template<typename Value>
+bool compareLiteral(const PredicateLiteral& literal, PredicateOp op, const Value& field_value) {
+    if (isNumeric(literal.type) && field_value.is_number()) {
+        return compareNumbers(op, field_value, literal);
+    }
+    if (literal.type == LiteralType::String && field_value.is_string()) {
+        return ordered(op, textOf(field_value), literal.text);
+    }
+    return compareJson(op, jsonOf(field_value), literal.value);
+}
+
+template<typename Value>
+bool testValue(const PredicateNode& node, const Value& field_value) {
+    if (node.op == PredicateOp::In) {
+        if (field_value.is_string()) {
+            std::string_view text = textOf(field_value);
+            return std::binary_search(node.in_strings.begin(), node.in_strings.end(), text);
+        }
+        for (size_t i = 0; i < node.in_others.size(); ++i) {
+            if (node.in_others[i].equals(field_value)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    if (node.op == PredicateOp::Like) {
+        // нестроковое поле сравнивается с шаблоном как пустая строка
+        return node.like.matches(field_value.is_string() ? textOf(field_value) : std::string_view());
+    }
+    if (node.op == PredicateOp::Never) {
+        return false;
+    }
+    return node.literal.compare(node.op, field_value);
+}
+
+// условие и остальные условия по тому же полю
+template<typename Value>
+bool testAll(const PredicateNode& node, const Value& field_value) {
+    if (!node.test(field_value)) {
+        return false;
+    }
+    for (size_t i = 0; i < node.children.size(); ++i) {
+        if (!node.children[i].test(field_value)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+char lowerAscii(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+PredicateOp operatorOf(const std::string& op) {
+    if (op == "$eq" || op.empty()) {
+        return PredicateOp::Eq;
+    }
+    if (op == "$ne") {
+        return PredicateOp::Ne;
+    }
+    if (op == "$gt") {
+        return PredicateOp::Gt;
+    }
+    if (op == "$gte") {
+        return PredicateOp::Gte;
+    }
+    if (op == "$lt") {
+        return PredicateOp::Lt;
+    }
+    if (op == "$lte") {
+        return PredicateOp::Lte;
+    }
+    if (op == "$in") {
+        return PredicateOp::In;
+    }
+    if (op == "$like" || op == "$ilike") {
+        return PredicateOp::Like;
+    }
+    return PredicateOp::Never;
+}
+
+}
+
+LikePattern::LikePattern(const std::string& source, bool ignore_case) : case_insensitive(ignore_case) {
+    for (size_t i = 0; i < source.size(); ++i) {
+        char c = case_insensitive ? lowerAscii(source[i]) : source[i];
+        if (c == '%' && !pattern.empty() && pattern.back() == '%') {
+            continue;
+        }
+        pattern.push_back(c);
+        if (c != '%') {
+            min_length++;
+        }
+    }
+
+    size_t first_wildcard = pattern.find_first_of("%_");
+    leading = pattern.substr(0, first_wildcard);
+    if (first_wildcard == std::string::npos) {
+        kind = Kind::Exact;
+        literal = pattern;
+        return;
+    }
+    if (pattern.find('_') == std::string::npos) {
+        size_t percents = pattern.size() - min_length;
+        bool starts = pattern.front() == '%';
+        bool ends = pattern.back() == '%';
+        if (percents == 1 && ends && !starts) {
+            kind = Kind::Prefix;
+            literal = pattern.substr(0, pattern.size() - 1);
+            return;
+        }
+        if (percents == 1 && starts && !ends) {
+            kind = Kind::Suffix;
+            literal = pattern.substr(1);
+            return;
+        }
+        if (starts && ends && percents <= 2) {
+            kind = Kind::Contains;
+            literal = pattern.size() > 1 ? pattern.substr(1, pattern.size() - 2) : std::string();
+            return;
+        }
+    }
+    // для остальных шаблонов текст сначала проверяется на литералы по краям и самый длинный литерал
+    kind = Kind::General;
+    trailing = pattern.substr(pattern.find_last_of("%_") + 1);
+    size_t start = 0;
+    while (start < pattern.size()) {
+        size_t end = pattern.find_first_of("%_", start);
+        if (end == std::string::npos) {
+            end = pattern.size();
+        }
+        if (end - start > literal.size()) {
+            literal = pattern.substr(start, end - start);
+        }
+        start = end + 1;
+    }
+}
+
+bool LikePattern::matches(std::string_view text) const {
+    if (text.size() < min_length) {
+        return false;
+    }
+    if (!case_insensitive) {
+        return matchText(text.data(), text.size());
+    }
+    // буфер на поток: при параллельном обходе у каждого свой
+    thread_local std::string lowered;
+    lowered.resize(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        lowered[i] = lowerAscii(text[i]);
+    }
+    return matchText(lowered.data(), lowered.size());
+}
+
+bool LikePattern::matchText(const char* text, size_t length) const {
+    switch (kind) {
+        case Kind::Exact:
+            return length == literal.size() && std::memcmp(text, literal.data(), length) == 0;
+        case Kind::Prefix:
+            return std::memcmp(text, literal.data(), literal.size()) == 0;
+        case Kind::Suffix:
+            return std::memcmp(text + length - literal.size(), literal.data(), literal.size()) == 0;
+        case Kind::Contains:
+            return literal.empty() || memmem(text, length, literal.data(), literal.size()) != nullptr;
+        default:
+            if (std::memcmp(text, leading.data(), leading.size()) != 0 ||
+                std::memcmp(text + length - trailing.size(), trailing.data(), trailing.size()) != 0) {
+                return false;
+            }
+            if (!literal.empty() && memmem(text, length, literal.data(), literal.size()) == nullptr) {
+                return false;
+            }
+            return matchGeneral(text, length);
+    }
+}
+
+// жадное сопоставление: при несовпадении откат только к последнему %, он забирает ещё один символ
+bool LikePattern::matchGeneral(const char* text, size_t length) const {
+    // начало уже сверено
+    size_t text_pos = leading.size();
+    size_t pattern_pos = leading.size();
+    size_t star = std::string::npos;
+    size_t star_text = 0;
+    while (text_pos < length) {
+        if (pattern_pos < pattern.size() && pattern[pattern_pos] == '%') {
+            star = pattern_pos++;
+            star_text = text_pos;
+        } else if (pattern_pos < pattern.size() &&
+                   (pattern[pattern_pos] == '_' || pattern[pattern_pos] == text[text_pos])) {
+            ++text_pos;
+            ++pattern_pos;
+        } else if (star != std::string::npos) {
+            pattern_pos = star + 1;
+            text_pos = ++star_text;
+        } else {
+            return false;
+        }
+    }
+    while (pattern_pos < pattern.size() && pattern[pattern_pos] == '%') {
+        ++pattern_pos;
+    }
+    return pattern_pos == pattern.size();
+}
+
+bool LikePattern::caseInsensitive() const {
+    return case_insensitive;
+}
+
+const std::string& LikePattern::prefix() const {
+    static const std::string none;
+    return case_insensitive ? none : leading;
+}
+
+bool LikePattern::isPrefix() const {
+    return kind == Kind::Prefix && !case_insensitive;
+}
+
+PredicateLiteral::PredicateLiteral(const Document& source) : value(source) {
+    switch (source.type()) {
+        case Document::value_t::number_integer:
+            type = LiteralType::Integer;
+            integer = source.get<int64_t>();
+            break;
+        case Document::value_t::number_unsigned:
+            type = LiteralType::Unsigned;
+            unsigned_integer = source.get<uint64_t>();
+            break;
+        case Document::value_t::number_float:
+            type = LiteralType::Float;
+            number = source.get<double>();
+            break;
+        case Document::value_t::string:
+            type = LiteralType::String;
+            text = source.get<std::string>();
+            break;
+        default:
+            type = LiteralType::Other;
+            break;
+    }
+}
+
+bool PredicateLiteral::equals(const Document& field_value) const {
+    return compare(PredicateOp::Eq, field_value);
+}
+
+bool PredicateLiteral::equals(const CompactValue& field_value) const {
+    return compare(PredicateOp::Eq, field_value);
+}
+
+bool PredicateLiteral::compare(PredicateOp op, const Document& field_value) const {
+    return compareLiteral(*this, op, field_value);
+}
+
+bool PredicateLiteral::compare(PredicateOp op, const CompactValue& field_value) const {
+    return compareLiteral(*this, op, field_value);
+}
+
+bool PredicateNode::matches(const DocumentWrapper& doc) const {
+    switch (op) {
+        case PredicateOp::And:
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (!children[i].matches(doc)) {
+                    return false;
+                }
+            }
+            return true;
+        case PredicateOp::Or:
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (children[i].matches(doc)) {
+                    return true;
+                }
+            }
+            return false;
+        case PredicateOp::Never:
+            return false;
+        default:
+            break;
+    }
+
+    // отсутствующее поле не подходит ни под одно условие, включая $ne
+    if (doc.isCompact()) {
+        // поле читается прямо из буфера документа
+        CompactValue field_value;
+        return doc.findCompactField(field, field_value) && testAll(*this, field_value);
+    }
+    const Document& raw = doc.getRawDocument();
+    if (!raw.is_object()) {
+        return false;
+    }
+    auto found = raw.find(field);
+    return found != raw.end() && testAll(*this, *found);
+}
+
+bool PredicateNode::test(const Document& field_value) const {
+    return testValue(*this, field_value);
+}
+
+bool PredicateNode::test(const CompactValue& field_value) const {
+    return testValue(*this, field_value);
+}
+
+PredicateNode Predicate::compileCondition(const QueryCondition& condition) {
+    PredicateNode node;
+    node.op = operatorOf(condition.operator_);
+    node.field = condition.field;
+    if (node.op == PredicateOp::In) {
+        if (!condition.value.is_array()) {
+            node.op = PredicateOp::Never;
+            return node;
+        }
+        for (auto it = condition.value.begin(); it != condition.value.end(); ++it) {
+            if (it->is_string()) {
+                node.in_strings.push_back(it->get<std::string>());
+            } else {
+                node.in_others.emplace_back(*it);
+            }
+        }
+        std::sort(node.in_strings.begin(), node.in_strings.end());
+    } else if (node.op == PredicateOp::Like) {
+        if (!condition.value.is_string()) {
+            node.op = PredicateOp::Never;
+            return node;
+        }
+        node.like = LikePattern(condition.value.get<std::string>(), condition.operator_ == "$ilike");
+    } else if (node.op != PredicateOp::Never) {
+        node.literal = PredicateLiteral(condition.value);
+    }
+    return node;
+}
+
+PredicateNode Predicate::compileQuery(const ParsedQuery& query) {
+    PredicateNode node;
+    if (query.has_or_operator) {
+        // как и раньше, при $or проверяются только его ветки
+        node.op = PredicateOp::Or;
+        for (size_t i = 0; i < query.or_conditions.size(); ++i) {
+            node.children.push_back(compileQuery(query.or_conditions[i]));
+        }
+    } else {
+        node = compileConditions(query.conditions);
+    }
+    return node;
+}
+
+// условия по одному полю собираются в один узел: поле ищется в документе один раз
+PredicateNode Predicate::compileConditions(const Vector<QueryCondition>& conditions) {
+    PredicateNode node;
+    node.op = PredicateOp::And;
+    for (size_t i = 0; i < conditions.size(); ++i) {
+        PredicateNode condition = compileCondition(conditions[i]);
+        bool merged = false;
+        for (size_t k = 0; k < node.children.size() && !merged; ++k) {
+            if (node.children[k].field == condition.field) {
+                node.children[k].children.push_back(std::move(condition));
+                merged = true;
+            }
+        }
+        if (!merged) {
+            node.children.push_back(std::move(condition));
+        }
+    }
+    return node;
+}
+
+Predicate Predicate::compile(const ParsedQuery& query) {
+    Predicate predicate;
+    predicate.root = compileQuery(query);
+    return predicate;
+}
+
+Predicate Predicate::compile(const Vector<QueryCondition>& conditions) {
+    Predicate predicate;
+    predicate.root = compileConditions(conditions);
+    return predicate;
+}
+
+Predicate Predicate::compile(const QueryCondition& condition) {
+    Predicate predicate;
+    predicate.root = compileCondition(condition);
+    return predicate;
+}
+
+bool Predicate::matches(const DocumentWrapper& doc) const {
+    return root.matches(doc);
+}
\ No newline at end of file
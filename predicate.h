@@ -0,0 +1,121 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include "document.h"
+#include "parser.h"
+#include "vector.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+enum class PredicateOp {
+    Eq,
+    Ne,
+    Gt,
+    Gte,
+    Lt,
+    Lte,
+    In,
+    Like,
+    Never,  // условие не может выполниться (например, $in не с массивом)
+    And,
+    Or
+};
+
+enum class LiteralType {
+    Integer,
+    Unsigned,
+    Float,
+    String,
+    Other   // bool, null, объекты и массивы - сравниваются как json
+};
+
+// значение из запроса, заранее приведённое к своему типу
+struct PredicateLiteral {
+    LiteralType type = LiteralType::Other;
+    int64_t integer = 0;
+    uint64_t unsigned_integer = 0;
+    double number = 0;
+    std::string text;
+    Document value;
+
+    PredicateLiteral() = default;
+    explicit PredicateLiteral(const Document& source);
+
+    bool equals(const Document& field_value) const;
+    bool equals(const CompactValue& field_value) const;
+    // сравнение по правилам nlohmann::json, без копий значения поля
+    bool compare(PredicateOp op, const Document& field_value) const;
+    bool compare(PredicateOp op, const CompactValue& field_value) const;
+};
+
+// шаблон $like/$ilike, разобранный один раз на запрос: % - любая подстрока, _ - один символ
+// без подстановок в середине проверяется через memcmp/memmem, иначе жадным проходом за O(n*m)
+class LikePattern {
+private:
+    enum class Kind {
+        Exact,     // abc
+        Prefix,    // abc%
+        Suffix,    // %abc
+        Contains,  // %abc%, % - любая строка
+        General
+    };
+
+    Kind kind = Kind::Exact;
+    std::string pattern;   // подряд идущие % схлопнуты; для $ilike в нижнем регистре
+    std::string literal;   // литерал для Exact/Prefix/Suffix/Contains, иначе самый длинный фрагмент
+    std::string leading;   // литерал до первой подстановки
+    std::string trailing;  // литерал после последней подстановки
+    size_t min_length = 0; // символов в тексте не меньше, чем не-% в шаблоне
+    bool case_insensitive = false;
+
+    bool matchText(const char* text, size_t length) const;
+    bool matchGeneral(const char* text, size_t length) const;
+
+public:
+    LikePattern() = default;
+    LikePattern(const std::string& source, bool ignore_case);
+
+    bool matches(std::string_view text) const;
+    bool caseInsensitive() const;
+    // литерал в начале шаблона: подходящие строки лежат в диапазоне [prefix, следующий за prefix)
+    const std::string& prefix() const;
+    // шаблон вида abc% - совпадает ровно со строками этого диапазона
+    bool isPrefix() const;
+};
+
+struct PredicateNode {
+    PredicateOp op = PredicateOp::And;
+    std::string field;
+    PredicateLiteral literal;              // операнд сравнения
+    LikePattern like;                      // шаблон $like/$ilike
+    Vector<std::string> in_strings;        // строки из $in, по возрастанию
+    Vector<PredicateLiteral> in_others;    // остальные значения $in
+    Vector<PredicateNode> children;        // для And/Or; у условия - другие условия по тому же полю
+
+    bool matches(const DocumentWrapper& doc) const;
+    // проверка уже найденного значения поля: из дерева или прямо из компактного документа
+    bool test(const Document& field_value) const;
+    bool test(const CompactValue& field_value) const;
+};
+
+// запрос, скомпилированный один раз перед выполнением: операторы разобраны в enum,
+// поле ищется в документе один раз и сравнивается по ссылке (в компактном документе - на месте, без разворачивания)
+class Predicate {
+private:
+    PredicateNode root;  // пустой And - подходит любой документ
+
+    static PredicateNode compileCondition(const QueryCondition& condition);
+    static PredicateNode compileConditions(const Vector<QueryCondition>& conditions);
+    static PredicateNode compileQuery(const ParsedQuery& query);
+
+public:
+    static Predicate compile(const ParsedQuery& query);
+    // все условия через И, в заданном порядке (по одному полю - вместе с первым)
+    static Predicate compile(const Vector<QueryCondition>& conditions);
+    static Predicate compile(const QueryCondition& condition);
+
+    bool matches(const DocumentWrapper& doc) const;
+};
+
+#endif
\ No newline at end of file
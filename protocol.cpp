@@ -0,0 +1,84 @@
+#include "protocol.h"
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+bool writeAll(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool readAll(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = ::read(fd, data, size);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+}
+
+void FrameCodec::encode(const std::string& payload, std::string& out) {
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((length >> (8 * i)) & 0xFF));
+    }
+    out += payload;
+}
+
+uint32_t FrameCodec::payloadLength(const char* header) {
+    uint32_t length = 0;
+    for (int i = 0; i < 4; ++i) {
+        length |= static_cast<uint32_t>(static_cast<unsigned char>(header[i])) << (8 * i);
+    }
+    return length;
+}
+
+bool FrameCodec::decode(const std::string& buffer, size_t& offset, std::string& payload) {
+    if (buffer.size() - offset < HEADER_SIZE) {
+        return false;
+    }
+    size_t length = payloadLength(buffer.data() + offset);
+    if (buffer.size() - offset - HEADER_SIZE < length) {
+        return false;
+    }
+    payload.assign(buffer, offset + HEADER_SIZE, length);
+    offset += HEADER_SIZE + length;
+    return true;
+}
+
+bool FrameCodec::send(int fd, const std::string& payload) {
+    std::string frame;
+    frame.reserve(HEADER_SIZE + payload.size());
+    encode(payload, frame);
+    return writeAll(fd, frame.data(), frame.size());
+}
+
+bool FrameCodec::receive(int fd, std::string& payload) {
+    char header[HEADER_SIZE];
+    if (!readAll(fd, header, HEADER_SIZE)) {
+        return false;
+    }
+    uint32_t length = payloadLength(header);
+    payload.resize(length);
+    return length == 0 || readAll(fd, &payload[0], length);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// кадр запроса и ответа сервера: [length:4][JSON:length], длина little-endian
+// запрос: {"op": "insert|find|count|delete|stats", "collection": ..., "document"/"documents"/"query": ...}
+// ответ: {"ok": true, ...} или {"ok": false, "error": "..."}
+class FrameCodec {
+public:
+    static const size_t HEADER_SIZE = 4;
+    static const size_t MAX_PAYLOAD = 64 * 1024 * 1024;  // предел для запроса, ответ может быть больше
+
+    static void encode(const std::string& payload, std::string& out);
+    static uint32_t payloadLength(const char* header);
+    // вынимает полный кадр из buffer начиная с offset и сдвигает offset,
+    // false - кадр ещё не пришёл целиком
+    static bool decode(const std::string& buffer, size_t& offset, std::string& payload);
+
+    // блокирующие отправка и приём кадра, для клиента
+    static bool send(int fd, const std::string& payload);
+    static bool receive(int fd, std::string& payload);
+};
+
+#endif
\ No newline at end of file
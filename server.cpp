@@ -0,0 +1,567 @@
+#include "server.h"
+#include "aggregate.h"
+#include "parser.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const size_t READ_CHUNK = 64 * 1024;
+// необработанного ввода на подключение не больше одного кадра наибольшего размера:
+// первый кадр в буфере всегда помещается целиком, остальное клиент держит у себя
+const size_t MAX_BUFFERED_INPUT = FrameCodec::HEADER_SIZE + FrameCodec::MAX_PAYLOAD;
+const int MAX_EVENTS = 64;
+
+}
+
+Server::Server(Database& db, const std::string& path, size_t worker_count)
+    : database(db), socket_path(path), listen_fd(-1), epoll_fd(-1),
+      wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), stopping(false), in_flight(0),
+      durability(db.getDurability()),
+      workers(worker_count == 0 ? std::thread::hardware_concurrency() : worker_count) {
+    // fsync журнала ждём сами после снятия блокировки коллекции: так параллельные писатели попадают в одну группу
+    DurabilityOptions deferred = durability;
+    deferred.caller_waits = true;
+    database.setDurability(deferred);
+}
+
+Server::~Server() {
+    database.setDurability(durability);
+    for (size_t fd = 0; fd < connections.size(); ++fd) {
+        if (connections[fd] != nullptr) {
+            ::close(connections[fd]->fd);
+            delete connections[fd];
+        }
+    }
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+    if (epoll_fd >= 0) {
+        ::close(epoll_fd);
+    }
+    if (wake_fd >= 0) {
+        ::close(wake_fd);
+    }
+}
+
+bool Server::openSocket() {
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid socket path: " << socket_path << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // сокет от прошлого запуска мешает bind, обычный файл не трогаем
+    struct stat st;
+    if (stat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path.c_str());
+    }
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 ||
+        bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0 || wake_fd < 0) {
+        std::cerr << "Cannot create event loop: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.fd = wake_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event);
+    return true;
+}
+
+bool Server::run() {
+    if (!openSocket()) {
+        return false;
+    }
+    std::cout << "Serving database '" << database.getName() << "' on " << socket_path
+              << " (" << workers.size() << " workers)" << std::endl;
+
+    epoll_event events[MAX_EVENTS];
+    bool accepting = true;
+    // после stop() новые запросы не берутся, но начатые доводятся до ответа
+    while (!stopping || in_flight > 0) {
+        if (stopping && accepting) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+            accepting = false;
+        }
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "Event loop error: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd) {
+                if (accepting) {
+                    acceptClients();
+                }
+                continue;
+            }
+            if (fd == wake_fd) {
+                uint64_t counter = 0;
+                while (read(wake_fd, &counter, sizeof(counter)) > 0) {
+                }
+                deliverReplies();
+                continue;
+            }
+            if (static_cast<size_t>(fd) >= connections.size() || connections[fd] == nullptr) {
+                continue;
+            }
+            Connection* connection = connections[fd];
+            if (events[i].events & EPOLLOUT) {
+                writeClient(connection);
+            }
+            // запись могла закрыть подключение
+            if (connections[fd] == connection && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+                readClient(connection, (events[i].events & (EPOLLHUP | EPOLLERR)) != 0);
+            }
+        }
+    }
+
+    std::cout << "Server stopped" << std::endl;
+    return true;
+}
+
+void Server::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    ssize_t written = write(wake_fd, &one, sizeof(one));
+    (void)written;
+}
+
+void Server::acceptClients() {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                std::cerr << "Accept failed: " << std::strerror(errno) << std::endl;
+            }
+            return;
+        }
+        if (static_cast<size_t>(fd) >= connections.size()) {
+            connections.resize(fd + 1, nullptr);
+        }
+        Connection* connection = new Connection();
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        connections[fd] = connection;
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = connection->events;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.connections++;
+    }
+}
+
+void Server::readClient(Connection* connection, bool hangup) {
+    char buffer[READ_CHUNK];
+    while (!connection->input_ended) {
+        size_t pending = connection->input.size() - connection->input_offset;
+        if (pending >= MAX_BUFFERED_INPUT) {
+            break;  // дочитаем, когда dispatch разберёт кадры
+        }
+        size_t wanted = std::min(sizeof(buffer), MAX_BUFFERED_INPUT - pending);
+        ssize_t received = read(connection->fd, buffer, wanted);
+        if (received > 0) {
+            connection->input.append(buffer, static_cast<size_t>(received));
+            continue;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (received == 0) {
+            connection->input_ended = true;
+            break;
+        }
+        connection->closing = true;  // ошибка чтения
+        break;
+    }
+    // клиент отключился совсем: ответы отдавать некому
+    if (hangup) {
+        connection->closing = true;
+    }
+
+    // кадр больше предела не дочитываем: подключение закрывается
+    size_t pending = connection->input.size() - connection->input_offset;
+    if (pending >= FrameCodec::HEADER_SIZE &&
+        FrameCodec::payloadLength(connection->input.data() + connection->input_offset) > FrameCodec::MAX_PAYLOAD) {
+        std::cerr << "Request frame too large, closing connection" << std::endl;
+        connection->closing = true;
+    }
+    if (connection->closing) {
+        closeClient(connection);
+        return;
+    }
+    dispatch(connection);
+    updateEvents(connection);
+    closeIfDrained(connection);
+}
+
+void Server::writeClient(Connection* connection) {
+    while (connection->output_offset < connection->output.size()) {
+        ssize_t written = send(connection->fd, connection->output.data() + connection->output_offset,
+                               connection->output.size() - connection->output_offset, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            connection->closing = true;
+            closeClient(connection);
+            return;
+        }
+        connection->output_offset += static_cast<size_t>(written);
+    }
+    if (connection->output_offset == connection->output.size()) {
+        connection->output.clear();
+        connection->output_offset = 0;
+    }
+    updateEvents(connection);
+    closeIfDrained(connection);
+}
+
+void Server::updateEvents(Connection* connection) {
+    uint32_t wanted = 0;
+    if (!connection->input_ended && connection->input.size() - connection->input_offset < MAX_BUFFERED_INPUT) {
+        wanted |= EPOLLIN;
+    }
+    if (!connection->output.empty()) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted == connection->events) {
+        return;
+    }
+    connection->events = wanted;
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = wanted;
+    event.data.fd = connection->fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+}
+
+void Server::closeIfDrained(Connection* connection) {
+    // незаконченный последний кадр уже не придёт
+    if (connection->input_ended && !connection->busy && connection->output.empty()) {
+        closeClient(connection);
+    }
+}
+
+void Server::closeClient(Connection* connection) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    if (connection->busy) {
+        return;  // закроется, когда придёт ответ на начатый запрос
+    }
+    connections[connection->fd] = nullptr;
+    ::close(connection->fd);
+    delete connection;
+}
+
+void Server::dispatch(Connection* connection) {
+    if (connection->busy || connection->closing || stopping) {
+        return;
+    }
+    std::string payload;
+    if (!FrameCodec::decode(connection->input, connection->input_offset, payload)) {
+        return;
+    }
+    // прочитанное сдвигается в начало буфера, когда его набирается больше половины
+    if (connection->input_offset * 2 > connection->input.size()) {
+        connection->input.erase(0, connection->input_offset);
+        connection->input_offset = 0;
+    }
+    connection->busy = true;
+    in_flight++;
+    int fd = connection->fd;
+    workers.submit([this, fd, payload]() {
+        Reply reply;
+        reply.fd = fd;
+        Collection* changed = nullptr;
+        ShardedCollection* changed_sharded = nullptr;
+        FrameCodec::encode(execute(payload, changed, changed_sharded), reply.frame);
+        {
+            std::lock_guard<std::mutex> lock(replies_mutex);
+            replies.push_back(std::move(reply));
+        }
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        (void)written;
+        // клиент не ждёт контрольной точки: она идёт на этом потоке уже после ответа
+        checkpoint(changed, changed_sharded);
+    });
+}
+
+void Server::deliverReplies() {
+    Vector<Reply> ready;
+    {
+        std::lock_guard<std::mutex> lock(replies_mutex);
+        ready = std::move(replies);
+        replies = Vector<Reply>();
+    }
+    for (size_t i = 0; i < ready.size(); ++i) {
+        Connection* connection = connections[ready[i].fd];
+        connection->busy = false;
+        in_flight--;
+        if (connection->closing) {
+            closeClient(connection);
+            continue;
+        }
+        connection->output += ready[i].frame;
+        // следующий запрос, если клиент успел прислать его, пока выполнялся этот;
+        // до записи ответа, чтобы после конца ввода подключение не закрылось раньше времени
+        dispatch(connection);
+        writeClient(connection);
+    }
+}
+
+std::string Server::handle(const std::string& request) {
+    Collection* changed = nullptr;
+    ShardedCollection* changed_sharded = nullptr;
+    std::string response = execute(request, changed, changed_sharded);
+    checkpoint(changed, changed_sharded);
+    return response;
+}
+
+void Server::checkpoint(Collection* changed, ShardedCollection* changed_sharded) {
+    if (changed != nullptr) {
+        changed->maybeCheckpoint();
+    }
+    if (changed_sharded != nullptr) {
+        changed_sharded->maybeCheckpoint();
+    }
+}
+
+std::string Server::execute(const std::string& request, Collection*& changed, ShardedCollection*& changed_sharded) {
+    Document response;
+    try {
+        Document message = Document::parse(request);
+        if (!message.is_object()) {
+            throw std::runtime_error("request must be a JSON object");
+        }
+        std::string op = message.value("op", "");
+        std::string collection_name = message.value("collection", "default");
+        ParsedQuery query;
+        if (message.contains("query")) {
+            QueryParser parser;
+            query = parser.parse(message["query"]);
+        }
+
+        Durability mode = durability.mode;
+        if (message.contains("durability")) {
+            DurabilityOptions requested;
+            if (!message["durability"].is_string() || !requested.setMode(message["durability"].get<std::string>())) {
+                throw std::runtime_error("durability must be none, batched or strict");
+            }
+            mode = requested.mode;
+        }
+        Collection* written = nullptr;  // изменённая коллекция: ответ только после fsync её журнала
+        uint64_t written_position = 0;
+        ShardedCollection* written_sharded = nullptr;
+
+        // database_mutex держится только на поиск коллекции, дальше - блокировка самой коллекции
+        if (op == "insert") {
+            Vector<DocumentWrapper> documents;
+            bool single = false;
+            if (message.contains("documents") && message["documents"].is_array()) {
+                for (auto it = message["documents"].begin(); it != message["documents"].end(); ++it) {
+                    documents.emplace_back(std::move(*it));
+                }
+            } else if (message.contains("document") && message["document"].is_object()) {
+                documents.emplace_back(std::move(message["document"]));
+                single = true;
+            } else {
+                throw std::runtime_error("insert requires \"document\" or \"documents\"");
+            }
+            size_t inserted = 0;
+            ShardedCollection* sharded = findSharded(collection_name);
+            if (sharded != nullptr) {
+                // части блокируются внутри, разные части пишутся параллельно
+                inserted = single ? static_cast<size_t>(sharded->insert(documents[0])) : sharded->insertMany(documents);
+                written_sharded = sharded;
+            } else {
+                Collection& collection = findCollection(collection_name);
+                Collection::WriteGuard lock = collection.writeLock();
+                inserted = single ? static_cast<size_t>(collection.insert(documents[0])) : collection.insertMany(documents);
+                written = &collection;
+                written_position = collection.logPosition();
+            }
+            if (single && inserted == 0) {
+                throw std::runtime_error("insert failed");
+            }
+            response["inserted"] = inserted;
+        } else if (op == "find") {
+            FindOptions options;
+            options.skip = message.value("skip", static_cast<size_t>(0));
+            options.limit = message.value("limit", static_cast<size_t>(0));
+            if (!options.setFields(message.value("fields", std::string()))) {
+                throw std::runtime_error("fields cannot mix included and excluded fields");
+            }
+            if (!options.setSort(message.value("sort", std::string()))) {
+                throw std::runtime_error("invalid sort specification");
+            }
+            Document documents = Document::array();
+            std::function<void(const DocumentWrapper&)> append = [&documents](const DocumentWrapper& doc) {
+                documents.push_back(doc.toDocument());
+            };
+            ShardedCollection* sharded = findSharded(collection_name);
+            bool sorted = true;
+            if (sharded != nullptr && !options.sort.empty()) {
+                sorted = sharded->findSorted(query, options, append);
+            } else if (sharded != nullptr) {
+                Vector<DocumentWrapper> results = sharded->find(query, options);
+                for (size_t i = 0; i < results.size(); ++i) {
+                    append(results[i]);
+                }
+            } else {
+                Collection& collection = findCollection(collection_name);
+                Collection::ReadGuard lock = collection.readLock();
+                if (!options.sort.empty()) {
+                    sorted = collection.findSorted(query, options, append);
+                } else {
+                    Cursor cursor = collection.findCursor(query, options);
+                    while (cursor.next()) {
+                        if (options.hasProjection()) {
+                            append(options.project(cursor.current()));
+                        } else {
+                            append(cursor.current());
+                        }
+                    }
+                }
+            }
+            if (!sorted) {
+                throw std::runtime_error("sort failed");
+            }
+            response["count"] = documents.size();
+            response["documents"] = std::move(documents);
+        } else if (op == "aggregate") {
+            AggregationPipeline pipeline;
+            if (!message.contains("pipeline") || !pipeline.parse(message["pipeline"])) {
+                throw std::runtime_error("invalid pipeline");
+            }
+            Vector<DocumentWrapper> results;
+            ShardedCollection* sharded = findSharded(collection_name);
+            if (sharded != nullptr) {
+                results = sharded->aggregate(pipeline);
+            } else {
+                Collection& collection = findCollection(collection_name);
+                Collection::ReadGuard lock = collection.readLock();
+                results = collection.aggregate(pipeline);
+            }
+            Document documents = Document::array();
+            for (size_t i = 0; i < results.size(); ++i) {
+                documents.push_back(results[i].getRawDocument());
+            }
+            response["count"] = documents.size();
+            response["documents"] = std::move(documents);
+        } else if (op == "count") {
+            ShardedCollection* sharded = findSharded(collection_name);
+            if (sharded != nullptr) {
+                response["count"] = sharded->count(query);
+            } else {
+                Collection& collection = findCollection(collection_name);
+                Collection::ReadGuard lock = collection.readLock();
+                response["count"] = collection.count(query);
+            }
+        } else if (op == "delete") {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            ShardedCollection* sharded = findSharded(collection_name);
+            if (sharded != nullptr) {
+                response["deleted"] = sharded->remove(query);
+                written_sharded = sharded;
+            } else {
+                Collection& collection = findCollection(collection_name);
+                Collection::WriteGuard lock = collection.writeLock();
+                response["deleted"] = collection.remove(query);
+                written = &collection;
+                written_position = collection.logPosition();
+            }
+            response["elapsed_ms"] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        } else if (op == "stats") {
+            std::stringstream text;
+            {
+                std::lock_guard<std::mutex> lock(database_mutex);
+                database.printStats(text);
+            }
+            response["stats"] = text.str();
+            ServerStats server = getStats();
+            response["server"] = {{"connections", server.connections},
+                                  {"requests", server.requests},
+                                  {"errors", server.errors},
+                                  {"durability", DurabilityOptions::modeName(durability.mode)}};
+        } else {
+            throw std::runtime_error("unknown op '" + op + "'");
+        }
+        changed = written;
+        changed_sharded = written_sharded;
+        // fsync журнала ждём уже без блокировки коллекции
+        if ((written != nullptr && !written->waitDurable(written_position, mode)) ||
+            (written_sharded != nullptr && !written_sharded->waitDurable(mode))) {
+            throw std::runtime_error("log sync failed, change is not durable");
+        }
+        response["ok"] = true;
+    } catch (const std::exception& e) {
+        response = {{"ok", false}, {"error", e.what()}};
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.requests++;
+        if (!response["ok"].get<bool>()) {
+            stats.errors++;
+        }
+    }
+    return response.dump(-1, ' ', false, Document::error_handler_t::replace);
+}
+
+Collection& Server::findCollection(const std::string& name) {
+    std::lock_guard<std::mutex> lock(database_mutex);
+    return database.getCollection(name);
+}
+
+ShardedCollection* Server::findSharded(const std::string& name) {
+    std::lock_guard<std::mutex> lock(database_mutex);
+    return database.isSharded(name) ? &database.getShardedCollection(name) : nullptr;
+}
+
+ServerStats Server::getStats() {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return stats;
+}
\ No newline at end of file
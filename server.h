@@ -0,0 +1,93 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "database.h"
+#include "protocol.h"
+#include "thread_pool.h"
+#include "vector.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct ServerStats {
+    uint64_t connections = 0;   // принято подключений всего
+    uint64_t requests = 0;
+    uint64_t errors = 0;        // ответов с ok = false
+};
+
+// сервер на unix-сокете: один поток epoll принимает подключения и читает кадры,
+// запросы выполняются на пуле потоков, ответы пишет обратно поток epoll
+// у подключения одновременно выполняется не больше одного запроса - ответы идут в порядке запросов
+// чтения одной коллекции выполняются параллельно, изменения коллекции - по одному
+class Server {
+private:
+    struct Connection {
+        int fd = -1;
+        std::string input;
+        size_t input_offset = 0;
+        std::string output;
+        size_t output_offset = 0;
+        bool busy = false;      // запрос на пуле, закрывать нельзя: номер дескриптора займёт другой клиент
+        bool closing = false;   // клиент отключился или прислал слишком большой кадр
+        bool input_ended = false;  // клиент закрыл свою сторону на запись: дорабатываем пришедшие кадры
+        uint32_t events = 0;    // маска, зарегистрированная в epoll
+    };
+    struct Reply {
+        int fd;
+        std::string frame;
+    };
+
+    Database& database;
+    std::string socket_path;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;                      // eventfd: готовы ответы или пора остановиться
+    Vector<Connection*> connections;  // по номеру дескриптора
+    std::mutex database_mutex;        // таблица коллекций базы; сами коллекции блокируются отдельно
+    std::mutex replies_mutex;
+    Vector<Reply> replies;
+    std::atomic<bool> stopping;
+    size_t in_flight;                 // запросов на пуле, трогается только потоком epoll
+    std::mutex stats_mutex;
+    ServerStats stats;
+    DurabilityOptions durability;     // режим базы; запрос может задать свой полем "durability"
+    ThreadPool workers;               // последним: при разрушении дожидается задач, которые ссылаются на поля выше
+
+    bool openSocket();
+    void acceptClients();
+    // hangup - клиент закрыл подключение целиком, ответы отдавать некому
+    void readClient(Connection* connection, bool hangup);
+    void writeClient(Connection* connection);
+    void closeClient(Connection* connection);
+    void dispatch(Connection* connection);
+    void deliverReplies();
+    // чтение приостанавливается, пока непрочитанного во входном буфере больше предела
+    void updateEvents(Connection* connection);
+    // после конца ввода: закрывает, когда все кадры обработаны и ответы отправлены
+    void closeIfDrained(Connection* connection);
+    // коллекция открывается под database_mutex, ссылка действительна до конца работы сервера
+    Collection& findCollection(const std::string& name);
+    // nullptr - коллекция не секционирована; секционированная блокирует свои части сама
+    ShardedCollection* findSharded(const std::string& name);
+    // выполняет запрос; changed/changed_sharded - коллекция, которую он изменил
+    std::string execute(const std::string& request, Collection*& changed, ShardedCollection*& changed_sharded);
+    // контрольная точка изменённой коллекции по её политике, без блокировок запроса
+    void checkpoint(Collection* changed, ShardedCollection* changed_sharded);
+
+public:
+    Server(Database& db, const std::string& path, size_t worker_count = 0);
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // цикл обработки до stop(); false - сокет не открылся
+    bool run();
+    // можно вызывать из обработчика сигнала
+    void stop();
+    // выполняет один запрос: JSON запроса -> JSON ответа, затем контрольная точка, если она нужна
+    std::string handle(const std::string& request);
+    ServerStats getStats();
+};
+
+#endif
\ No newline at end of file
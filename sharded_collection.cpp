@@ -0,0 +1,498 @@
+#include "sharded_collection.h"
+#include "aggregate.h"
+#include "cursor.h"
+#include "hash_map.h"
+#include "sorter.h"
+#include "thread_pool.h"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+
+const char* ShardedCollection::SHARD_COUNT_FILE = "shards";
+
+namespace {
+
+// своя соль: иначе в части попадали бы id с одинаковыми младшими битами хэша таблицы
+const uint64_t SHARD_SEED = 0x2545f4914f6cdd1dULL;
+
+size_t readShardCount(const std::string& directory) {
+    std::ifstream file(directory + "/" + ShardedCollection::SHARD_COUNT_FILE);
+    size_t count = 0;
+    if (!(file >> count)) {
+        return 0;
+    }
+    return count;
+}
+
+}
+
+ShardedCollection::ShardedCollection(const std::string& collection_name, const std::string& db_path, size_t shard_count)
+    : name(collection_name), directory(directoryFor(collection_name, db_path)) {
+    if (shard_count == 0) {
+        shard_count = readShardCount(directory);
+        if (shard_count == 0) {
+            throw std::runtime_error("cannot read shard count of collection '" + name + "' in " + directory);
+        }
+    } else {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        std::ofstream file(directory + "/" + SHARD_COUNT_FILE, std::ios::trunc);
+        file << shard_count << std::endl;
+        if (!file) {
+            throw std::runtime_error("cannot write shard count of collection '" + name + "' in " + directory);
+        }
+    }
+    shards.resize(shard_count, nullptr);
+    // снимки и журналы частей читаются одновременно
+    ThreadPool::shared().parallelFor(shard_count, [this](size_t i) {
+        shards[i] = new Collection(std::to_string(i), directory);
+    });
+    setScanOptions(scan_options);
+}
+
+ShardedCollection::~ShardedCollection() {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        delete shards[i];
+    }
+}
+
+std::string ShardedCollection::directoryFor(const std::string& collection_name, const std::string& db_path) {
+    return db_path + "/" + collection_name + ".shards";
+}
+
+size_t ShardedCollection::shardOf(const std::string& id) const {
+    return HashFunction::mix(HashFunction()(id) ^ SHARD_SEED) % shards.size();
+}
+
+void ShardedCollection::forEachShard(const std::function<void(size_t)>& body) const {
+    if (scan_options.threads == 1 || shards.size() == 1) {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            body(i);
+        }
+        return;
+    }
+    ThreadPool::shared().parallelFor(shards.size(), body);
+}
+
+bool ShardedCollection::commitShard(size_t shard, uint64_t position) {
+    if (durability.caller_waits) {
+        return true;
+    }
+    return shards[shard]->waitDurable(position, durability.mode);
+}
+
+bool ShardedCollection::insert(const DocumentWrapper& document) {
+    DocumentWrapper doc = document;
+    doc.setGeneratedId();
+    size_t shard = shardOf(doc.getField<std::string>("_id"));
+    uint64_t position = 0;
+    {
+        Collection::WriteGuard lock = shards[shard]->writeLock();
+        if (!shards[shard]->insert(doc)) {
+            return false;
+        }
+        position = shards[shard]->logPosition();
+    }
+    return commitShard(shard, position);
+}
+
+bool ShardedCollection::insert(const std::string& json_str) {
+    DocumentWrapper doc(json_str);
+    return insert(doc);
+}
+
+size_t ShardedCollection::insertMany(const Vector<DocumentWrapper>& documents) {
+    size_t missing_ids = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (!documents[i].hasField("_id")) {
+            missing_ids++;
+        }
+    }
+    // id нужны до раскладки по частям
+    Vector<std::string> ids = DocumentWrapper::generateIds(missing_ids);
+    size_t next_id = 0;
+    Vector<Vector<DocumentWrapper>> parts(shards.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (documents[i].hasField("_id")) {
+            parts[shardOf(documents[i].getField<std::string>("_id"))].push_back(documents[i]);
+            continue;
+        }
+        const std::string& id = ids[next_id++];
+        DocumentWrapper doc = documents[i];
+        doc.setField("_id", id);
+        parts[shardOf(id)].push_back(std::move(doc));
+    }
+    Vector<size_t> inserted(shards.size(), 0);
+    forEachShard([&](size_t i) {
+        if (parts[i].empty()) {
+            return;
+        }
+        uint64_t position = 0;
+        {
+            Collection::WriteGuard lock = shards[i]->writeLock();
+            inserted[i] = shards[i]->insertMany(parts[i]);
+            position = shards[i]->logPosition();
+        }
+        if (!commitShard(i, position)) {
+            inserted[i] = 0;
+        }
+    });
+    size_t total = 0;
+    for (size_t i = 0; i < inserted.size(); ++i) {
+        total += inserted[i];
+    }
+    return total;
+}
+
+size_t ShardedCollection::importNdjson(std::istream& input, size_t batch_size) {
+    return Collection::readNdjson(input, batch_size, [this](const Vector<DocumentWrapper>& batch) {
+        size_t inserted = insertMany(batch);
+        maybeCheckpoint();
+        return inserted;
+    });
+}
+
+bool ShardedCollection::findById(const std::string& id, DocumentWrapper& result) const {
+    const Collection& shard = *shards[shardOf(id)];
+    Collection::ReadGuard lock = shard.readLock();
+    return shard.findById(id, result);
+}
+
+Vector<DocumentWrapper> ShardedCollection::find(const ParsedQuery& query, const FindOptions& options) const {
+    Vector<DocumentWrapper> results;
+    if (options.skip == 0 && options.limit == 0) {
+        // нужны все совпадения: части ищут параллельно, их результаты переносятся без копий
+        Vector<Vector<DocumentWrapper>> partial(shards.size());
+        forEachShard([&](size_t i) {
+            Collection::ReadGuard lock = shards[i]->readLock();
+            partial[i] = shards[i]->find(query, options);
+        });
+        size_t total = 0;
+        for (size_t i = 0; i < partial.size(); ++i) {
+            total += partial[i].size();
+        }
+        results.reserve(total);
+        for (size_t i = 0; i < partial.size(); ++i) {
+            for (size_t j = 0; j < partial[i].size(); ++j) {
+                results.push_back(std::move(partial[i][j]));
+            }
+        }
+        return results;
+    }
+    // части по очереди курсором: копируются только отданные документы, обход кончается на skip+limit
+    size_t skipped = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        Collection::ReadGuard lock = shards[i]->readLock();
+        Cursor cursor = shards[i]->findCursor(query);
+        while (cursor.next()) {
+            if (skipped < options.skip) {
+                skipped++;
+                continue;
+            }
+            if (options.hasProjection()) {
+                results.push_back(options.project(cursor.current()));
+            } else {
+                results.push_back(cursor.current());
+            }
+            if (options.limit > 0 && results.size() >= options.limit) {
+                return results;
+            }
+        }
+    }
+    return results;
+}
+
+bool ShardedCollection::findSorted(const ParsedQuery& query, const FindOptions& options,
+                                   const std::function<void(const DocumentWrapper&)>& output) const {
+    SortOrder order(options.sort);
+    size_t needed = options.matchesNeeded();
+    if (needed == 0) {
+        return mergeSorted(query, options, order, output);
+    }
+
+    // у каждой части своя куча из skip+limit указателей; указатели в таблицы частей
+    // действительны, пока держатся отметки чтения всех частей (писателей они не ждут)
+    Vector<Collection::ReadGuard> locks;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        locks.push_back(shards[i]->readLock());
+    }
+    Vector<Vector<const DocumentWrapper*>> best(shards.size());
+    forEachShard([&](size_t i) {
+        TopK top(order, needed);
+        Cursor cursor = shards[i]->findCursor(query);
+        while (cursor.next()) {
+            top.add(cursor.current());
+        }
+        best[i] = top.take();
+    });
+
+    // слияние N отсортированных списков: каждый раз берётся наименьшая голова, при равенстве - из меньшей части
+    Vector<size_t> heads(shards.size(), 0);
+    size_t position = 0;
+    while (position < needed) {
+        size_t next = shards.size();
+        for (size_t i = 0; i < best.size(); ++i) {
+            if (heads[i] >= best[i].size()) {
+                continue;
+            }
+            if (next == shards.size() || order.compare(*best[i][heads[i]], *best[next][heads[next]]) < 0) {
+                next = i;
+            }
+        }
+        if (next == shards.size()) {
+            break;
+        }
+        const DocumentWrapper& doc = *best[next][heads[next]++];
+        if (position++ < options.skip) {
+            continue;
+        }
+        if (options.hasProjection()) {
+            output(options.project(doc));
+        } else {
+            output(doc);
+        }
+    }
+    return true;
+}
+
+bool ShardedCollection::mergeSorted(const ParsedQuery& query, const FindOptions& options, const SortOrder& order,
+                                    const std::function<void(const DocumentWrapper&)>& output) const {
+    // общий бюджет памяти делится между частями: сверх своей доли часть пишет серии на диск
+    size_t shard_memory = options.sort_memory / shards.size();
+    if (shard_memory == 0) {
+        shard_memory = 1;
+    }
+    Vector<std::unique_ptr<ExternalSorter>> sorters;
+    Vector<ExternalSorter*> merged;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        sorters.push_back(std::unique_ptr<ExternalSorter>(new ExternalSorter(order, shard_memory, options.sort_directory)));
+        merged.push_back(sorters[i].get());
+    }
+    Vector<char> filled(shards.size(), 1);
+    forEachShard([&](size_t i) {
+        Collection::ReadGuard lock = shards[i]->readLock();
+        Cursor cursor = shards[i]->findCursor(query);
+        while (filled[i] && cursor.next()) {
+            const DocumentWrapper& doc = cursor.current();
+            filled[i] = sorters[i]->add(doc, options.hasProjection() ? options.project(doc) : DocumentWrapper(doc));
+        }
+    });
+    bool ok = true;
+    for (size_t i = 0; i < filled.size(); ++i) {
+        ok = ok && filled[i];
+    }
+    // серии и буферы всех частей сливаются одним потоком прямо в output
+    size_t position = 0;
+    ok = ok && ExternalSorter::merge(merged, [&](const DocumentWrapper& doc) {
+        if (position++ >= options.skip) {
+            output(doc);
+        }
+    });
+    if (!ok) {
+        std::cerr << "Sort failed for collection '" << name << "'" << std::endl;
+    }
+    return ok;
+}
+
+size_t ShardedCollection::count(const ParsedQuery& query) const {
+    Vector<size_t> counts(shards.size(), 0);
+    forEachShard([&](size_t i) {
+        Collection::ReadGuard lock = shards[i]->readLock();
+        counts[i] = shards[i]->count(query);
+    });
+    size_t total = 0;
+    for (size_t i = 0; i < counts.size(); ++i) {
+        total += counts[i];
+    }
+    return total;
+}
+
+Vector<DocumentWrapper> ShardedCollection::aggregate(const AggregationPipeline& pipeline) const {
+    Vector<std::unique_ptr<GroupTable>> partial;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        partial.push_back(std::unique_ptr<GroupTable>(new GroupTable(pipeline)));
+    }
+    forEachShard([&](size_t i) {
+        Collection::ReadGuard lock = shards[i]->readLock();
+        shards[i]->aggregateInto(pipeline, *partial[i]);
+    });
+    GroupTable groups(pipeline);
+    for (size_t i = 0; i < partial.size(); ++i) {
+        groups.merge(*partial[i]);
+    }
+    return pipeline.finish(groups);
+}
+
+size_t ShardedCollection::remove(const ParsedQuery& query) {
+    Vector<size_t> removed(shards.size(), 0);
+    forEachShard([&](size_t i) {
+        uint64_t position = 0;
+        {
+            Collection::WriteGuard lock = shards[i]->writeLock();
+            removed[i] = shards[i]->remove(query);
+            position = shards[i]->logPosition();
+        }
+        if (removed[i] > 0) {
+            commitShard(i, position);
+        }
+    });
+    size_t total = 0;
+    for (size_t i = 0; i < removed.size(); ++i) {
+        total += removed[i];
+    }
+    return total;
+}
+
+bool ShardedCollection::createIndex(const std::string& field, IndexType type) {
+    Vector<char> created(shards.size(), 1);
+    forEachShard([&](size_t i) {
+        Collection::WriteGuard lock = shards[i]->writeLock();
+        created[i] = shards[i]->createIndex(field, type);
+    });
+    for (size_t i = 0; i < created.size(); ++i) {
+        if (!created[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShardedCollection::dropIndex(const std::string& field) {
+    Vector<char> dropped(shards.size(), 1);
+    forEachShard([&](size_t i) {
+        Collection::WriteGuard lock = shards[i]->writeLock();
+        dropped[i] = shards[i]->dropIndex(field);
+    });
+    for (size_t i = 0; i < dropped.size(); ++i) {
+        if (!dropped[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ShardedCollection::setScanOptions(const ScanOptions& options) {
+    scan_options = options;
+    // параллельность уже между частями: внутри части обход в одном потоке, иначе задачи пула ждали бы друг друга
+    ScanOptions shard_options = options;
+    shard_options.threads = 1;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->setScanOptions(shard_options);
+    }
+}
+
+void ShardedCollection::setDurability(const DurabilityOptions& options) {
+    durability = options;
+    // части только пишут журнал, подтверждение ждём после снятия блокировки части
+    DurabilityOptions shard_options = options;
+    shard_options.caller_waits = true;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->setDurability(shard_options);
+    }
+}
+
+bool ShardedCollection::waitDurable(Durability mode) {
+    bool ok = true;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (!shards[i]->waitDurable(shards[i]->logPosition(), mode)) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+bool ShardedCollection::saveToFile() {
+    Vector<char> saved(shards.size(), 1);
+    // часть блокирует себя сама и только на время снятия вида
+    forEachShard([&](size_t i) {
+        saved[i] = shards[i]->saveToFile();
+    });
+    for (size_t i = 0; i < saved.size(); ++i) {
+        if (!saved[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShardedCollection::maybeCheckpoint() {
+    Vector<char> saved(shards.size(), 1);
+    forEachShard([&](size_t i) {
+        saved[i] = shards[i]->maybeCheckpoint();
+    });
+    for (size_t i = 0; i < saved.size(); ++i) {
+        if (!saved[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ShardedCollection::isDirty() const {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        if (shards[i]->isDirty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShardedCollection::exportToJson(std::ostream& out) const {
+    try {
+        nlohmann::json collection_data = nlohmann::json::object();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            Collection::ReadGuard lock = shards[i]->readLock();
+            Vector<DocumentWrapper> docs = shards[i]->findAll();
+            for (size_t j = 0; j < docs.size(); ++j) {
+                collection_data[docs[j].getField<std::string>("_id")] = docs[j].getRawDocument();
+            }
+        }
+        out << collection_data.dump(4) << std::endl;
+        return static_cast<bool>(out);
+    } catch (const std::exception& e) {
+        std::cerr << "Error exporting collection: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void ShardedCollection::printStats(std::ostream& out) const {
+    out << "Sharded collection '" << name << "': " << shards.size() << " shards in " << directory << std::endl;
+    DocumentMemory total;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->printStats(out);
+        DocumentMemory memory = shards[i]->documentMemory();
+        total.documents += memory.documents;
+        total.bytes += memory.bytes + memory.dictionary_bytes;
+        total.tree_bytes += memory.tree_bytes;
+    }
+    // у каждой части свой словарь имён, он входит в итог
+    out << "  all shards: " << total.documents << " documents in " << total.bytes << " bytes, as json trees ~"
+        << total.tree_bytes << " bytes";
+    if (total.tree_bytes > 0) {
+        out << ", saved " << (1.0 - static_cast<double>(total.bytes) / total.tree_bytes) * 100 << "%";
+    }
+    out << std::endl;
+}
+
+size_t ShardedCollection::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        total += shards[i]->size();
+    }
+    return total;
+}
+
+size_t ShardedCollection::shardCount() const {
+    return shards.size();
+}
+
+std::string ShardedCollection::getName() const {
+    return name;
+}
+
+std::string ShardedCollection::getDirectory() const {
+    return directory;
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef SHARDED_COLLECTION_H
+#define SHARDED_COLLECTION_H
+
+#include "collection.h"
+#include "parser.h"
+#include "vector.h"
+#include <functional>
+#include <iostream>
+#include <string>
+
+class AggregationPipeline;
+class SortOrder;
+
+// коллекция из N независимых частей, часть выбирается по хэшу _id
+// часть - обычная Collection в каталоге <имя>.shards: своя таблица, журнал, снимок, индексы и блокировка
+// изменения разных частей идут параллельно, чтения и обходы расходятся по частям на общем пуле
+// каждая часть согласована сама по себе, общего снимка всех частей нет
+class ShardedCollection {
+private:
+    std::string name;
+    std::string directory;
+    Vector<Collection*> shards;
+    ScanOptions scan_options;
+    DurabilityOptions durability;
+
+    size_t shardOf(const std::string& id) const;
+    // body(0..N-1), по части на задачу пула; при threads == 1 - по очереди
+    void forEachShard(const std::function<void(size_t)>& body) const;
+    // подтверждение изменений части после снятия её блокировки
+    bool commitShard(size_t shard, uint64_t position);
+    // сортировка без limit: в памяти всех частей вместе не больше options.sort_memory
+    bool mergeSorted(const ParsedQuery& query, const FindOptions& options, const SortOrder& order,
+                     const std::function<void(const DocumentWrapper&)>& output) const;
+
+public:
+    static const char* SHARD_COUNT_FILE;
+
+    // shard_count == 0 - число частей читается из каталога; части загружаются параллельно
+    ShardedCollection(const std::string& collection_name, const std::string& db_path, size_t shard_count = 0);
+    ~ShardedCollection();
+    ShardedCollection(const ShardedCollection&) = delete;
+    ShardedCollection& operator=(const ShardedCollection&) = delete;
+
+    // каталог частей коллекции: <db_path>/<имя>.shards
+    static std::string directoryFor(const std::string& collection_name, const std::string& db_path);
+
+    bool insert(const DocumentWrapper& document);
+    bool insert(const std::string& json_str);
+    // пачка делится по частям, части пишутся параллельно
+    size_t insertMany(const Vector<DocumentWrapper>& documents);
+    size_t importNdjson(std::istream& input, size_t batch_size = 1000);
+    bool findById(const std::string& id, DocumentWrapper& result) const;
+    // без skip/limit части ищут параллельно; с ними части обходятся по очереди до skip+limit совпадений
+    Vector<DocumentWrapper> find(const ParsedQuery& query, const FindOptions& options) const;
+    // с limit - куча указателей skip+limit в каждой части и слияние их голов, документы не копируются;
+    // без limit - внешняя сортировка в каждой части на свою долю sort_memory и одно слияние всех серий
+    bool findSorted(const ParsedQuery& query, const FindOptions& options,
+                    const std::function<void(const DocumentWrapper&)>& output) const;
+    size_t count(const ParsedQuery& query) const;
+    // у каждой части своя таблица групп, таблицы сливаются перед итоговыми стадиями
+    Vector<DocumentWrapper> aggregate(const AggregationPipeline& pipeline) const;
+    size_t remove(const ParsedQuery& query);
+
+    bool createIndex(const std::string& field, IndexType type = IndexType::Hash);
+    bool dropIndex(const std::string& field);
+
+    void setScanOptions(const ScanOptions& options);
+    void setDurability(const DurabilityOptions& options);
+    // при caller_waits: ждёт fsync журналов всех частей до их текущего конца
+    bool waitDurable(Durability mode);
+
+    // контрольные точки частей параллельно; блокировки частей не должны быть взяты вызывающим
+    bool saveToFile();
+    // контрольные точки частей по их политике, после изменений и снятия блокировок
+    bool maybeCheckpoint();
+    bool isDirty() const;
+    bool exportToJson(std::ostream& out) const;
+    void printStats(std::ostream& out) const;
+    size_t size() const;
+    size_t shardCount() const;
+    std::string getName() const;
+    std::string getDirectory() const;
+};
+
+#endif
\ No newline at end of file
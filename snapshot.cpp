@@ -0,0 +1,208 @@
+#include "snapshot.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'N', 'S', 'D', 'B', 'S', 'N', 'P', '1'};
+const size_t SNAPSHOT_HEADER_SIZE = 24;
+const size_t MIN_DIRECTORY_ENTRY_SIZE = 16;  // [id_length:4][offset:8][length:4] при пустом id
+
+void putUint(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t getUint(const char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+}
+
+SnapshotReader::SnapshotReader() : fd(-1), base(nullptr), file_size(0) {}
+
+SnapshotReader::~SnapshotReader() {
+    close();
+}
+
+bool SnapshotReader::open(const std::string& file_path) {
+    close();
+    path = file_path;
+    fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < SNAPSHOT_HEADER_SIZE) {
+        std::cerr << "Snapshot file is too short: " << file_path << std::endl;
+        close();
+        return false;
+    }
+    file_size = static_cast<size_t>(st.st_size);
+    void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        std::cerr << "Cannot mmap snapshot: " << file_path << std::endl;
+        close();
+        return false;
+    }
+    base = static_cast<const char*>(mapped);
+    if (memcmp(base, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        std::cerr << "Not a snapshot file: " << file_path << std::endl;
+        close();
+        return false;
+    }
+    // заголовок проверяется до того, как по числу документов резервируется память
+    uint64_t count = getUint(base + 8, 8);
+    uint64_t data_offset = getUint(base + 16, 8);
+    if (data_offset < SNAPSHOT_HEADER_SIZE || data_offset > file_size ||
+        count > (data_offset - SNAPSHOT_HEADER_SIZE) / MIN_DIRECTORY_ENTRY_SIZE) {
+        std::cerr << "Corrupted snapshot header: " << file_path << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SnapshotReader::close() {
+    if (base != nullptr) {
+        munmap(const_cast<char*>(base), file_size);
+        base = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    file_size = 0;
+}
+
+bool SnapshotReader::isOpen() const {
+    return base != nullptr;
+}
+
+size_t SnapshotReader::documentCount() const {
+    return isOpen() ? static_cast<size_t>(getUint(base + 8, 8)) : 0;
+}
+
+bool SnapshotReader::readDirectory(const std::function<void(const std::string& id, const SnapshotEntry& entry)>& visit) const {
+    if (!isOpen()) {
+        return false;
+    }
+    uint64_t count = getUint(base + 8, 8);
+    uint64_t data_offset = getUint(base + 16, 8);
+    if (data_offset > file_size) {
+        std::cerr << "Corrupted snapshot directory: " << path << std::endl;
+        return false;
+    }
+    size_t pos = SNAPSHOT_HEADER_SIZE;
+    std::string id;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (pos + 4 > data_offset) {
+            std::cerr << "Corrupted snapshot directory: " << path << std::endl;
+            return false;
+        }
+        uint32_t id_length = static_cast<uint32_t>(getUint(base + pos, 4));
+        pos += 4;
+        if (pos + id_length + 12 > data_offset) {
+            std::cerr << "Corrupted snapshot directory: " << path << std::endl;
+            return false;
+        }
+        id.assign(base + pos, id_length);
+        pos += id_length;
+        SnapshotEntry entry;
+        entry.offset = getUint(base + pos, 8);
+        entry.length = static_cast<uint32_t>(getUint(base + pos + 8, 4));
+        pos += 12;
+        if (entry.offset < data_offset || entry.offset > file_size || entry.length > file_size - entry.offset) {
+            std::cerr << "Snapshot entry out of bounds for id '" << id << "': " << path << std::endl;
+            return false;
+        }
+        visit(id, entry);
+    }
+    return true;
+}
+
+bool SnapshotReader::materialize(const SnapshotEntry& entry, Document& result) const {
+    if (!isOpen()) {
+        return false;
+    }
+    try {
+        const uint8_t* begin = reinterpret_cast<const uint8_t*>(base + entry.offset);
+        result = nlohmann::json::from_msgpack(begin, begin + entry.length);
+        return true;
+    } catch (const nlohmann::json::exception& e) {
+        std::cerr << "Error decoding snapshot document: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool SnapshotWriter::write(const std::string& file_path, const Vector<const DocumentWrapper*>& documents) {
+    std::ofstream file(file_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Cannot open file for writing: " << file_path << std::endl;
+        return false;
+    }
+    Vector<std::string> ids;
+    ids.reserve(documents.size());
+    uint64_t directory_size = 0;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ids.push_back(documents[i]->getField<std::string>("_id"));
+        directory_size += 4 + ids.back().size() + 12;
+    }
+    uint64_t data_offset = SNAPSHOT_HEADER_SIZE + directory_size;
+
+    std::string header(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    putUint(header, documents.size(), 8);
+    putUint(header, data_offset, 8);
+    file.write(header.data(), header.size());
+
+    // место под каталог, заполняется после записи данных
+    std::string directory(directory_size, '\0');
+    file.write(directory.data(), directory.size());
+
+    directory.clear();
+    uint64_t offset = data_offset;
+    std::vector<uint8_t> encoded;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        encoded.clear();
+        nlohmann::json::to_msgpack(documents[i]->toDocument(), encoded);
+        file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+
+        putUint(directory, ids[i].size(), 4);
+        directory.append(ids[i]);
+        putUint(directory, offset, 8);
+        putUint(directory, encoded.size(), 4);
+        offset += encoded.size();
+    }
+    file.seekp(SNAPSHOT_HEADER_SIZE);
+    file.write(directory.data(), directory.size());
+    file.close();
+    if (!file) {
+        std::cerr << "Error writing snapshot: " << file_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotWriter::syncFile(const std::string& file_path) {
+    int fd = ::open(file_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open for fsync: " << file_path << std::endl;
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    if (!ok) {
+        std::cerr << "fsync failed: " << file_path << std::endl;
+    }
+    return ok;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "document.h"
+#include "vector.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// бинарный снимок коллекции
+// [magic "NSDBSNP1":8][count:8][data_offset:8]
+// каталог, count записей: [id_length:4][id][offset:8][length:4]
+// данные: документы в MessagePack подряд, offset от начала файла; числа little-endian
+struct SnapshotEntry {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+};
+
+// читает снимок через mmap, документы декодируются по одному по запросу
+class SnapshotReader {
+private:
+    int fd;
+    const char* base;
+    size_t file_size;
+    std::string path;
+
+public:
+    SnapshotReader();
+    ~SnapshotReader();
+    SnapshotReader(const SnapshotReader&) = delete;
+    SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+    bool open(const std::string& file_path);
+    void close();
+    bool isOpen() const;
+
+    // число документов по заголовку (open проверил, что каталог такого размера помещается в файл), 0 - снимок не открыт
+    size_t documentCount() const;
+    // обходит каталог id без разбора самих документов
+    bool readDirectory(const std::function<void(const std::string& id, const SnapshotEntry& entry)>& visit) const;
+    bool materialize(const SnapshotEntry& entry, Document& result) const;
+};
+
+class SnapshotWriter {
+public:
+    // пишет документы потоком: сначала заголовок и каталог, потом данные
+    // документы не копируются, указатели должны жить до конца записи
+    static bool write(const std::string& file_path, const Vector<const DocumentWrapper*>& documents);
+    // fsync файла или каталога
+    static bool syncFile(const std::string& file_path);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,367 @@
+#include "sorter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <system_error>
+#include <unistd.h>
+
+namespace {
+
+const Document& missingValue() {
+    static const Document null_value;
+    return null_value;
+}
+
+// поле компактного документа разворачивается в scratch
+const Document& fieldValue(const DocumentWrapper& doc, const std::string& field, Document& scratch) {
+    const Document* value = doc.findField(field, scratch);
+    return value == nullptr ? missingValue() : *value;
+}
+
+int compareValues(const Document& a, const Document& b, bool descending) {
+    int result = 0;
+    if (a < b) {
+        result = -1;
+    } else if (b < a) {
+        result = 1;
+    }
+    return descending ? -result : result;
+}
+
+// примерный размер документа в памяти: узлы json и содержимое строк
+size_t approximateSize(const Document& doc) {
+    size_t size = sizeof(Document);
+    if (doc.is_string()) {
+        size += doc.get_ref<const std::string&>().capacity();
+    } else if (doc.is_object()) {
+        for (auto it = doc.begin(); it != doc.end(); ++it) {
+            size += 48 + it.key().capacity() + approximateSize(it.value());
+        }
+    } else if (doc.is_array()) {
+        for (auto it = doc.begin(); it != doc.end(); ++it) {
+            size += approximateSize(*it);
+        }
+    }
+    return size;
+}
+
+void putUint(std::string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t getUint(const char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+std::string runDirectory(const std::string& directory) {
+    if (!directory.empty()) {
+        return directory;
+    }
+    std::error_code error;
+    std::filesystem::path temp = std::filesystem::temp_directory_path(error);
+    return error ? std::string(".") : temp.string();
+}
+
+std::atomic<uint64_t> run_counter(0);
+
+}
+
+SortOrder::SortOrder(const Vector<SortKey>& sort_keys) : keys(sort_keys) {}
+
+size_t SortOrder::size() const {
+    return keys.size();
+}
+
+Document SortOrder::extract(const DocumentWrapper& doc) const {
+    Document values = Document::array();
+    Document scratch;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        values.push_back(fieldValue(doc, keys[i].field, scratch));
+    }
+    return values;
+}
+
+int SortOrder::compare(const DocumentWrapper& a, const DocumentWrapper& b) const {
+    Document scratch_a;
+    Document scratch_b;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        int result = compareValues(fieldValue(a, keys[i].field, scratch_a), fieldValue(b, keys[i].field, scratch_b),
+                                   keys[i].descending);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+int SortOrder::compareKeys(const Document& a, const Document& b) const {
+    for (size_t i = 0; i < keys.size(); ++i) {
+        int result = compareValues(a[i], b[i], keys[i].descending);
+        if (result != 0) {
+            return result;
+        }
+    }
+    return 0;
+}
+
+TopK::TopK(const SortOrder& sort_order, size_t limit)
+    : order(sort_order), count(limit), next_sequence(0) {}
+
+bool TopK::before(const Entry& a, const Entry& b) const {
+    int result = order.compare(*a.doc, *b.doc);
+    return result != 0 ? result < 0 : a.sequence < b.sequence;
+}
+
+void TopK::add(const DocumentWrapper& doc) {
+    Entry entry{&doc, next_sequence++};
+    auto less = [this](const Entry& a, const Entry& b) { return before(a, b); };
+    if (heap.size() < count) {
+        heap.push_back(entry);
+        std::push_heap(heap.begin(), heap.end(), less);
+        return;
+    }
+    // хуже худшего из отобранных - сразу мимо, куча не трогается
+    if (count == 0 || !before(entry, heap.front())) {
+        return;
+    }
+    std::pop_heap(heap.begin(), heap.end(), less);
+    heap.back() = entry;
+    std::push_heap(heap.begin(), heap.end(), less);
+}
+
+Vector<const DocumentWrapper*> TopK::take() {
+    std::sort_heap(heap.begin(), heap.end(), [this](const Entry& a, const Entry& b) { return before(a, b); });
+    Vector<const DocumentWrapper*> result;
+    result.reserve(heap.size());
+    for (size_t i = 0; i < heap.size(); ++i) {
+        result.push_back(heap[i].doc);
+    }
+    heap.clear();
+    return result;
+}
+
+// серия на диске: записи [sequence:8][keys_length:4][doc_length:4][ключи MessagePack][документ MessagePack]
+class ExternalSorter::RunReader {
+private:
+    std::ifstream file;
+    std::string header;
+    std::string keys_bytes;
+    std::string doc_bytes;
+
+public:
+    Record current;
+
+    explicit RunReader(const std::string& path) : file(path, std::ios::binary), header(16, '\0') {}
+
+    bool isOpen() const {
+        return file.is_open();
+    }
+
+    // false и пустой файл - серия закончилась, false и bad - ошибка
+    bool next(bool& failed) {
+        failed = false;
+        if (!file.read(&header[0], header.size())) {
+            failed = file.gcount() != 0;
+            return false;
+        }
+        current.sequence = getUint(header.data(), 8);
+        keys_bytes.resize(getUint(header.data() + 8, 4));
+        doc_bytes.resize(getUint(header.data() + 12, 4));
+        if (!file.read(&keys_bytes[0], keys_bytes.size()) || !file.read(&doc_bytes[0], doc_bytes.size())) {
+            failed = true;
+            return false;
+        }
+        try {
+            current.keys = Document::from_msgpack(keys_bytes);
+            current.doc = DocumentWrapper(Document::from_msgpack(doc_bytes));
+        } catch (const nlohmann::json::exception& e) {
+            std::cerr << "Error decoding sort run: " << e.what() << std::endl;
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+};
+
+ExternalSorter::ExternalSorter(const SortOrder& sort_order, size_t memory_limit_bytes, const std::string& run_directory)
+    : order(sort_order), memory_limit(memory_limit_bytes), directory(runDirectory(run_directory)),
+      buffer_bytes(0), next_sequence(0) {}
+
+ExternalSorter::~ExternalSorter() {
+    for (size_t i = 0; i < runs.size(); ++i) {
+        std::remove(runs[i].c_str());
+    }
+}
+
+bool ExternalSorter::before(const Record& a, const Record& b) const {
+    int result = order.compareKeys(a.keys, b.keys);
+    return result != 0 ? result < 0 : a.sequence < b.sequence;
+}
+
+void ExternalSorter::sortBuffer() {
+    std::sort(buffer.begin(), buffer.end(), [this](const Record& a, const Record& b) { return before(a, b); });
+}
+
+bool ExternalSorter::add(const DocumentWrapper& source, DocumentWrapper&& output) {
+    Record record;
+    record.keys = order.extract(source);
+    record.sequence = next_sequence++;
+    record.doc = std::move(output);
+    buffer_bytes += sizeof(Record) + approximateSize(record.keys) + approximateSize(record.doc.getRawDocument());
+    buffer.push_back(std::move(record));
+    if (buffer_bytes >= memory_limit) {
+        return spill();
+    }
+    return true;
+}
+
+bool ExternalSorter::spill() {
+    if (buffer.empty()) {
+        return true;
+    }
+    sortBuffer();
+    std::string path = directory + "/nosql_sort_" + std::to_string(getpid()) + "_" +
+                       std::to_string(run_counter++) + ".run";
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Cannot create sort run: " << path << std::endl;
+        return false;
+    }
+    runs.push_back(path);
+    std::string record;
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        std::vector<uint8_t> keys = Document::to_msgpack(buffer[i].keys);
+        std::vector<uint8_t> doc = Document::to_msgpack(buffer[i].doc.getRawDocument());
+        record.clear();
+        putUint(record, buffer[i].sequence, 8);
+        putUint(record, keys.size(), 4);
+        putUint(record, doc.size(), 4);
+        record.append(reinterpret_cast<const char*>(keys.data()), keys.size());
+        record.append(reinterpret_cast<const char*>(doc.data()), doc.size());
+        file.write(record.data(), record.size());
+    }
+    file.flush();
+    if (!file) {
+        std::cerr << "Error writing sort run: " << path << std::endl;
+        return false;
+    }
+    buffer.clear();
+    buffer_bytes = 0;
+    return true;
+}
+
+// источник слияния: серия на диске или отсортированный буфер в памяти
+struct ExternalSorter::MergeSource {
+    size_t owner = 0;                       // номер сортировщика в слиянии
+    std::string path;
+    std::unique_ptr<RunReader> reader;
+    const Vector<Record>* buffer = nullptr;
+    size_t position = 0;
+    const Record* current = nullptr;
+
+    bool next(bool& failed) {
+        failed = false;
+        if (reader) {
+            if (!reader->next(failed)) {
+                return false;
+            }
+            current = &reader->current;
+            return true;
+        }
+        if (position >= buffer->size()) {
+            return false;
+        }
+        current = &(*buffer)[position++];
+        return true;
+    }
+};
+
+bool ExternalSorter::finish(const std::function<void(const DocumentWrapper&)>& output) {
+    Vector<ExternalSorter*> self;
+    self.push_back(this);
+    return merge(self, output);
+}
+
+bool ExternalSorter::merge(const Vector<ExternalSorter*>& sorters, const std::function<void(const DocumentWrapper&)>& output) {
+    if (sorters.empty()) {
+        return true;
+    }
+    // остаток в памяти не пишется на диск: он уже меньше предела и сливается прямо из буфера
+    Vector<std::unique_ptr<MergeSource>> sources;
+    for (size_t i = 0; i < sorters.size(); ++i) {
+        for (size_t j = 0; j < sorters[i]->runs.size(); ++j) {
+            std::unique_ptr<MergeSource> source(new MergeSource());
+            source->owner = i;
+            source->path = sorters[i]->runs[j];
+            source->reader.reset(new RunReader(source->path));
+            if (!source->reader->isOpen()) {
+                std::cerr << "Cannot open sort run: " << source->path << std::endl;
+                return false;
+            }
+            sources.push_back(std::move(source));
+        }
+        if (!sorters[i]->buffer.empty()) {
+            sorters[i]->sortBuffer();
+            std::unique_ptr<MergeSource> source(new MergeSource());
+            source->owner = i;
+            source->buffer = &sorters[i]->buffer;
+            sources.push_back(std::move(source));
+        }
+    }
+
+    const SortOrder& order = sorters[0]->order;
+    // ключи, потом номер сортировщика, потом порядок добавления в нём
+    auto later = [&](size_t a, size_t b) {
+        const MergeSource& x = *sources[a];
+        const MergeSource& y = *sources[b];
+        int result = order.compareKeys(y.current->keys, x.current->keys);
+        if (result != 0) {
+            return result < 0;
+        }
+        if (x.owner != y.owner) {
+            return y.owner < x.owner;
+        }
+        return y.current->sequence < x.current->sequence;
+    };
+    Vector<size_t> heap;    // номера источников, наверху - источник с наименьшей текущей записью
+    bool failed = false;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (sources[i]->next(failed)) {
+            heap.push_back(i);
+        } else if (failed) {
+            std::cerr << "Error reading sort run: " << sources[i]->path << std::endl;
+            return false;
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        size_t source = heap.back();
+        output(sources[source]->current->doc);
+        if (sources[source]->next(failed)) {
+            std::push_heap(heap.begin(), heap.end(), later);
+        } else if (failed) {
+            std::cerr << "Error reading sort run: " << sources[source]->path << std::endl;
+            return false;
+        } else {
+            heap.pop_back();
+        }
+    }
+    for (size_t i = 0; i < sorters.size(); ++i) {
+        sorters[i]->buffer.clear();
+        sorters[i]->buffer_bytes = 0;
+    }
+    return true;
+}
+
+size_t ExternalSorter::runCount() const {
+    return runs.size();
+}
\ No newline at end of file
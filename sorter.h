@@ -0,0 +1,95 @@
+#ifndef SORTER_H
+#define SORTER_H
+
+#include "document.h"
+#include "parser.h"
+#include "vector.h"
+#include <cstdint>
+#include <functional>
+#include <fstream>
+#include <memory>
+#include <string>
+
+// порядок документов по ключам сортировки; значения сравниваются операторами nlohmann
+// (null < bool < числа < объекты < массивы < строки), нет поля - как null
+class SortOrder {
+private:
+    Vector<SortKey> keys;
+
+public:
+    explicit SortOrder(const Vector<SortKey>& sort_keys);
+
+    size_t size() const;
+    // значения ключей документа массивом - для хранения отдельно от документа
+    Document extract(const DocumentWrapper& doc) const;
+    // <0 - a раньше b, 0 - ключи равны
+    int compare(const DocumentWrapper& a, const DocumentWrapper& b) const;
+    int compareKeys(const Document& a, const Document& b) const;
+};
+
+// первые count документов по порядку: куча из count указателей, документы не копируются
+// при равных ключах раньше идёт документ, добавленный раньше
+class TopK {
+private:
+    struct Entry {
+        const DocumentWrapper* doc;
+        uint64_t sequence;
+    };
+    const SortOrder& order;
+    size_t count;
+    Vector<Entry> heap;     // наверху - худший из отобранных
+    uint64_t next_sequence;
+
+    bool before(const Entry& a, const Entry& b) const;
+
+public:
+    TopK(const SortOrder& sort_order, size_t limit);
+
+    void add(const DocumentWrapper& doc);
+    // отобранные по порядку; указатели действительны, пока коллекция не меняется
+    Vector<const DocumentWrapper*> take();
+};
+
+// сортировка без ограничения на число документов: записи копятся в памяти до memory_limit байт,
+// потом отсортированная серия уходит во временный файл; в конце серии сливаются k-путевым слиянием
+// при равных ключах порядок добавления сохраняется
+class ExternalSorter {
+private:
+    struct Record {
+        Document keys;
+        uint64_t sequence = 0;
+        DocumentWrapper doc;
+    };
+    class RunReader;
+    struct MergeSource;
+
+    const SortOrder& order;
+    size_t memory_limit;
+    std::string directory;
+    Vector<Record> buffer;
+    size_t buffer_bytes;
+    Vector<std::string> runs;   // файлы записанных серий
+    uint64_t next_sequence;
+
+    bool before(const Record& a, const Record& b) const;
+    void sortBuffer();
+    bool spill();
+
+public:
+    ExternalSorter(const SortOrder& sort_order, size_t memory_limit_bytes, const std::string& run_directory = "");
+    ~ExternalSorter();
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    // ключи берутся из source, хранится и отдаётся output (например, проекция source)
+    bool add(const DocumentWrapper& source, DocumentWrapper&& output);
+    // отдаёт все записи по порядку; false - ошибка чтения или записи серий
+    bool finish(const std::function<void(const DocumentWrapper&)>& output);
+    // одно k-путевое слияние серий и буферов нескольких сортировщиков с одинаковым порядком
+    // (например, по одному на часть коллекции); при равных ключах раньше идут записи сортировщика с меньшим номером
+    static bool merge(const Vector<ExternalSorter*>& sorters, const std::function<void(const DocumentWrapper&)>& output);
+    // сколько серий ушло на диск
+    size_t runCount() const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(size_t thread_count) : stopping(false) {
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+    for (size_t i = 0; i < thread_count; ++i) {
+        workers.emplace_back([this]() { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    has_task.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            has_task.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) {
+                return; // остановка, очередь пуста
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    has_task.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t parts, const std::function<void(size_t)>& body) {
+    if (parts == 0) {
+        return;
+    }
+    std::mutex done_mutex;
+    std::condition_variable all_done;
+    size_t remaining = parts;
+    for (size_t part = 0; part < parts; ++part) {
+        submit([&, part]() {
+            body(part);
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if (--remaining == 0) {
+                all_done.notify_one();
+            }
+        });
+    }
+    std::unique_lock<std::mutex> lock(done_mutex);
+    all_done.wait(lock, [&remaining]() { return remaining == 0; });
+}
+
+size_t ThreadPool::size() const {
+    return workers.size();
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// пул рабочих потоков для параллельного обхода коллекций
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable has_task;
+    bool stopping;
+
+    void workerLoop();
+
+public:
+    ThreadPool(size_t thread_count);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+    // выполняет body(0..parts-1) на пуле и ждёт завершения всех частей
+    void parallelFor(size_t parts, const std::function<void(size_t)>& body);
+    size_t size() const;
+
+    // общий пул процесса, по потоку на ядро
+    static ThreadPool& shared();
+};
+
+#endif
\ No newline at end of file
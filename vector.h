@@ -1,8 +1,11 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include <new>
 #include <stdexcept>
+#include <utility>
 
+// память выделяется без конструирования, элементы создаются на месте и переносятся при росте
 template<typename T>
 class Vector {
 private:
@@ -10,36 +13,53 @@ private:
     size_t size_ = 0;
     size_t capacity_ = 0;
 
+    static T* allocate(size_t count) {
+        return count == 0 ? nullptr : static_cast<T*>(::operator new(count * sizeof(T)));
+    }
+
+    void destroyRange(size_t from, size_t to) {
+        for (size_t i = from; i < to; ++i) {
+            data_[i].~T();
+        }
+    }
+
     void reallocate(size_t new_capacity) {
-        T* new_data = new T[new_capacity];
-        
+        T* new_data = allocate(new_capacity);
+
         for (size_t i = 0; i < size_; ++i) {
-            new_data[i] = data_[i];
+            new (new_data + i) T(std::move_if_noexcept(data_[i]));
+            data_[i].~T();
         }
-        
-        delete[] data_;
+
+        ::operator delete(data_);
         data_ = new_data;
         capacity_ = new_capacity;
     }
 
+    void grow() {
+        if (size_ >= capacity_) {
+            reallocate(capacity_ == 0 ? 1 : capacity_ * 2);
+        }
+    }
+
 public:
     Vector() = default;
 
-    Vector(size_t count) : size_(count), capacity_(count) {
-        data_ = new T[capacity_];
+    Vector(size_t count) : data_(allocate(count)), size_(0), capacity_(count) {
+        for (; size_ < count; ++size_) {
+            new (data_ + size_) T();
+        }
     }
 
-    Vector(size_t count, const T& value) : size_(count), capacity_(count) {
-        data_ = new T[capacity_];
-        for (size_t i = 0; i < size_; ++i) {
-            data_[i] = value;
+    Vector(size_t count, const T& value) : data_(allocate(count)), size_(0), capacity_(count) {
+        for (; size_ < count; ++size_) {
+            new (data_ + size_) T(value);
         }
     }
 
-    Vector(const Vector& other) : size_(other.size_), capacity_(other.capacity_) {
-        data_ = new T[capacity_];
-        for (size_t i = 0; i < size_; ++i) {
-            data_[i] = other.data_[i];
+    Vector(const Vector& other) : data_(allocate(other.size_)), size_(0), capacity_(other.size_) {
+        for (; size_ < other.size_; ++size_) {
+            new (data_ + size_) T(other.data_[size_]);
         }
     }
 
@@ -53,25 +73,22 @@ public:
     }
 
     ~Vector() {
-        delete[] data_;
+        destroyRange(0, size_);
+        ::operator delete(data_);
     }
 
     Vector& operator=(const Vector& other) {
         if (this != &other) {
-            delete[] data_;
-            size_ = other.size_;
-            capacity_ = other.capacity_;
-            data_ = new T[capacity_];
-            for (size_t i = 0; i < size_; ++i) {
-                data_[i] = other.data_[i];
-            }
+            Vector copy(other);
+            *this = std::move(copy);
         }
         return *this;
     }
 
     Vector& operator=(Vector&& other) noexcept {
         if (this != &other) {
-            delete[] data_;
+            destroyRange(0, size_);
+            ::operator delete(data_);
             data_ = other.data_;
             size_ = other.size_;
             capacity_ = other.capacity_;
@@ -162,27 +179,59 @@ public:
         }
     }
 
+    // лишняя ёмкость отдаётся обратно
+    void shrink_to_fit() {
+        if (capacity_ > size_) {
+            reallocate(size_);
+        }
+    }
+
+    // элементы разрушаются, ёмкость остаётся
     void clear() {
+        destroyRange(0, size_);
         size_ = 0;
     }
 
     void push_back(const T& value) {
         if (size_ >= capacity_) {
-            reserve(capacity_ == 0 ? 1 : capacity_ * 2);
+            // value может лежать в этом же векторе - копия делается до переноса
+            T copy(value);
+            grow();
+            new (data_ + size_) T(std::move(copy));
+        } else {
+            new (data_ + size_) T(value);
         }
-        data_[size_++] = value;
+        ++size_;
     }
 
     void push_back(T&& value) {
         if (size_ >= capacity_) {
-            reserve(capacity_ == 0 ? 1 : capacity_ * 2);
+            T moved(std::move(value));
+            grow();
+            new (data_ + size_) T(std::move(moved));
+        } else {
+            new (data_ + size_) T(std::move(value));
+        }
+        ++size_;
+    }
+
+    // элемент создаётся прямо в памяти вектора из аргументов конструктора
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (size_ >= capacity_) {
+            T created(std::forward<Args>(args)...);
+            grow();
+            new (data_ + size_) T(std::move(created));
+        } else {
+            new (data_ + size_) T(std::forward<Args>(args)...);
         }
-        data_[size_++] = value;
+        return data_[size_++];
     }
 
     void pop_back() {
         if (size_ > 0) {
             --size_;
+            data_[size_].~T();
         }
     }
 
@@ -190,18 +239,28 @@ public:
         if (new_size > capacity_) {
             reserve(new_size);
         }
+        for (; size_ < new_size; ++size_) {
+            new (data_ + size_) T();
+        }
+        destroyRange(new_size, size_);
         size_ = new_size;
     }
 
     void resize(size_t new_size, const T& value) {
         if (new_size > size_) {
             if (new_size > capacity_) {
+                T copy(value);
                 reserve(new_size);
+                for (; size_ < new_size; ++size_) {
+                    new (data_ + size_) T(copy);
+                }
+                return;
             }
-            for (size_t i = size_; i < new_size; ++i) {
-                data_[i] = value;
+            for (; size_ < new_size; ++size_) {
+                new (data_ + size_) T(value);
             }
         }
+        destroyRange(new_size, size_);
         size_ = new_size;
     }
 };
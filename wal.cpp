@@ -0,0 +1,471 @@
+#include "wal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+
+namespace {
+
+struct Crc32Table {
+    uint32_t entries[256];
+};
+
+uint32_t crc32Update(uint32_t crc, const unsigned char* bytes, size_t length) {
+    // статическая инициализация потокобезопасна: журналы разных коллекций пишутся параллельно
+    static const Crc32Table crc_table = [] {
+        Crc32Table result;
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            result.entries[i] = c;
+        }
+        return result;
+    }();
+    const uint32_t* table = crc_table.entries;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+void writeUint32(char* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint32_t readUint32(const char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+}
+
+bool DurabilityOptions::setMode(const std::string& text) {
+    if (text == "none") {
+        mode = Durability::None;
+    } else if (text == "batched") {
+        mode = Durability::Batched;
+    } else if (text == "strict") {
+        mode = Durability::Strict;
+    } else {
+        std::cerr << "Unknown durability mode '" << text << "' (expected none, batched or strict)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+const char* DurabilityOptions::modeName(Durability mode) {
+    switch (mode) {
+        case Durability::Batched:
+            return "batched";
+        case Durability::Strict:
+            return "strict";
+        default:
+            return "none";
+    }
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& log_path)
+    : path(log_path), fd(-1), size_bytes(0), rotated_bytes(0), rotation_position(0), next_rotation(1),
+      written_position(0), synced_position(0), syncing(false), strict_waiters(0) {
+    std::error_code ec;
+    uintmax_t existing = std::filesystem::file_size(path, ec);
+    if (!ec) {
+        size_bytes = static_cast<size_t>(existing);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    closeFile();
+    for (size_t i = 0; i < rotated_fds.size(); ++i) {
+        ::close(rotated_fds[i]);
+    }
+}
+
+uint32_t WriteAheadLog::checksum(uint8_t operation, const std::string& payload) {
+    uint32_t crc = 0xFFFFFFFFu;
+    crc = crc32Update(crc, &operation, 1);
+    crc = crc32Update(crc, reinterpret_cast<const unsigned char*>(payload.data()), payload.size());
+    return crc ^ 0xFFFFFFFFu;
+}
+
+bool WriteAheadLog::ensureOpen() {
+    if (fd >= 0) {
+        return true;
+    }
+    std::error_code ec;
+    bool created = !std::filesystem::exists(path, ec);
+    int opened = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (opened < 0) {
+        std::cerr << "Cannot open log for writing: " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (created) {
+        // без fsync каталога новый журнал может пропасть вместе с подтверждёнными записями
+        std::string directory = std::filesystem::path(path).parent_path().string();
+        int directory_fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (directory_fd >= 0) {
+            fsync(directory_fd);
+            ::close(directory_fd);
+        }
+    }
+    // дескриптор читает лидер группового fsync из другого потока
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    fd = opened;
+    return true;
+}
+
+void WriteAheadLog::closeFile() {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void WriteAheadLog::encode(WalOperation operation, const std::string& payload, std::string& out_buffer) const {
+    uint8_t op = static_cast<uint8_t>(operation);
+    char header[HEADER_SIZE];
+    header[0] = static_cast<char>(op);
+    writeUint32(header + 1, static_cast<uint32_t>(payload.size()));
+    writeUint32(header + 5, checksum(op, payload));
+    out_buffer.append(header, HEADER_SIZE);
+    out_buffer.append(payload);
+}
+
+bool WriteAheadLog::writeBuffer(const std::string& buffer) {
+    if (!ensureOpen()) {
+        return false;
+    }
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        ssize_t written = ::write(fd, buffer.data() + offset, buffer.size() - offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            std::cerr << "Error writing log: " << path << ": " << std::strerror(errno) << std::endl;
+            // недописанная запись срезается, иначе следующие легли бы после битого хвоста и потерялись при replay
+            if (offset > 0 && ftruncate(fd, static_cast<off_t>(size_bytes)) != 0) {
+                std::cerr << "Cannot cut partial log record: " << path << std::endl;
+            }
+            return false;
+        }
+        offset += static_cast<size_t>(written);
+    }
+    size_bytes += buffer.size();
+
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    if (written_position == synced_position) {
+        batch_start = std::chrono::steady_clock::now();
+    }
+    written_position += buffer.size();
+    // пачка набрана - лидер batched не ждёт конца интервала
+    if (durability.mode == Durability::Batched && written_position - synced_position >= durability.batch_bytes) {
+        sync_done.notify_all();
+    }
+    return true;
+}
+
+bool WriteAheadLog::append(WalOperation operation, const std::string& payload) {
+    std::string buffer;
+    buffer.reserve(HEADER_SIZE + payload.size());
+    encode(operation, payload, buffer);
+    return writeBuffer(buffer);
+}
+
+bool WriteAheadLog::appendInsert(const DocumentWrapper& document) {
+    return append(WalOperation::Insert, document.toJson());
+}
+
+bool WriteAheadLog::appendInsertBatch(const Vector<DocumentWrapper>& documents) {
+    if (documents.empty()) {
+        return true;
+    }
+    std::string buffer;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        encode(WalOperation::Insert, documents[i].toJson(), buffer);
+    }
+    return writeBuffer(buffer);
+}
+
+bool WriteAheadLog::appendRemove(const std::string& id) {
+    return append(WalOperation::Remove, id);
+}
+
+bool WriteAheadLog::appendRemoveBatch(const Vector<std::string>& ids) {
+    if (ids.empty()) {
+        return true;
+    }
+    std::string payload;
+    size_t total = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        total += 4 + ids[i].size();
+    }
+    payload.reserve(total);
+    char length[4];
+    for (size_t i = 0; i < ids.size(); ++i) {
+        writeUint32(length, static_cast<uint32_t>(ids[i].size()));
+        payload.append(length, 4);
+        payload.append(ids[i]);
+    }
+    return append(WalOperation::RemoveBatch, payload);
+}
+
+bool WriteAheadLog::decodeIds(const std::string& payload, Vector<std::string>& ids) {
+    size_t pos = 0;
+    while (pos < payload.size()) {
+        if (payload.size() - pos < 4) {
+            return false;
+        }
+        uint32_t length = readUint32(payload.data() + pos);
+        pos += 4;
+        if (payload.size() - pos < length) {
+            return false;
+        }
+        ids.push_back(payload.substr(pos, length));
+        pos += length;
+    }
+    return true;
+}
+
+size_t WriteAheadLog::replay(const std::function<void(const WalRecord&)>& apply) {
+    size_t applied = 0;
+    // отложенные файлы остались от контрольной точки, прерванной сбоем: их записи старше основного файла
+    // снимок мог успеть их вобрать - повторное применение вставок и удалений даёт то же состояние
+    Vector<std::string> rotated = rotatedFiles(path);
+    size_t bytes = 0;
+    rotated_bytes = 0;
+    for (size_t i = 0; i < rotated.size(); ++i) {
+        applied += replayFile(rotated[i], apply, bytes);
+        rotated_bytes += bytes;
+    }
+    if (!rotated.empty()) {
+        next_rotation = std::stoul(rotated.back().substr(path.size() + 1)) + 1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(sync_mutex);
+        rotated_paths = rotated;
+    }
+    applied += replayFile(path, apply, bytes);
+    size_bytes = bytes;
+    return applied;
+}
+
+size_t WriteAheadLog::replayFile(const std::string& file, const std::function<void(const WalRecord&)>& apply,
+                                 size_t& file_bytes) {
+    file_bytes = 0;
+    std::ifstream in(file, std::ios::binary);
+    if (!in.is_open()) {
+        return 0; // журнала нет - нечего применять
+    }
+    std::error_code ec;
+    uintmax_t total_bytes = std::filesystem::file_size(file, ec);
+    if (!ec) {
+        file_bytes = static_cast<size_t>(total_bytes);
+    }
+    size_t applied = 0;
+    size_t valid_bytes = 0;
+    char header[HEADER_SIZE];
+    WalRecord record;
+    while (in.read(header, HEADER_SIZE)) {
+        uint8_t op = static_cast<uint8_t>(header[0]);
+        uint32_t length = readUint32(header + 1);
+        uint32_t expected_crc = readUint32(header + 5);
+        if (valid_bytes + HEADER_SIZE + length > file_bytes) {
+            // длина из битого заголовка: запись не может быть длиннее остатка файла
+            std::cerr << "Corrupted log record length at offset " << valid_bytes << " in " << file << std::endl;
+            break;
+        }
+        record.payload.resize(length);
+        if (!in.read(&record.payload[0], length)) {
+            break; // запись оборвана
+        }
+        if (checksum(op, record.payload) != expected_crc ||
+            op < static_cast<uint8_t>(WalOperation::Insert) || op > static_cast<uint8_t>(WalOperation::RemoveBatch)) {
+            std::cerr << "Corrupted log record at offset " << valid_bytes << " in " << file << std::endl;
+            break;
+        }
+        record.operation = static_cast<WalOperation>(op);
+        apply(record);
+        applied++;
+        valid_bytes += HEADER_SIZE + length;
+    }
+    in.close();
+
+    if (valid_bytes < file_bytes) {
+        // отрезаем недописанный хвост, чтобы новые записи шли после последней целой
+        std::filesystem::resize_file(file, valid_bytes, ec);
+        if (ec) {
+            std::cerr << "Cannot truncate damaged log tail: " << file << std::endl;
+        }
+        file_bytes = valid_bytes;
+    }
+    return applied;
+}
+
+Vector<std::string> WriteAheadLog::rotatedFiles(const std::string& log_path) {
+    std::filesystem::path log(log_path);
+    std::string prefix = log.filename().string() + ".";
+    Vector<std::pair<unsigned long, std::string>> found;
+    std::error_code ec;
+    std::filesystem::directory_iterator it(log.parent_path().empty() ? std::filesystem::path(".") : log.parent_path(), ec);
+    for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+        std::string file = it->path().filename().string();
+        if (file.size() <= prefix.size() || file.compare(0, prefix.size(), prefix) != 0 ||
+            file.find_first_not_of("0123456789", prefix.size()) != std::string::npos) {
+            continue;
+        }
+        found.push_back(std::make_pair(std::stoul(file.substr(prefix.size())), log_path + "." + file.substr(prefix.size())));
+    }
+    std::sort(found.begin(), found.end());
+    Vector<std::string> files;
+    for (size_t i = 0; i < found.size(); ++i) {
+        files.push_back(found[i].second);
+    }
+    return files;
+}
+
+bool WriteAheadLog::rotate() {
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    rotation_position = written_position;
+    if (size_bytes == 0) {
+        return true; // записей после прошлого снимка нет
+    }
+    std::string rotated = path + "." + std::to_string(next_rotation);
+    if (std::rename(path.c_str(), rotated.c_str()) != 0) {
+        std::cerr << "Cannot set log aside for checkpoint: " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    next_rotation++;
+    rotated_paths.push_back(rotated);
+    if (fd >= 0) {
+        // дескриптор с записями без fsync остаётся открытым: их подтверждение ждут писатели
+        if (synced_position < written_position) {
+            rotated_fds.push_back(fd);
+        } else {
+            ::close(fd);
+        }
+        fd = -1;
+    }
+    rotated_bytes += size_bytes;
+    size_bytes = 0;
+    return true;
+}
+
+void WriteAheadLog::dropRotated() {
+    std::unique_lock<std::mutex> lock(sync_mutex);
+    // дескриптор нельзя закрыть под идущим fsync
+    sync_done.wait(lock, [this] { return !syncing; });
+    for (size_t i = 0; i < rotated_fds.size(); ++i) {
+        ::close(rotated_fds[i]);
+    }
+    rotated_fds.clear();
+    for (size_t i = 0; i < rotated_paths.size(); ++i) {
+        if (std::remove(rotated_paths[i].c_str()) != 0) {
+            std::cerr << "Cannot remove log already in snapshot: " << rotated_paths[i] << std::endl;
+        }
+    }
+    rotated_paths.clear();
+    rotated_bytes = 0;
+    synced_position = std::max(synced_position, rotation_position);
+    sync_done.notify_all();
+}
+
+void WriteAheadLog::setDurability(const DurabilityOptions& options) {
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    durability = options;
+}
+
+uint64_t WriteAheadLog::position() const {
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    return written_position;
+}
+
+bool WriteAheadLog::waitDurable(uint64_t target, Durability mode) {
+    if (mode == Durability::None) {
+        return true;
+    }
+    std::unique_lock<std::mutex> lock(sync_mutex);
+    if (mode == Durability::Strict) {
+        strict_waiters++;
+        sync_done.notify_all();
+    }
+    bool ok = true;
+    while (synced_position < target) {
+        if (syncing) {
+            sync_done.wait(lock);
+            continue;
+        }
+        syncing = true;
+        if (mode == Durability::Batched && strict_waiters == 0) {
+            // лидер собирает группу: до конца интервала с первой записи, набранной пачки или прихода strict
+            std::chrono::steady_clock::time_point deadline =
+                batch_start + std::chrono::milliseconds(durability.batch_interval_ms);
+            sync_done.wait_until(lock, deadline, [this] {
+                return strict_waiters > 0 || written_position - synced_position >= durability.batch_bytes;
+            });
+        }
+        uint64_t covered = written_position;
+        // отложенные контрольной точкой файлы, пока их записи не подтверждены, и текущий
+        Vector<int> sync_fds = rotated_fds;
+        if (fd >= 0) {
+            sync_fds.push_back(fd);
+        }
+        lock.unlock();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        bool synced = true;
+        for (size_t i = 0; i < sync_fds.size() && synced; ++i) {
+            synced = fdatasync(sync_fds[i]) == 0;
+        }
+        int sync_error = synced ? 0 : errno;
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        lock.lock();
+        syncing = false;
+        if (synced) {
+            synced_position = std::max(synced_position, covered);
+            // записи, пришедшие во время fsync, открывают следующую группу
+            batch_start = std::chrono::steady_clock::now();
+            sync_stats.syncs++;
+            sync_stats.total_ms += elapsed;
+            sync_stats.max_ms = std::max(sync_stats.max_ms, elapsed);
+        } else {
+            std::cerr << "fsync failed for log " << path << ": " << std::strerror(sync_error) << std::endl;
+            ok = false;
+        }
+        sync_done.notify_all();
+        if (!ok) {
+            break;
+        }
+    }
+    if (mode == Durability::Strict) {
+        strict_waiters--;
+    }
+    if (ok) {
+        sync_stats.commits++;
+    }
+    return ok;
+}
+
+LogSyncStats WriteAheadLog::syncStats() const {
+    std::lock_guard<std::mutex> lock(sync_mutex);
+    return sync_stats;
+}
+
+size_t WriteAheadLog::sizeBytes() const {
+    return size_bytes + rotated_bytes;
+}
+
+std::string WriteAheadLog::getPath() const {
+    return path;
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include "document.h"
+#include "vector.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+enum class WalOperation : uint8_t {
+    Insert = 1,
+    Remove = 2,
+    RemoveBatch = 3   // id пачки удаления одной записью: целиком применяется или целиком отбрасывается
+};
+
+struct WalRecord {
+    WalOperation operation;
+    std::string payload; // insert - JSON документа, remove - id, remove batch - [length:4][id] подряд
+};
+
+// когда запись считается подтверждённой
+enum class Durability {
+    None,     // записано в буфер ОС, fsync только при контрольной точке
+    Batched,  // fsync общий для всех записей за batch_interval_ms или batch_bytes
+    Strict    // fsync до ответа (одновременные писатели всё равно делят один fsync)
+};
+
+struct DurabilityOptions {
+    Durability mode = Durability::None;
+    long long batch_interval_ms = 10;
+    size_t batch_bytes = 1024 * 1024;
+    // true - изменения только пишутся в журнал, fsync ждёт вызывающий через waitDurable
+    // (сервер ждёт вне общей блокировки, иначе писатели не попадут в одну группу)
+    bool caller_waits = false;
+
+    // "none", "batched" или "strict"; false - неизвестный режим
+    bool setMode(const std::string& text);
+    static const char* modeName(Durability mode);
+};
+
+struct LogSyncStats {
+    uint64_t syncs = 0;        // вызовов fsync журнала
+    uint64_t commits = 0;      // подтверждений, дождавшихся fsync; commits / syncs - размер группы
+    double total_ms = 0;
+    double max_ms = 0;
+};
+
+// журнал операций коллекции, запись только в конец файла
+// формат записи: [op:1][length:4][crc32:4][payload:length], числа little-endian
+// контрольная точка откладывает текущий файл как <путь>.<n> и пишет снимок, пока новые записи идут в новый файл;
+// отложенные файлы удаляются, когда снимок на диске, а после сбоя применяются перед основным
+class WriteAheadLog {
+private:
+    std::string path;
+    int fd;                  // открывается при первой записи
+    std::atomic<size_t> size_bytes;      // размер читается без блокировки коллекции (проверка контрольной точки)
+    std::atomic<size_t> rotated_bytes;   // отложенные файлы
+    Vector<std::string> rotated_paths;   // под sync_mutex
+    Vector<int> rotated_fds;             // отложенные с записями без fsync: лидер группы синхронизирует и их
+    uint64_t rotation_position;          // конец журнала на момент последнего rotate
+    unsigned long next_rotation;
+
+    // групповой fsync: записи идут под блокировкой коллекции, ожидание fsync - под sync_mutex
+    // позиции считаются в байтах, записанных за время работы, и не сбрасываются при rotate
+    mutable std::mutex sync_mutex;
+    std::condition_variable sync_done;
+    DurabilityOptions durability;
+    uint64_t written_position;
+    uint64_t synced_position;
+    std::chrono::steady_clock::time_point batch_start;  // первая запись, ещё не прошедшая fsync
+    bool syncing;
+    size_t strict_waiters;   // ждущим в strict лидер группы batched не тянет время
+    LogSyncStats sync_stats;
+
+    bool append(WalOperation operation, const std::string& payload);
+    void encode(WalOperation operation, const std::string& payload, std::string& out_buffer) const;
+    bool writeBuffer(const std::string& buffer);
+    bool ensureOpen();
+    void closeFile();
+    // целые записи одного файла, битый хвост отрезается; file_bytes - размер после этого
+    size_t replayFile(const std::string& file, const std::function<void(const WalRecord&)>& apply, size_t& file_bytes);
+
+public:
+    static const size_t HEADER_SIZE = 9;
+
+    WriteAheadLog(const std::string& log_path);
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    bool appendInsert(const DocumentWrapper& document);
+    bool appendRemove(const std::string& id);
+    bool appendRemoveBatch(const Vector<std::string>& ids);
+    // все записи пачки одной записью в файл
+    bool appendInsertBatch(const Vector<DocumentWrapper>& documents);
+
+    // применяет все целые записи по порядку: сначала отложенные файлы, потом основной;
+    // битый хвост (оборванная запись) отрезается
+    size_t replay(const std::function<void(const WalRecord&)>& apply);
+    // начало контрольной точки (вызывается под блокировкой записи коллекции): текущий файл откладывается,
+    // следующая запись создаст новый
+    bool rotate();
+    // снимок с записями отложенных файлов прошёл fsync: файлы удаляются, записанное до rotate считается на диске
+    void dropRotated();
+    // отложенные файлы журнала log_path по порядку
+    static Vector<std::string> rotatedFiles(const std::string& log_path);
+
+    void setDurability(const DurabilityOptions& options);
+    // конец журнала после последней записи, для waitDurable
+    uint64_t position() const;
+    // ждёт, пока журнал до position будет на диске: первый ждущий делает fsync за всех,
+    // кто успел записать до его начала, остальные ждут его; false - fsync не удался
+    bool waitDurable(uint64_t position, Durability mode);
+    LogSyncStats syncStats() const;
+
+    // вместе с отложенными файлами
+    size_t sizeBytes() const;
+    std::string getPath() const;
+
+    static uint32_t checksum(uint8_t operation, const std::string& payload);
+    // id из записи RemoveBatch, false - запись повреждена
+    static bool decodeIds(const std::string& payload, Vector<std::string>& ids);
+};
+
+#endif
\ No newline at end of file